@@ -0,0 +1,34 @@
+#ifndef __BENCH_H
+#define __BENCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+///
+/// @brief A benchmark that can be run by configd_bench.
+///
+struct bench
+{
+    const char* name; ///< The name used to select the benchmark on the command line.
+    const char* usage; ///< A description of the arguments the benchmark accepts.
+    int (*run)(int argc, char** argv); ///< Runs the benchmark; returns the process exit code.
+};
+
+uint64_t bench_now(void);
+void bench_report(const char* name, uint64_t iterations, uint64_t elapsed);
+
+int bench_generate(int argc, char** argv);
+int bench_yaml(int argc, char** argv);
+int bench_xml(int argc, char** argv);
+int bench_xslt(int argc, char** argv);
+int bench_parallel(int argc, char** argv);
+int bench_records(int argc, char** argv);
+int bench_diff(int argc, char** argv);
+int bench_template(int argc, char** argv);
+int bench_emit(int argc, char** argv);
+int bench_binary(int argc, char** argv);
+int bench_e2e(int argc, char** argv);
+int bench_replay(int argc, char** argv);
+int bench_watch(int argc, char** argv);
+
+#endif
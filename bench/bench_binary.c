@@ -0,0 +1,109 @@
+///
+/// @file
+/// @brief Compares reading the binary object format against re-parsing YAML.
+///
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "bench.h"
+#include "../hive_yaml.h"
+#include "../hive_binary.h"
+
+///
+/// @internal
+/// @brief Looks up every top level key of a document in place.
+///
+/// @return The number of keys that were found, to keep the work observable.
+///
+static uint32_t bench_binary_lookup_all(const void* data, size_t length, struct object* document)
+{
+    struct hive_binary_header header;
+    struct hive_binary_node node;
+    uint32_t found = 0;
+    hive_binary_read_header(data, length, &header);
+    const void* payload = hive_binary_read_node(data, header.length, header.root, &node);
+    if (payload == NULL || node.type != HIVE_BINARY_TYPE_MAP || document->type != OBJECT_TYPE_MAP)
+        return 0;
+    list_iterator_start(&document->map);
+    while (list_iterator_hasnext(&document->map))
+    {
+        struct map_entry* entry = list_iterator_next(&document->map);
+        if (entry->key->type == OBJECT_TYPE_STRING &&
+            hive_binary_map_find(data, header.length, payload, node.count,
+                                 (const char*)entry->key->string->data, blength(entry->key->string)) != 0)
+            found++;
+    }
+    list_iterator_stop(&document->map);
+    return found;
+}
+
+///
+/// @brief Runs the binary format benchmark.
+///
+/// Measures parsing the YAML source, encoding, decoding, mapping the
+/// encoded file and resolving every top level key in place.
+///
+int bench_binary(int argc, char** argv)
+{
+    if (argc < 1)
+    {
+        fprintf(stderr, "binary: missing yaml file\n");
+        return 1;
+    }
+    bstring path = bfromcstr(argv[0]);
+    uint64_t iterations = argc >= 2 ? strtoull(argv[1], NULL, 10) : 100;
+    uint64_t start;
+    
+    struct object* document = hive_yaml_parse_file(path);
+    if (document == NULL)
+    {
+        fprintf(stderr, "binary: unable to parse %s\n", argv[0]);
+        return 1;
+    }
+    bstring encoded = hive_binary_encode(document);
+    bstring binary_path = bformat("%s.bin", argv[0]);
+    hive_binary_write_file(binary_path, document);
+    printf("yaml source %s, binary size %d bytes\n", argv[0], blength(encoded));
+    
+    start = bench_now();
+    for (uint64_t i = 0; i < iterations; i++)
+        hive_object_free(hive_yaml_parse_file(path));
+    bench_report("yaml parse", iterations, bench_now() - start);
+    
+    start = bench_now();
+    for (uint64_t i = 0; i < iterations; i++)
+        bdestroy(hive_binary_encode(document));
+    bench_report("binary encode", iterations, bench_now() - start);
+    
+    start = bench_now();
+    for (uint64_t i = 0; i < iterations; i++)
+        hive_object_free(hive_binary_decode(encoded->data, blength(encoded)));
+    bench_report("binary decode", iterations, bench_now() - start);
+    
+    uint32_t found = 0;
+    start = bench_now();
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        size_t length;
+        const void* data = hive_binary_map_file(binary_path, &length);
+        if (data == NULL)
+            break;
+        found += bench_binary_lookup_all(data, length, document);
+        hive_binary_unmap_file(data, length);
+    }
+    bench_report("binary map + lookup all keys", iterations, bench_now() - start);
+    
+    start = bench_now();
+    for (uint64_t i = 0; i < iterations; i++)
+        found += bench_binary_lookup_all(encoded->data, blength(encoded), document);
+    bench_report("binary lookup all keys", iterations, bench_now() - start);
+    printf("%u keys found\n", found);
+    
+    unlink((const char*)binary_path->data);
+    bdestroy(binary_path);
+    bdestroy(encoded);
+    hive_object_free(document);
+    bdestroy(path);
+    return 0;
+}
@@ -0,0 +1,153 @@
+///
+/// @file
+/// @brief Measures the latency from writing a source to the output being visible.
+///
+/// The daemon is run in-process: the benchmark rewrites the YAML source and
+/// then drives the same poll loop as app_run until the output changes, so
+/// the measurement covers change delivery (by any of the watch backends),
+/// dispatch and the whole regeneration pipeline.
+///
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "bench.h"
+#include "../hive_app.h"
+#include "../hive_sched.h"
+#include "../hive_watch.h"
+#include "../hive_stats.h"
+
+#define BENCH_E2E_TIMEOUT 10000000000ULL ///< Give up on an iteration after 10 seconds.
+
+///
+/// @internal
+/// @brief Copies a file, appending a top-level entry so that the data always changes.
+///
+/// A comment would not do: a source whose data is unchanged keeps it's old
+/// tree, and an output whose content is unchanged is not written again.
+///
+static bool bench_e2e_copy(const char* from, const char* to, uint64_t iteration)
+{
+    FILE* input = fopen(from, "rb");
+    if (input == NULL)
+        return false;
+    bstring content = bread((bNread)fread, input);
+    fclose(input);
+    if (iteration != 0)
+    {
+        bstring entry = bformat("\nconfigd_bench_iteration: %llu\n", (unsigned long long)iteration);
+        bconcat(content, entry);
+        bdestroy(entry);
+    }
+    FILE* output = fopen(to, "wb");
+    bool result = output != NULL && fwrite(content->data, 1, blength(content), output) == (size_t)blength(content);
+    if (output != NULL)
+        fclose(output);
+    bdestroy(content);
+    return result;
+}
+
+///
+/// @internal
+/// @brief Returns the modification time of a file in nanoseconds, or 0 if it is missing.
+///
+static uint64_t bench_e2e_mtime(const char* path)
+{
+    struct stat st;
+    if (stat(path, &st) != 0)
+        return 0;
+    return (uint64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+///
+/// @brief Measures source-write-to-output-visible latency.
+///
+/// Usage: e2e <file.yml> <file.xslt> [iterations] [inotify|fanotify|poll]
+///
+int bench_e2e(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "e2e: missing yaml or xslt file\n");
+        return 1;
+    }
+    uint64_t iterations = argc >= 3 ? strtoull(argv[2], NULL, 10) : 20;
+    const struct hive_watch_backend* backend = argc >= 4 ? hive_watch_find(argv[3]) : NULL;
+    if (argc >= 4 && backend == NULL)
+    {
+        fprintf(stderr, "e2e: unknown watch backend: %s\n", argv[3]);
+        return 1;
+    }
+    char root[] = "/tmp/configd_bench.XXXXXX";
+    if (mkdtemp(root) == NULL)
+    {
+        fprintf(stderr, "e2e: unable to create a temporary directory\n");
+        return 1;
+    }
+    bstring source = bformat("%s/source", root);
+    bstring active = bformat("%s/active", root);
+    mkdir((const char*)source->data, 0755);
+    mkdir((const char*)active->data, 0755);
+    bstring yaml = bformat("%s/bench.yml", source->data);
+    bstring xslt = bformat("%s/bench.xslt", source->data);
+    bstring output = bformat("%s/bench", active->data);
+    bench_e2e_copy(argv[1], (const char*)xslt->data, 0);
+    
+    // Start the daemon with everything except snapshots at their defaults.
+    app_t app;
+    memset(&app, 0, sizeof(app));
+    app.source.path = source;
+    app.active.path = active;
+    app.snapshot.name = bformat("/configd_bench.%d", (int)getpid());
+    app.source.backend = backend;
+    app.poll.interval = 100;
+    app_init(&app);
+    
+    struct hive_histogram* histogram = calloc(1, sizeof(struct hive_histogram));
+    uint64_t total = 0;
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        uint64_t previous = bench_e2e_mtime((const char*)output->data);
+        uint64_t start = bench_now();
+        if (!bench_e2e_copy(argv[0], (const char*)yaml->data, i + 1))
+        {
+            fprintf(stderr, "e2e: unable to copy %s\n", argv[0]);
+            break;
+        }
+        while (bench_e2e_mtime((const char*)output->data) == previous && bench_now() - start < BENCH_E2E_TIMEOUT)
+        {
+            hive_watch_wait(&app, app.sched.pending > 0 ? 0 : start + BENCH_E2E_TIMEOUT);
+            hive_watch_poll(&app);
+            hive_sched_poll(&app);
+        }
+        uint64_t elapsed = bench_now() - start;
+        if (elapsed >= BENCH_E2E_TIMEOUT)
+        {
+            fprintf(stderr, "e2e: output was not regenerated\n");
+            iterations = i;
+            break;
+        }
+        hive_histogram_record(histogram, elapsed);
+        total += elapsed;
+        
+        // Keep consecutive writes from sharing an mtime.
+        usleep(10000);
+    }
+    bench_report("source write to output visible", iterations, total);
+    printf("%-32s p50 %.1f us, p90 %.1f us, p99 %.1f us, max %.1f us\n", "",
+           hive_histogram_percentile(histogram, 50) / 1000.0, hive_histogram_percentile(histogram, 90) / 1000.0,
+           hive_histogram_percentile(histogram, 99) / 1000.0, histogram->max / 1000.0);
+    
+    shm_unlink((const char*)app.snapshot.name->data);
+    unlink((const char*)yaml->data);
+    unlink((const char*)xslt->data);
+    unlink((const char*)output->data);
+    rmdir((const char*)source->data);
+    rmdir((const char*)active->data);
+    rmdir(root);
+    free(histogram);
+    return 0;
+}
@@ -0,0 +1,239 @@
+///
+/// @file
+/// @brief Generates synthetic YAML and XSLT configuration corpora.
+///
+/// The shapes are modeled on the samples: "hosts" is a single hosts-style
+/// map of address to list of names (sample/hosts.yml), "flat" is a map of
+/// scalar settings (sample/ldap.conf.yml), "lists" is a few keys with very
+/// long lists, "deep" is a chain of nested maps, and "many" is a large
+/// number of small ldap.conf-style files.
+///
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "bench.h"
+
+///
+/// @internal
+/// @brief Renders each entry as "key value" or "key v1 v2 ..." (like sample/hosts.xslt).
+///
+static const char* bench_generate_xslt_records =
+    "<?xml version=\"1.0\" ?>\n"
+    "<xsl:stylesheet version=\"1.0\" xmlns:xsl=\"http://www.w3.org/1999/XSL/Transform\"\n"
+    "                xmlns:cfg=\"urn:configd:cfg\" cfg:records=\"yes\">\n"
+    "<xsl:output method=\"text\" />\n"
+    "<xsl:strip-space elements=\"*\" />\n"
+    "\n"
+    "<xsl:template match=\"/configuration/map\">\n"
+    "    <xsl:for-each select=\"entry\">\n"
+    "        <xsl:value-of select=\"key/*\" />\n"
+    "        <xsl:for-each select=\"value/string | value/list/*\">\n"
+    "            <xsl:text> </xsl:text>\n"
+    "            <xsl:value-of select=\"text()\" />\n"
+    "        </xsl:for-each>\n"
+    "        <xsl:text>&#xa;</xsl:text>\n"
+    "    </xsl:for-each>\n"
+    "</xsl:template>\n"
+    "\n"
+    "</xsl:stylesheet>\n";
+
+///
+/// @internal
+/// @brief Renders every string in the document, one per line, at any depth.
+///
+static const char* bench_generate_xslt_strings =
+    "<?xml version=\"1.0\" ?>\n"
+    "<xsl:stylesheet version=\"1.0\" xmlns:xsl=\"http://www.w3.org/1999/XSL/Transform\">\n"
+    "<xsl:output method=\"text\" />\n"
+    "<xsl:strip-space elements=\"*\" />\n"
+    "\n"
+    "<xsl:template match=\"string\">\n"
+    "    <xsl:value-of select=\".\" />\n"
+    "    <xsl:text>&#xa;</xsl:text>\n"
+    "</xsl:template>\n"
+    "\n"
+    "</xsl:stylesheet>\n";
+
+///
+/// @internal
+/// @brief The native template equivalent of bench_generate_xslt_records.
+///
+static const char* bench_generate_template_records =
+    "{{- each -}}\n"
+    "{{key}}{{if string}} {{.}}{{elif list}}{{each}} {{.}}{{end}}{{end}}\n"
+    "{{end -}}\n";
+
+///
+/// @internal
+/// @brief The built-in format equivalent of bench_generate_xslt_records.
+///
+static const char* bench_generate_emit_records =
+    "format hosts\n";
+
+///
+/// @internal
+/// @brief Opens a file in the corpus for writing.
+///
+static FILE* bench_generate_open(const char* directory, const char* name, const char* extension)
+{
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s.%s", directory, name, extension);
+    FILE* file = fopen(path, "w");
+    if (file == NULL)
+        fprintf(stderr, "generate: unable to write %s\n", path);
+    return file;
+}
+
+///
+/// @internal
+/// @brief Writes a stylesheet (or template, or .emit file) into the corpus.
+///
+static int bench_generate_xslt(const char* directory, const char* name, const char* xslt, const char* extension)
+{
+    FILE* file = bench_generate_open(directory, name, extension);
+    if (file == NULL)
+        return 1;
+    fputs(xslt, file);
+    fclose(file);
+    return 0;
+}
+
+///
+/// @internal
+/// @brief Writes a hosts-style map of addresses to lists of names.
+///
+static void bench_generate_hosts(FILE* file, unsigned long count)
+{
+    for (unsigned long i = 0; i < count; i++)
+    {
+        fprintf(file, "10.%lu.%lu.%lu:\n", (i >> 16) & 255, (i >> 8) & 255, i & 255);
+        fprintf(file, "    - host%lu.example.com\n", i);
+        if (i % 3 == 0)
+            fprintf(file, "    - host%lu\n", i);
+    }
+}
+
+///
+/// @internal
+/// @brief Writes a map of scalar settings.
+///
+static void bench_generate_flat(FILE* file, unsigned long count)
+{
+    for (unsigned long i = 0; i < count; i++)
+        fprintf(file, "setting_%lu: value-%lu\n", i, i * 7919);
+}
+
+///
+/// @internal
+/// @brief Writes a few keys with very long lists.
+///
+static void bench_generate_lists(FILE* file, unsigned long count)
+{
+    for (unsigned long key = 0; key < 4; key++)
+    {
+        fprintf(file, "list_%lu:\n", key);
+        for (unsigned long i = 0; i < count; i++)
+            fprintf(file, "    - item-%lu-%lu\n", key, i);
+    }
+}
+
+///
+/// @internal
+/// @brief Writes a chain of nested maps, with a few scalars at each level.
+///
+static void bench_generate_deep(FILE* file, unsigned long depth)
+{
+    for (unsigned long level = 0; level < depth; level++)
+    {
+        fprintf(file, "%*sname: level-%lu\n", (int)(level * 2), "", level);
+        fprintf(file, "%*senabled: yes\n", (int)(level * 2), "");
+        fprintf(file, "%*schild:\n", (int)(level * 2), "");
+    }
+    fprintf(file, "%*sname: leaf\n", (int)(depth * 2), "");
+}
+
+///
+/// @brief Generates a synthetic corpus.
+///
+/// Usage: generate <directory> <hosts|flat|lists|deep|many|all> [scale]
+///
+/// The scale is the number of entries (hosts, flat), the length of each
+/// list (lists), the nesting depth (deep) or the number of files (many).
+/// Note that each level of nesting becomes three levels of XML, and libxml2
+/// refuses documents nested more than 256 levels deep.
+///
+int bench_generate(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "generate: missing directory or shape\n");
+        return 1;
+    }
+    const char* directory = argv[0];
+    const char* shape = argv[1];
+    bool all = strcmp(shape, "all") == 0;
+    unsigned long scale = argc >= 3 ? strtoul(argv[2], NULL, 10) : 0;
+    if (mkdir(directory, 0755) != 0 && errno != EEXIST)
+    {
+        fprintf(stderr, "generate: unable to create %s\n", directory);
+        return 1;
+    }
+    
+    struct
+    {
+        const char* name;
+        void (*write)(FILE* file, unsigned long scale);
+        unsigned long scale;
+        const char* xslt;
+    } shapes[] =
+    {
+        { "hosts", bench_generate_hosts, 100000, bench_generate_xslt_records },
+        { "flat", bench_generate_flat, 10000, bench_generate_xslt_records },
+        { "lists", bench_generate_lists, 10000, bench_generate_xslt_records },
+        { "deep", bench_generate_deep, 60, bench_generate_xslt_strings },
+    };
+    bool found = false;
+    for (size_t i = 0; i < sizeof(shapes) / sizeof(shapes[0]); i++)
+    {
+        if (!all && strcmp(shape, shapes[i].name) != 0)
+            continue;
+        found = true;
+        FILE* file = bench_generate_open(directory, shapes[i].name, "yml");
+        if (file == NULL)
+            return 1;
+        shapes[i].write(file, scale != 0 ? scale : shapes[i].scale);
+        fclose(file);
+        if (bench_generate_xslt(directory, shapes[i].name, shapes[i].xslt, "xslt") != 0)
+            return 1;
+        if (shapes[i].xslt == bench_generate_xslt_records &&
+            (bench_generate_xslt(directory, shapes[i].name, bench_generate_template_records, "tmpl") != 0 ||
+             bench_generate_xslt(directory, shapes[i].name, bench_generate_emit_records, "emit") != 0))
+            return 1;
+    }
+    if (all || strcmp(shape, "many") == 0)
+    {
+        found = true;
+        unsigned long count = scale != 0 ? scale : 1000;
+        for (unsigned long i = 0; i < count; i++)
+        {
+            char name[64];
+            snprintf(name, sizeof(name), "small%05lu.conf", i);
+            FILE* file = bench_generate_open(directory, name, "yml");
+            if (file == NULL)
+                return 1;
+            bench_generate_flat(file, 10);
+            fclose(file);
+            if (bench_generate_xslt(directory, name, bench_generate_xslt_records, "xslt") != 0)
+                return 1;
+        }
+    }
+    if (!found)
+    {
+        fprintf(stderr, "generate: unknown shape %s\n", shape);
+        return 1;
+    }
+    return 0;
+}
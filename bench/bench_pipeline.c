@@ -0,0 +1,508 @@
+///
+/// @file
+/// @brief Micro benchmarks for each stage of the regeneration pipeline.
+///
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "bench.h"
+#include "../hive_yaml.h"
+#include "../hive_xslt.h"
+#include "../hive_template.h"
+#include "../hive_emit.h"
+#include "../hive_stats.h"
+#include "../hive_output.h"
+#include "../hive_records.h"
+#include "../hive_diff.h"
+#include <libxml/xmlmemory.h>
+
+///
+/// @internal
+/// @brief The number of allocations libxml2 and libxslt have made.
+///
+static uint64_t bench_pipeline_allocations = 0;
+
+static void* bench_pipeline_malloc(size_t size)
+{
+    bench_pipeline_allocations++;
+    return malloc(size);
+}
+
+static void* bench_pipeline_realloc(void* pointer, size_t size)
+{
+    bench_pipeline_allocations++;
+    return realloc(pointer, size);
+}
+
+static char* bench_pipeline_strdup(const char* string)
+{
+    bench_pipeline_allocations++;
+    size_t length = strlen(string) + 1;
+    return memcpy(malloc(length), string, length);
+}
+
+///
+/// @internal
+/// @brief Counts the allocations libxml2 and libxslt make from now on.
+///
+/// This must be called before libxml2 is used at all.
+///
+static void bench_pipeline_count_allocations()
+{
+    xmlGcMemSetup(free, bench_pipeline_malloc, bench_pipeline_malloc, bench_pipeline_realloc, bench_pipeline_strdup);
+}
+
+///
+/// @internal
+/// @brief Parses the YAML file named by the first argument.
+///
+static struct object* bench_pipeline_load(int argc, char** argv, const char* name)
+{
+    if (argc < 1)
+    {
+        fprintf(stderr, "%s: missing yaml file\n", name);
+        return NULL;
+    }
+    bstring path = bfromcstr(argv[0]);
+    struct object* document = hive_yaml_parse_file(path);
+    bdestroy(path);
+    if (document == NULL)
+        fprintf(stderr, "%s: unable to parse %s\n", name, argv[0]);
+    return document;
+}
+
+///
+/// @brief Measures parsing a YAML file.
+///
+/// Usage: yaml <file.yml> [iterations]
+///
+int bench_yaml(int argc, char** argv)
+{
+    struct object* document = bench_pipeline_load(argc, argv, "yaml");
+    if (document == NULL)
+        return 1;
+    hive_object_free(document);
+    bstring path = bfromcstr(argv[0]);
+    uint64_t iterations = argc >= 2 ? strtoull(argv[1], NULL, 10) : 100;
+    uint64_t start = bench_now();
+    for (uint64_t i = 0; i < iterations; i++)
+        hive_object_free(hive_yaml_parse_file(path));
+    bench_report("yaml parse", iterations, bench_now() - start);
+    bdestroy(path);
+    return 0;
+}
+
+///
+/// @brief Measures converting a parsed YAML file to XML text, and building the
+///        equivalent document directly (as the daemon does).
+///
+/// Usage: xml <file.yml> [iterations]
+///
+int bench_xml(int argc, char** argv)
+{
+    struct object* document = bench_pipeline_load(argc, argv, "xml");
+    if (document == NULL)
+        return 1;
+    uint64_t iterations = argc >= 2 ? strtoull(argv[1], NULL, 10) : 100;
+    bench_pipeline_count_allocations();
+    uint64_t start = bench_now();
+    for (uint64_t i = 0; i < iterations; i++)
+        bdestroy(hive_xslt_object_to_xml(document));
+    bench_report("object to xml", iterations, bench_now() - start);
+    
+    uint64_t allocations = bench_pipeline_allocations;
+    start = bench_now();
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        bstring xml = hive_xslt_object_to_xml(document);
+        xmlFreeDoc(xmlReadMemory((const char*)xml->data, blength(xml), "unnamed.xml", NULL, 0));
+        bdestroy(xml);
+    }
+    bench_report("object to xml to document", iterations, bench_now() - start);
+    printf("%-32s %10llu iterations %14.1f allocations/op\n", "  libxml2 allocations", (unsigned long long)iterations,
+           iterations == 0 ? 0.0 : (double)(bench_pipeline_allocations - allocations) / iterations);
+    
+    allocations = bench_pipeline_allocations;
+    start = bench_now();
+    for (uint64_t i = 0; i < iterations; i++)
+        xmlFreeDoc(hive_xslt_object_to_document(document));
+    bench_report("object to document", iterations, bench_now() - start);
+    printf("%-32s %10llu iterations %14.1f allocations/op\n", "  libxml2 allocations", (unsigned long long)iterations,
+           iterations == 0 ? 0.0 : (double)(bench_pipeline_allocations - allocations) / iterations);
+    hive_object_free(document);
+    return 0;
+}
+
+///
+/// @brief Measures applying a stylesheet, broken down by stage.
+///
+/// The stylesheet is compiled on the first iteration and cached after that,
+/// as it is in the daemon.
+///
+/// Usage: xslt <file.yml> <file.xslt> [iterations]
+///
+int bench_xslt(int argc, char** argv)
+{
+    struct object* document = bench_pipeline_load(argc, argv, "xslt");
+    if (document == NULL)
+        return 1;
+    if (argc < 2)
+    {
+        fprintf(stderr, "xslt: missing xslt file\n");
+        hive_object_free(document);
+        return 1;
+    }
+    uint64_t iterations = argc >= 3 ? strtoull(argv[2], NULL, 10) : 100;
+    bench_pipeline_count_allocations();
+    bstring xslt_path = bfromcstr(argv[1]);
+    bstring output_path = bformat("/tmp/configd_bench.%d.out", (int)getpid());
+    struct hive_stats_output* stats = calloc(1, sizeof(struct hive_stats_output));
+    app_t app;
+    memset(&app, 0, sizeof(app));
+    hive_xslt_init(&app);
+    hive_output_init(&app);
+    hive_records_init(&app);
+    
+    uint64_t allocations = bench_pipeline_allocations;
+    uint64_t start = bench_now();
+    for (uint64_t i = 0; i < iterations; i++)
+        hive_xslt_transform_with_path_to_file(&app, xslt_path, NULL, document, output_path, stats);
+    bench_report("xslt transform to file", iterations, bench_now() - start);
+    printf("%-32s %10llu iterations %14.1f allocations/op\n", "  libxml2 allocations", (unsigned long long)iterations,
+           iterations == 0 ? 0.0 : (double)(bench_pipeline_allocations - allocations) / iterations);
+    
+    const char* names[] = { "  document build", "  document load", "  stylesheet compile", "  stylesheet apply", "  result write" };
+    int stages[] = { HIVE_STAGE_CONVERT, HIVE_STAGE_LOAD, HIVE_STAGE_COMPILE, HIVE_STAGE_APPLY, HIVE_STAGE_WRITE };
+    for (int i = 0; i < 5; i++)
+        bench_report(names[i], stats->stages[stages[i]].count, stats->stages[stages[i]].total);
+    
+    unlink((const char*)output_path->data);
+    free(stats);
+    hive_xslt_release(&app, document);
+    bdestroy(output_path);
+    bdestroy(xslt_path);
+    hive_object_free(document);
+    return 0;
+}
+
+///
+/// @brief Measures rendering records on 1, 2, 4 and 8 threads.
+///
+/// The stylesheet must declare cfg:records="yes".  Every result is checked
+/// against the single threaded one, and the source document is rebuilt on
+/// every iteration so that the single threaded timing is not helped by the
+/// document pool.
+///
+/// Usage: parallel <file.yml> <file.xslt> [iterations]
+///
+int bench_parallel(int argc, char** argv)
+{
+    struct object* document = bench_pipeline_load(argc, argv, "parallel");
+    if (document == NULL)
+        return 1;
+    if (argc < 2)
+    {
+        fprintf(stderr, "parallel: missing xslt file\n");
+        hive_object_free(document);
+        return 1;
+    }
+    uint64_t iterations = argc >= 3 ? strtoull(argv[2], NULL, 10) : 10;
+    bstring xslt_path = bfromcstr(argv[1]);
+    bstring serial = bfromcstr("");
+    bstring result = bfromcstr("");
+    app_t app;
+    memset(&app, 0, sizeof(app));
+    hive_xslt_init(&app);
+    hive_output_init(&app);
+    hive_records_init(&app);
+    
+    int status = 0;
+    size_t threads[] = { 1, 2, 4, 8 };
+    for (int i = 0; i < 4 && status == 0; i++)
+    {
+        app.render.threads = threads[i];
+        uint64_t elapsed = 0;
+        for (uint64_t j = 0; j < iterations && status == 0; j++)
+        {
+            btrunc(result, 0);
+            uint64_t start = bench_now();
+            if (!hive_xslt_transform_to_bstring(&app, xslt_path, NULL, document, result, NULL))
+                status = 1;
+            elapsed += bench_now() - start;
+            hive_xslt_release(&app, document);
+        }
+        if (i == 0)
+            bassign(serial, result);
+        else if (status == 0 && !biseq(serial, result))
+        {
+            fprintf(stderr, "parallel: the result on %zu threads differs from the result on 1\n", threads[i]);
+            status = 1;
+        }
+        char name[32];
+        snprintf(name, sizeof(name), "xslt records on %zu thread%s", threads[i], threads[i] == 1 ? "" : "s");
+        bench_report(name, iterations, elapsed);
+    }
+    
+    bdestroy(result);
+    bdestroy(serial);
+    bdestroy(xslt_path);
+    hive_object_free(document);
+    return status;
+}
+
+///
+/// @internal
+/// @brief Returns a new string object.
+///
+static struct object* bench_pipeline_string(const char* text)
+{
+    struct object* object = malloc(sizeof(struct object));
+    memset(object, 0, sizeof(struct object));
+    object->type = OBJECT_TYPE_STRING;
+    object->string = bfromcstr(text);
+    return object;
+}
+
+///
+/// @internal
+/// @brief Edits the entry of a map at a position: changes it's value, removes it,
+///        or inserts a new entry before it.
+///
+static void bench_pipeline_edit(struct object* map, size_t position, uint64_t edit)
+{
+    char text[64];
+    snprintf(text, sizeof(text), "edited%llu", (unsigned long long)edit);
+    if (edit % 3 == 0)
+    {
+        struct map_entry* entry = list_get_at(&map->map, position);
+        hive_object_free(entry->value);
+        entry->value = bench_pipeline_string(text);
+    }
+    else if (edit % 3 == 1)
+    {
+        struct map_entry* entry = list_extract_at(&map->map, position);
+        hive_object_free(entry->key);
+        hive_object_free(entry->value);
+        free(entry);
+    }
+    else
+    {
+        struct map_entry* entry = malloc(sizeof(struct map_entry));
+        entry->key = bench_pipeline_string(text);
+        entry->value = bench_pipeline_string(text);
+        list_insert_at(&map->map, entry, position);
+    }
+    hive_object_changed(map);
+}
+
+///
+/// @brief Measures rendering a record-oriented output again after small edits.
+///
+/// The source is edited in place (alternately changing, removing and
+/// inserting an entry), and after each edit the output is rendered again
+/// both incrementally and from scratch.  Every incremental result is
+/// checked against the one from scratch.
+///
+/// Usage: records <file.yml> <file.xslt> [iterations]
+///
+int bench_records(int argc, char** argv)
+{
+    struct object* document = bench_pipeline_load(argc, argv, "records");
+    if (document == NULL)
+        return 1;
+    if (argc < 2 || document->type != OBJECT_TYPE_MAP || list_size(&document->map) < 2)
+    {
+        fprintf(stderr, "records: expected a map with entries, and an xslt file\n");
+        hive_object_free(document);
+        return 1;
+    }
+    uint64_t iterations = argc >= 3 ? strtoull(argv[2], NULL, 10) : 20;
+    bstring xslt_path = bfromcstr(argv[1]);
+    bstring output_path = bformat("/tmp/configd_bench.%d.out", (int)getpid());
+    bstring incremental = bfromcstr("");
+    bstring full = bfromcstr("");
+    app_t app;
+    memset(&app, 0, sizeof(app));
+    hive_xslt_init(&app);
+    hive_output_init(&app);
+    hive_records_init(&app);
+    
+    uint64_t start = bench_now();
+    const char* error = hive_xslt_load(&app, xslt_path) == NULL ? "invalid xslt" : NULL;
+    if (error == NULL && !hive_xslt_records(hive_xslt_load(&app, xslt_path)))
+        error = "the stylesheet does not declare cfg:records=\"yes\"";
+    if (error == NULL)
+        error = hive_records_render(&app, output_path, hive_xslt_load(&app, xslt_path), NULL, document, 1, incremental);
+    bench_report("records first render", 1, bench_now() - start);
+    
+    uint64_t incremental_elapsed = 0;
+    uint64_t full_elapsed = 0;
+    for (uint64_t i = 0; i < iterations && error == NULL; i++)
+    {
+        bench_pipeline_edit(document, (i * 7919) % (list_size(&document->map) - 1), i);
+        hive_xslt_release(&app, document);
+        btrunc(incremental, 0);
+        start = bench_now();
+        error = hive_records_render(&app, output_path, hive_xslt_load(&app, xslt_path), NULL, document, 1, incremental);
+        incremental_elapsed += bench_now() - start;
+        btrunc(full, 0);
+        start = bench_now();
+        if (error == NULL && !hive_xslt_transform_to_bstring(&app, xslt_path, NULL, document, full, NULL))
+            error = "invalid application of xslt";
+        full_elapsed += bench_now() - start;
+        if (error == NULL && !biseq(incremental, full))
+            error = "the incremental result differs from the full result";
+    }
+    bench_report("records render after an edit", iterations, incremental_elapsed);
+    bench_report("full render after an edit", iterations, full_elapsed);
+    if (error != NULL)
+        fprintf(stderr, "records: %s\n", error);
+    
+    hive_xslt_release(&app, document);
+    hive_records_remove(&app, output_path);
+    bdestroy(full);
+    bdestroy(incremental);
+    bdestroy(output_path);
+    bdestroy(xslt_path);
+    hive_object_free(document);
+    return error == NULL ? 0 : 1;
+}
+
+///
+/// @brief Measures comparing two versions of a source, and prints the differences.
+///
+/// With one file, the file is compared with a copy of itself after the
+/// same edits that the records benchmark makes.
+///
+/// Usage: diff <old.yml> [new.yml] [iterations]
+///
+int bench_diff(int argc, char** argv)
+{
+    struct object* old = bench_pipeline_load(argc, argv, "diff");
+    if (old == NULL)
+        return 1;
+    bool edited = argc < 2 || strcmp(argv[1], "-") == 0;
+    struct object* new = bench_pipeline_load(argc - (edited ? 0 : 1), argv + (edited ? 0 : 1), "diff");
+    if (new == NULL)
+    {
+        hive_object_free(old);
+        return 1;
+    }
+    if (edited && new->type == OBJECT_TYPE_MAP)
+        for (uint64_t i = 0; i < 6 && list_size(&new->map) > 1; i++)
+            bench_pipeline_edit(new, (i * 7919) % (list_size(&new->map) - 1), i);
+    uint64_t iterations = argc >= 3 ? strtoull(argv[2], NULL, 10) : 10;
+    
+    uint64_t start = bench_now();
+    for (uint64_t i = 0; i < iterations; i++)
+        hive_diff_free(hive_diff_compute(old, new));
+    bench_report("diff", iterations, bench_now() - start);
+    start = bench_now();
+    for (uint64_t i = 0; i < iterations; i++)
+        hive_diff_free(hive_diff_compute(old, old));
+    bench_report("diff of identical trees", iterations, bench_now() - start);
+    
+    struct hive_diff* diff = hive_diff_compute(old, new);
+    for (size_t i = 0; i < diff->count && i < 20; i++)
+        printf("  %-8s %s\n", hive_diff_kind_name(diff->changes[i].kind), diff->changes[i].path->data);
+    printf("  %zu differences\n", diff->count);
+    hive_diff_free(diff);
+    hive_object_free(new);
+    hive_object_free(old);
+    return 0;
+}
+
+///
+/// @brief Measures rendering a native template, broken down by stage.
+///
+/// The template is compiled on the first iteration and cached after that,
+/// as it is in the daemon, so this is directly comparable with xslt.
+///
+/// Usage: template <file.yml> <file.tmpl> [iterations]
+///
+int bench_template(int argc, char** argv)
+{
+    struct object* document = bench_pipeline_load(argc, argv, "template");
+    if (document == NULL)
+        return 1;
+    if (argc < 2)
+    {
+        fprintf(stderr, "template: missing template file\n");
+        hive_object_free(document);
+        return 1;
+    }
+    uint64_t iterations = argc >= 3 ? strtoull(argv[2], NULL, 10) : 100;
+    bstring template_path = bfromcstr(argv[1]);
+    bstring output_path = bformat("/tmp/configd_bench.%d.out", (int)getpid());
+    struct hive_stats_output* stats = calloc(1, sizeof(struct hive_stats_output));
+    app_t app;
+    memset(&app, 0, sizeof(app));
+    hive_template_init(&app);
+    hive_output_init(&app);
+    
+    uint64_t start = bench_now();
+    for (uint64_t i = 0; i < iterations; i++)
+        hive_template_transform_with_path_to_file(&app, template_path, document, output_path, stats);
+    bench_report("template render to file", iterations, bench_now() - start);
+    
+    const char* names[] = { "  template load", "  template render", "  result write" };
+    int stages[] = { HIVE_STAGE_COMPILE, HIVE_STAGE_APPLY, HIVE_STAGE_WRITE };
+    for (int i = 0; i < 3; i++)
+        bench_report(names[i], stats->stages[stages[i]].count, stats->stages[stages[i]].total);
+    
+    unlink((const char*)output_path->data);
+    free(stats);
+    bdestroy(output_path);
+    bdestroy(template_path);
+    hive_object_free(document);
+    return 0;
+}
+
+///
+/// @brief Measures writing a built-in format, broken down by stage.
+///
+/// The .emit file is read on the first iteration and cached after that,
+/// as it is in the daemon, so this is directly comparable with xslt.
+///
+/// Usage: emit <file.yml> <file.emit> [iterations]
+///
+int bench_emit(int argc, char** argv)
+{
+    struct object* document = bench_pipeline_load(argc, argv, "emit");
+    if (document == NULL)
+        return 1;
+    if (argc < 2)
+    {
+        fprintf(stderr, "emit: missing .emit file\n");
+        hive_object_free(document);
+        return 1;
+    }
+    uint64_t iterations = argc >= 3 ? strtoull(argv[2], NULL, 10) : 100;
+    bstring spec_path = bfromcstr(argv[1]);
+    bstring output_path = bformat("/tmp/configd_bench.%d.out", (int)getpid());
+    struct hive_stats_output* stats = calloc(1, sizeof(struct hive_stats_output));
+    app_t app;
+    memset(&app, 0, sizeof(app));
+    hive_emit_init(&app);
+    hive_output_init(&app);
+    
+    uint64_t start = bench_now();
+    for (uint64_t i = 0; i < iterations; i++)
+        hive_emit_transform_with_path_to_file(&app, spec_path, document, output_path, stats);
+    bench_report("emit to file", iterations, bench_now() - start);
+    
+    const char* names[] = { "  emit load", "  emit", "  result write" };
+    int stages[] = { HIVE_STAGE_COMPILE, HIVE_STAGE_APPLY, HIVE_STAGE_WRITE };
+    for (int i = 0; i < 3; i++)
+        bench_report(names[i], stats->stages[stages[i]].count, stats->stages[stages[i]].total);
+    
+    unlink((const char*)output_path->data);
+    free(stats);
+    bdestroy(output_path);
+    bdestroy(spec_path);
+    hive_object_free(document);
+    return 0;
+}
@@ -0,0 +1,70 @@
+///
+/// @file
+/// @brief Replays a recorded inotify event stream through the daemon.
+///
+/// Recordings are made by running configd with -r <file>.  Replaying one
+/// regenerates outputs from the recorded file contents into a temporary
+/// directory, so that bursts captured in production can be benchmarked
+/// repeatably.
+///
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "bench.h"
+#include "../hive_app.h"
+#include "../hive_replay.h"
+
+///
+/// @brief Replays a recording.
+///
+/// Usage: replay <recording> [speed]
+///
+/// The speed is how many times faster than the original to replay; 0 (the
+/// default) replays as fast as possible.
+///
+int bench_replay(int argc, char** argv)
+{
+    if (argc < 1)
+    {
+        fprintf(stderr, "replay: missing recording\n");
+        return 1;
+    }
+    double speed = argc >= 2 ? strtod(argv[1], NULL) : 0;
+    char root[] = "/tmp/configd_bench.XXXXXX";
+    if (mkdtemp(root) == NULL)
+    {
+        fprintf(stderr, "replay: unable to create a temporary directory\n");
+        return 1;
+    }
+    
+    app_t app;
+    memset(&app, 0, sizeof(app));
+    app.source.path = bformat("%s/source", root);
+    app.active.path = bformat("%s/active", root);
+    app.snapshot.name = bformat("/configd_bench.%d", (int)getpid());
+    mkdir((const char*)app.source.path->data, 0755);
+    mkdir((const char*)app.active.path->data, 0755);
+    app_init(&app);
+    
+    struct hive_replay_result* result = malloc(sizeof(struct hive_replay_result));
+    bstring recording = bfromcstr(argv[0]);
+    bool complete = hive_replay(&app, recording, speed, result);
+    shm_unlink((const char*)app.snapshot.name->data);
+    if (!complete)
+        fprintf(stderr, "replay: %s is truncated or invalid\n", argv[0]);
+    
+    printf("replayed %llu events in %llu batches into %s\n", (unsigned long long)result->events,
+           (unsigned long long)result->batches, root);
+    bench_report("replay", 1, result->elapsed);
+    bench_report("dispatch batch", result->dispatch.count, result->dispatch.total);
+    printf("%-32s p50 %.1f us, p90 %.1f us, p99 %.1f us, max %.1f us\n", "",
+           hive_histogram_percentile(&result->dispatch, 50) / 1000.0, hive_histogram_percentile(&result->dispatch, 90) / 1000.0,
+           hive_histogram_percentile(&result->dispatch, 99) / 1000.0, result->dispatch.max / 1000.0);
+    free(result);
+    bdestroy(recording);
+    return complete ? 0 : 1;
+}
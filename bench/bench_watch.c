@@ -0,0 +1,153 @@
+///
+/// @file
+/// @brief Compares the cost of watching a large source tree with inotify and fanotify.
+///
+/// inotify needs a watch per directory, so setting up is a system call per
+/// directory and the kernel keeps a watch (and pins an inode) for each of
+/// them; fanotify marks the whole filesystem once.  Kernel memory is
+/// estimated from the change in slab usage, so it is only meaningful on an
+/// otherwise quiet machine.
+///
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "bench.h"
+#include "../hive_app.h"
+#include "../hive_fanotify.h"
+#include "../hive_inotify.h"
+
+#define BENCH_WATCH_FANOUT 100 ///< The number of subdirectories of each directory.
+
+///
+/// @internal
+/// @brief Returns the kernel slab usage in kilobytes, from /proc/meminfo.
+///
+long bench_watch_slab(void)
+{
+    FILE* file = fopen("/proc/meminfo", "r");
+    char line[256];
+    long slab = 0;
+    if (file == NULL)
+        return 0;
+    while (fgets(line, sizeof(line), file) != NULL)
+        if (sscanf(line, "Slab: %ld kB", &slab) == 1)
+            break;
+    fclose(file);
+    return slab;
+}
+
+///
+/// @internal
+/// @brief Creates a tree of directories, breadth first.
+///
+/// Directory i is created in directory i / BENCH_WATCH_FANOUT - 1, or in
+/// the root for the first BENCH_WATCH_FANOUT directories.
+///
+/// @return The number of directories that were created.
+///
+long bench_watch_create(const char* root, long directories)
+{
+    long created = 0;
+    bstring* paths = malloc(directories * sizeof(bstring));
+    for (long i = 0; i < directories; i++)
+    {
+        long parent = i / BENCH_WATCH_FANOUT - 1;
+        paths[i] = bformat("%s/d%ld", parent < 0 ? root : (const char*)paths[parent]->data, i % BENCH_WATCH_FANOUT);
+        if (mkdir((const char*)paths[i]->data, 0755) == 0)
+            created++;
+    }
+    for (long i = 0; i < directories; i++)
+        bdestroy(paths[i]);
+    free(paths);
+    return created;
+}
+
+///
+/// @internal
+/// @brief Silences (or restores) stdout and stderr, which are noisy while registering watches.
+///
+void bench_watch_quiet(int* saved)
+{
+    fflush(stdout);
+    fflush(stderr);
+    if (saved[0] < 0)
+    {
+        int null = open("/dev/null", O_WRONLY);
+        saved[0] = dup(STDOUT_FILENO);
+        saved[1] = dup(STDERR_FILENO);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        close(null);
+    }
+    else
+    {
+        dup2(saved[0], STDOUT_FILENO);
+        dup2(saved[1], STDERR_FILENO);
+        close(saved[0]);
+        close(saved[1]);
+        saved[0] = saved[1] = -1;
+    }
+}
+
+///
+/// @brief Measures the setup time and memory of watching a tree with each backend.
+///
+/// Usage: watch [directories]
+///
+/// The tree (100000 directories by default) is created in a temporary
+/// directory and left behind so that it can be reused by hand.
+///
+int bench_watch(int argc, char** argv)
+{
+    long directories = argc >= 1 ? strtol(argv[0], NULL, 10) : 100000;
+    char root[] = "/tmp/configd_bench.XXXXXX";
+    if (mkdtemp(root) == NULL)
+    {
+        fprintf(stderr, "watch: unable to create a temporary directory\n");
+        return 1;
+    }
+    long created = bench_watch_create(root, directories);
+    printf("created %ld directories in %s\n", created, root);
+
+    int saved[2] = { -1, -1 };
+    app_t app;
+    memset(&app, 0, sizeof(app));
+    app.source.path = bfromcstr(root);
+
+    // inotify: one watch per directory.
+    long slab = bench_watch_slab();
+    uint64_t start = bench_now();
+    bench_watch_quiet(saved);
+    bool registered = hive_inotify_init(&app) && hive_inotify_add_root(&app, app.source.path);
+    bench_watch_quiet(saved);
+    uint64_t elapsed = bench_now() - start;
+    long watched = (long)list_size(&app.inotify.watches);
+    bench_report("inotify register", 1, elapsed);
+    printf("%-32s %ld of %ld directories watched, kernel slab +%ld kB\n", "",
+           watched, created + 1, bench_watch_slab() - slab);
+    if (!registered || watched < created + 1)
+        printf("%-32s (limited by fs.inotify.max_user_watches)\n", "");
+    hive_inotify_close(&app);
+
+    // fanotify: one mark for the whole filesystem.
+    slab = bench_watch_slab();
+    start = bench_now();
+    bench_watch_quiet(saved);
+    registered = hive_fanotify_init(&app) && hive_fanotify_add_root(&app, app.source.path);
+    bench_watch_quiet(saved);
+    elapsed = bench_now() - start;
+    if (!registered)
+        printf("fanotify unavailable (requires CAP_SYS_ADMIN and Linux 5.9)\n");
+    else
+    {
+        bench_report("fanotify register", 1, elapsed);
+        printf("%-32s whole filesystem marked, kernel slab +%ld kB\n", "", bench_watch_slab() - slab);
+    }
+    hive_fanotify_close(&app);
+    bdestroy(app.source.path);
+    return 0;
+}
@@ -0,0 +1,66 @@
+///
+/// @file
+/// @brief The entry point of the configd benchmark suite.
+///
+/// Each benchmark is selected by name on the command line and prints one
+/// line per measurement, so that results are easy to compare between runs.
+///
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "bench.h"
+
+static struct bench benches[] =
+{
+    { "generate", "<directory> <hosts|flat|lists|deep|many|all> [scale]", bench_generate },
+    { "yaml", "<file.yml> [iterations]", bench_yaml },
+    { "xml", "<file.yml> [iterations]", bench_xml },
+    { "xslt", "<file.yml> <file.xslt> [iterations]", bench_xslt },
+    { "parallel", "<file.yml> <file.xslt> [iterations]", bench_parallel },
+    { "records", "<file.yml> <file.xslt> [iterations]", bench_records },
+    { "diff", "<old.yml> [new.yml|-] [iterations]", bench_diff },
+    { "template", "<file.yml> <file.tmpl> [iterations]", bench_template },
+    { "emit", "<file.yml> <file.emit> [iterations]", bench_emit },
+    { "binary", "<file.yml> [iterations]", bench_binary },
+    { "e2e", "<file.yml> <file.xslt> [iterations] [inotify|fanotify|poll]", bench_e2e },
+    { "replay", "<recording> [speed]", bench_replay },
+    { "watch", "[directories]", bench_watch },
+};
+
+///
+/// @brief Returns the current monotonic time in nanoseconds.
+///
+uint64_t bench_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+///
+/// @brief Prints the result of a single measurement.
+///
+/// @param name The name of the measurement.
+/// @param iterations The number of iterations that were measured.
+/// @param elapsed The total elapsed time in nanoseconds.
+///
+void bench_report(const char* name, uint64_t iterations, uint64_t elapsed)
+{
+    printf("%-32s %10llu iterations %14.1f ns/op\n", name, (unsigned long long)iterations,
+           iterations == 0 ? 0.0 : (double)elapsed / iterations);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc >= 2)
+    {
+        for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++)
+            if (strcmp(argv[1], benches[i].name) == 0)
+                return benches[i].run(argc - 2, argv + 2);
+    }
+    printf("usage: %s <benchmark> [arguments]\n", argv[0]);
+    for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++)
+        printf("    %s %s\n", benches[i].name, benches[i].usage);
+    return 1;
+}
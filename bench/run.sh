@@ -0,0 +1,31 @@
+#!/bin/sh
+#
+# Generates a synthetic corpus and runs every benchmark against it.
+#
+# Usage: bench/run.sh <path to configd_bench> [corpus directory]
+#
+
+BENCH=${1:?usage: $0 <path to configd_bench> [corpus directory]}
+CORPUS=${2:-/tmp/configd_bench_corpus}
+
+"$BENCH" generate "$CORPUS" all || exit 1
+
+for SHAPE in hosts flat lists deep small00000.conf; do
+    echo "== $SHAPE"
+    "$BENCH" yaml "$CORPUS/$SHAPE.yml" 5
+    "$BENCH" xml "$CORPUS/$SHAPE.yml" 5
+    "$BENCH" xslt "$CORPUS/$SHAPE.yml" "$CORPUS/$SHAPE.xslt" 5
+    if [ -f "$CORPUS/$SHAPE.tmpl" ]; then
+        "$BENCH" template "$CORPUS/$SHAPE.yml" "$CORPUS/$SHAPE.tmpl" 5
+    fi
+    if [ -f "$CORPUS/$SHAPE.emit" ]; then
+        "$BENCH" emit "$CORPUS/$SHAPE.yml" "$CORPUS/$SHAPE.emit" 5
+    fi
+    "$BENCH" binary "$CORPUS/$SHAPE.yml" 5
+    "$BENCH" e2e "$CORPUS/$SHAPE.yml" "$CORPUS/$SHAPE.xslt" 5
+done
+
+echo "== hosts on more threads"
+"$BENCH" parallel "$CORPUS/hosts.yml" "$CORPUS/hosts.xslt" 5
+"$BENCH" records "$CORPUS/hosts.yml" "$CORPUS/hosts.xslt" 5
+"$BENCH" diff "$CORPUS/hosts.yml" - 5
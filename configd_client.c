@@ -0,0 +1,243 @@
+///
+/// @file
+/// @brief A client library for reading configuration snapshots published by configd.
+///
+/// The layout of the shared memory segment is described in
+/// hive_snapshot_format.h.  Values are resolved against the active snapshot
+/// under the slot's sequence counter; if the daemon rewrote the slot during
+/// the lookup, the lookup is simply retried against the new snapshot.  If
+/// configd was restarted, the segment is retired and the client opens the
+/// new segment before looking anything up.
+///
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "configd_client.h"
+#include "hive_binary_format.h"
+#include "hive_snapshot_format.h"
+
+///
+/// @internal
+/// @brief Maps (or remaps) the whole segment.
+///
+/// @return 0 on success, or a negative errno value.
+///
+static int configd_client_map(struct configd_client* client)
+{
+    struct stat st;
+    if (fstat(client->fd, &st) != 0)
+        return -errno;
+    if ((size_t)st.st_size < sizeof(struct hive_snapshot_header))
+        return -EPROTO;
+    const void* base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, client->fd, 0);
+    if (base == MAP_FAILED)
+        return -errno;
+    if (client->base != NULL)
+        munmap((void*)client->base, client->size);
+    client->base = base;
+    client->size = st.st_size;
+    return 0;
+}
+
+///
+/// @brief Opens the configuration snapshots published by configd.
+///
+/// @param client The client to initialize.
+/// @param name The shared memory name, or NULL for HIVE_SNAPSHOT_DEFAULT_NAME.
+/// @return 0 on success, or a negative errno value.
+///
+int configd_client_open(struct configd_client* client, const char* name)
+{
+    client->base = NULL;
+    client->size = 0;
+    client->fd = -1;
+    if (name == NULL)
+        name = HIVE_SNAPSHOT_DEFAULT_NAME;
+    if (strlen(name) >= sizeof(client->name))
+        return -ENAMETOOLONG;
+    strcpy(client->name, name);
+    client->fd = shm_open(client->name, O_RDONLY, 0);
+    if (client->fd < 0)
+        return -errno;
+    int result = configd_client_map(client);
+    if (result == 0 && ((const struct hive_snapshot_header*)client->base)->magic != HIVE_SNAPSHOT_MAGIC)
+        result = -EPROTO;
+    if (result != 0)
+        configd_client_close(client);
+    return result;
+}
+
+///
+/// @brief Closes a client that was opened with configd_client_open.
+///
+/// @param client The client to close.
+///
+void configd_client_close(struct configd_client* client)
+{
+    if (client->base != NULL)
+        munmap((void*)client->base, client->size);
+    if (client->fd >= 0)
+        close(client->fd);
+    client->base = NULL;
+    client->size = 0;
+    client->fd = -1;
+}
+
+///
+/// @internal
+/// @brief Opens the segment of a restarted configd in place of a retired one.
+///
+/// The retired segment is kept if the new one can not be opened.
+///
+/// @return 0 on success, or a negative errno value.
+///
+static int configd_client_reopen(struct configd_client* client)
+{
+    struct configd_client fresh;
+    int result = configd_client_open(&fresh, client->name);
+    if (result != 0)
+        return result;
+    configd_client_close(client);
+    *client = fresh;
+    return 0;
+}
+
+///
+/// @internal
+/// @brief Resolves a value within a single snapshot.
+///
+/// The snapshot may be concurrently rewritten, so every offset is validated
+/// before it is followed.
+///
+/// @return The length of the value, or a negative errno value.
+///
+static int configd_client_resolve(const char* base, size_t length, const char* document, const char* path, char* buffer, size_t size)
+{
+    struct hive_binary_header header;
+    struct hive_binary_node node;
+    if (!hive_binary_read_header(base, length, &header))
+        return -ENOENT;
+    const void* payload = hive_binary_read_node(base, header.length, header.root, &node);
+    if (payload == NULL || node.type != HIVE_BINARY_TYPE_MAP)
+        return -EPROTO;
+    uint32_t offset = hive_binary_map_find(base, header.length, payload, node.count, document, strlen(document));
+    
+    // Walk each '/' separated segment of the path.
+    while (offset != 0)
+    {
+        payload = hive_binary_read_node(base, header.length, offset, &node);
+        if (payload == NULL)
+            return -EPROTO;
+        while (*path == '/')
+            path++;
+        if (*path == '\0')
+            break;
+        size_t segment = strcspn(path, "/");
+        if (node.type == HIVE_BINARY_TYPE_MAP)
+            offset = hive_binary_map_find(base, header.length, payload, node.count, path, segment);
+        else if (node.type == HIVE_BINARY_TYPE_LIST)
+        {
+            uint32_t index = 0;
+            for (size_t i = 0; i < segment; i++)
+            {
+                if (path[i] < '0' || path[i] > '9' || index > node.count)
+                    return -ENOENT;
+                index = index * 10 + (path[i] - '0');
+            }
+            if (index >= node.count)
+                return -ENOENT;
+            memcpy(&offset, (const uint32_t*)payload + index, sizeof(offset));
+        }
+        else
+            return -ENOENT;
+        path += segment;
+    }
+    if (offset == 0)
+        return -ENOENT;
+    
+    // Copy out the scalar value, truncating like snprintf.
+    switch (node.type)
+    {
+        case HIVE_BINARY_TYPE_STRING:
+            if (size > 0)
+            {
+                size_t copy = node.count < size ? node.count : size - 1;
+                memcpy(buffer, payload, copy);
+                buffer[copy] = '\0';
+            }
+            return (int)node.count;
+        case HIVE_BINARY_TYPE_NUMBER:
+        {
+            int64_t number;
+            memcpy(&number, payload, sizeof(number));
+            return snprintf(buffer, size, "%lld", (long long)number);
+        }
+        case HIVE_BINARY_TYPE_NIL:
+            if (size > 0)
+                buffer[0] = '\0';
+            return 0;
+        default:
+            return -EISDIR;
+    }
+}
+
+///
+/// @brief Gets a configuration value from the latest snapshot.
+///
+/// Map keys and list indexes in the path are separated by '/', so for
+/// example document "ldap.conf" and path "nss_map_attribute/uniqueMember"
+/// resolves a value inside a nested map.
+///
+/// @param client The client.
+/// @param document The name of the document (the output path relative to the active directory).
+/// @param path The path of the value within the document.
+/// @param buffer Receives the value as a NUL-terminated string, truncated if needed.
+/// @param size The size of buffer.
+/// @return The length of the full value (as with snprintf), or a negative errno value;
+///         -ENOENT if there is no such value and -EISDIR if the value is a list or map.
+///
+int configd_client_get(struct configd_client* client, const char* document, const char* path, char* buffer, size_t size)
+{
+    const struct hive_snapshot_header* header = client->base;
+    while (true)
+    {
+        if (atomic_load_explicit(&header->retired, memory_order_acquire))
+        {
+            // configd was restarted and publishes into a new segment.
+            int result = configd_client_reopen(client);
+            if (result != 0)
+                return result;
+            header = client->base;
+            continue;
+        }
+        uint32_t active = atomic_load_explicit(&header->active, memory_order_acquire) & 1;
+        const struct hive_snapshot_slot* slot = &header->slots[active];
+        uint64_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        if (sequence & 1)
+            continue;
+        uint64_t offset = atomic_load_explicit(&slot->offset, memory_order_relaxed);
+        uint64_t length = atomic_load_explicit(&slot->length, memory_order_relaxed);
+        if (offset + length > client->size)
+        {
+            // The segment has grown since we mapped it.
+            if (atomic_load_explicit(&header->size, memory_order_acquire) > client->size)
+            {
+                int result = configd_client_map(client);
+                if (result != 0)
+                    return result;
+                header = client->base;
+            }
+            continue;
+        }
+        int result = configd_client_resolve((const char*)client->base + offset, length, document, path, buffer, size);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->sequence, memory_order_relaxed) == sequence)
+            return result;
+    }
+}
@@ -0,0 +1,32 @@
+///
+/// @file
+/// @brief A client library for reading configuration snapshots published by configd.
+///
+/// Once a client is open, configd_client_get resolves values directly from
+/// shared memory without making any system calls or allocations (except for
+/// a one-off remap when the daemon has grown the segment, or a reopen when
+/// it has been restarted).
+///
+
+#ifndef __CONFIGD_CLIENT_H
+#define __CONFIGD_CLIENT_H
+
+#include <limits.h>
+#include <stddef.h>
+
+///
+/// @brief A connection to the configuration snapshots of a running configd.
+///
+struct configd_client
+{
+    int fd; ///< The shared memory descriptor.
+    const void* base; ///< The start of the mapped segment.
+    size_t size; ///< The number of bytes that are mapped.
+    char name[NAME_MAX + 1]; ///< The shared memory name, to open the segment again after configd restarts.
+};
+
+int configd_client_open(struct configd_client* client, const char* name);
+void configd_client_close(struct configd_client* client);
+int configd_client_get(struct configd_client* client, const char* document, const char* path, char* buffer, size_t size);
+
+#endif
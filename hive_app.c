@@ -4,93 +4,171 @@
 #include <unistd.h>
 #include "hive_fuse.h"
 #include "hive_app.h"
+#include "hive_ignore.h"
 #include "hive_inotify.h"
+#include "hive_path.h"
+#include "hive_watch.h"
 #include "hive_yaml.h"
 #include "hive_xslt.h"
+#include "hive_snapshot.h"
+#include "hive_cache.h"
+#include "hive_stats.h"
+#include "hive_trace.h"
+#include "hive_record.h"
+#include "hive_resync.h"
+#include "hive_sched.h"
+#include "hive_template.h"
+#include "hive_emit.h"
+#include "hive_params.h"
+#include "hive_output.h"
+#include "hive_records.h"
     
-struct path_info
-{
-    bool is_valid;
-    bstring yaml;
-    bstring xslt;
-    bstring output;
-};
-
 ///
-/// @internal
-/// @brief Gets both the YAML and XSLT path information based on a single path.
+/// @brief Regenerates an output from a data file and a stylesheet, template or .emit file.
 ///
-struct path_info get_path_info(app_t* app, bstring path)
+/// @param app The application.
+/// @param yaml_path The path of the data file.
+/// @param renderer The role of the stylesheet, template or .emit file.
+/// @param xslt_path The path of the stylesheet, template or .emit file.
+/// @param params The stylesheet parameters as name, value pairs followed by NULL, or NULL.
+/// @param output The path of the output.
+/// @param name The name of the output, relative to the active directory.
+///
+void app_render(app_t* app, bstring yaml_path, int renderer, bstring xslt_path, const char** params, bstring output, bstring name)
 {
-    struct path_info result;
-    bstring trailing4 = bmidstr(path, blength(path) - 4, 4);
-    bstring trailing5 = bmidstr(path, blength(path) - 5, 5);
-    bstring relative = bmidstr(path, blength(app->source.path) + 1, blength(path) - blength(app->source.path) - 1);
-    if (path->data[0] == '.' || (!biseqcstrcaseless(trailing4, ".yml") && !biseqcstrcaseless(trailing5, ".xslt")))
+    hive_trace_begin("app_render", (const char*)output->data);
+    struct hive_stats_output* stats = hive_stats_output(app, output);
+    uint64_t start = hive_stats_now();
+    
+    // Parse the YAML file, unless it is unchanged since it was last parsed.
+    hive_trace_begin("hive_cache_parse_file", (const char*)yaml_path->data);
+    struct object* yaml = hive_cache_parse_file(app, yaml_path);
+    hive_trace_end("hive_cache_parse_file");
+    hive_stats_record(stats, HIVE_STAGE_PARSE, hive_stats_now() - start);
+    if (yaml == NULL)
     {
-        result.is_valid = false;
-        result.xslt = NULL;
-        result.yaml = NULL;
-        result.output = NULL;
+        fprintf(stderr, "missing yaml: %s\n", yaml_path->data);
+        hive_trace_end("app_render");
+        return;
     }
-    else if (biseqcstrcaseless(trailing4, ".yml"))
+    
+    if (renderer == HIVE_PATH_TEMPLATE)
     {
-        result.is_valid = true;
-        result.yaml = bstrcpy(path);
-        result.xslt = bmidstr(path, 0, blength(path) - 4);
-        bcatcstr(result.xslt, ".xslt");
-        result.output = bmidstr(relative, 0, blength(relative) - 4);
-        binsertch(result.output, 0, 1, '/');
-        binsert(result.output, 0, app->active.path, ' ');
+        // Render the template straight from the object, and save to the output.
+        hive_template_transform_with_path_to_file(app, xslt_path, yaml, output, stats);
     }
-    else if (biseqcstrcaseless(trailing5, ".xslt"))
+    else if (renderer == HIVE_PATH_EMITTER)
     {
-        result.is_valid = true;
-        result.xslt = bstrcpy(path);
-        result.yaml = bmidstr(path, 0, blength(path) - 5);
-        bcatcstr(result.yaml, ".yml");
-        result.output = bmidstr(relative, 0, blength(relative) - 5);
-        binsertch(result.output, 0, 1, '/');
-        binsert(result.output, 0, app->active.path, ' ');
+        // Write the object in a built-in format, and save to the output.
+        hive_emit_transform_with_path_to_file(app, xslt_path, yaml, output, stats);
     }
     else
-        assert(false);
-    bdestroy(trailing4);
-    bdestroy(trailing5);
-    bdestroy(relative);
-    return result;
+    {
+        // Build (or reuse) the source document, apply the (cached) stylesheet,
+        // and save to the output.
+        hive_xslt_transform_with_path_to_file(app, xslt_path, params, yaml, output, stats);
+    }
+    hive_stats_record(stats, HIVE_STAGE_TOTAL, hive_stats_now() - start);
+    
+    // Commit the parsed document to the shared memory snapshot.
+    if (app->enable_snapshot)
+        hive_snapshot_set_document(app, name, yaml);
+    hive_trace_end("app_render");
+}
+
+///
+/// @internal
+/// @brief Regenerates an output declared in a manifest.
+///
+void app_render_declared(app_t* app, struct hive_params_manifest* manifest, struct hive_params_output* output)
+{
+    app_render(app, output->yaml, manifest->renderer, manifest->xslt, output->params, output->output, output->name);
 }
 
 void app_on_updated(app_t* app, bstring path)
 {
-    struct path_info info = get_path_info(app, path);
-    if (!info.is_valid)
+    const struct hive_path_info* info = hive_path_lookup(app, path);
+    if (info == NULL || info->shadowed)
         return;
     
-    // Parse the YAML file.
-    struct object* yaml = hive_yaml_parse_file(info.yaml);
-    if (yaml == NULL)
+    hive_trace_begin("app_on_updated", (const char*)path->data);
+    
+    // A manifest is read again, and then all of it's outputs are regenerated.
+    bool declared = true;
+    if (info->handler->role == HIVE_PATH_MANIFEST)
     {
-        fprintf(stderr, "missing yaml: %s\n", info.yaml->data);
-        return;
+        // The stylesheet no longer produces an output of it's own.
+        hive_params_load(app, path, info);
+        hive_output_remove(app, info->output);
+        if (app->enable_snapshot)
+            hive_snapshot_remove_document(app, info->name);
     }
+    else
+        declared = hive_params_discover(app, info) != NULL;
     
-    // Convert the object to source XML.
-    bstring xml = hive_xslt_object_to_xml(yaml);
-    printf("%s", xml->data);
-    
-    // Parse and apply stylesheet, and save to the output.
-    hive_xslt_transform_with_path_to_file(info.xslt, xml, info.output);
+    // Regenerate the outputs declared in manifests that use the file, and
+    // the file's own output unless a manifest declares it's outputs instead.
+    hive_params_foreach(app, path, &app_render_declared);
+    if (!declared)
+        app_render(app, info->yaml, info->renderer, info->xslt, NULL, info->output, info->name);
+    hive_trace_end("app_on_updated");
 }
 
 void app_on_deleted(app_t* app, bstring path)
 {
-    struct path_info info = get_path_info(app, path);
-    if (!info.is_valid)
+    const struct hive_path_info* info = hive_path_lookup(app, path);
+    if (info == NULL)
+        return;
+    
+    hive_trace_begin("app_on_deleted", (const char*)path->data);
+    
+    // Delete the outputs a manifest declared, or the declared outputs that used the file;
+    // without the manifest, the stylesheet produces it's own output again.
+    if (info->handler->role == HIVE_PATH_MANIFEST)
+    {
+        bstring yaml = bstrcpy(info->yaml);
+        hive_params_remove(app, path);
+        hive_path_forget(app, path);
+        const struct hive_path_info* own = hive_path_lookup(app, yaml);
+        if (own != NULL && access((const char*)yaml->data, F_OK) == 0 && access((const char*)own->xslt->data, F_OK) == 0)
+            app_on_updated(app, yaml);
+        bdestroy(yaml);
+        hive_trace_end("app_on_deleted");
         return;
+    }
+    hive_params_foreach(app, path, &hive_params_unlink);
+    
+    // Once a stylesheet, template or .emit file is gone, whether it was the one
+    // in use can no longer be told, so if another one with the same name
+    // exists, that one takes over and the output is regenerated.
+    if (info->handler->role != HIVE_PATH_SOURCE && access((const char*)info->yaml->data, F_OK) == 0)
+    {
+        bstring yaml = bstrcpy(info->yaml);
+        hive_path_forget(app, path);
+        const struct hive_path_info* fallback = hive_path_lookup(app, yaml);
+        if (fallback != NULL && access((const char*)fallback->xslt->data, F_OK) == 0)
+        {
+            app_on_updated(app, yaml);
+            bdestroy(yaml);
+            hive_trace_end("app_on_deleted");
+            return;
+        }
+        bdestroy(yaml);
+        info = hive_path_lookup(app, path);
+    }
     
     // Delete the file in the active configuration directory.
-    unlink((const char*)info.output->data);
+    hive_output_remove(app, info->output);
+    
+    // Remove the document from the shared memory snapshot.
+    if (app->enable_snapshot)
+        hive_snapshot_remove_document(app, info->name);
+    
+    // Forget the parsed content if the YAML file itself was deleted.
+    if (biseq(path, info->yaml))
+        hive_cache_remove(app, info->yaml);
+    hive_path_forget(app, path);
+    hive_trace_end("app_on_deleted");
 }
 
 ///
@@ -103,12 +181,73 @@ void app_init(app_t* app)
     // This might end up being a compile-time option.
     app->enable_fuse = false;
     
-    // Register inotify.
-    hive_inotify_register(app);
+    // Cache parsed sources (app->cache.path is set by main if they should be persisted).
+    hive_cache_init(app);
+    
+    // Queue changes by the priority of their outputs (using the rules in
+    // app->sched.path if main set it), and remember the paths derived from
+    // each source file.
+    hive_sched_init(app);
+    hive_path_init(app);
+    
+    // Keep native templates compiled, and .emit files parsed, until they change.
+    hive_template_init(app);
+    hive_emit_init(app);
+    
+    // Keep stylesheets compiled until they change, and let them look values up
+    // in the parsed source with cfg:get and friends.
+    hive_xslt_init(app);
+    hive_params_init(app);
+    
+    // Render large record-oriented outputs on as many threads as it's worth.
+    app->render.threads = 0;
     
-    // Set inotify callbacks.
-    hive_inotify_set_callback_updated(app, &app_on_updated);
-    hive_inotify_set_callback_deleted(app, &app_on_deleted);
+    // Skip writing outputs whose rendered content has not changed, and only
+    // render the records that changed in record-oriented outputs.
+    hive_output_init(app);
+    hive_records_init(app);
+    
+    // Record per-stage latencies (app->stats.path is set by main if they should be
+    // dumped to a file on SIGUSR1).
+    app->enable_stats = true;
+    hive_stats_init(app);
+    
+    // Record a timeline of events (only if main set app->trace.path).
+    hive_trace_init(app);
+    
+    // Publish snapshots for clients of configd_client (under app->snapshot.name if
+    // it has already been set).
+    app->enable_snapshot = true;
+    if (app->snapshot.name == NULL)
+        app->snapshot.name = bfromcstr(HIVE_SNAPSHOT_DEFAULT_NAME);
+    if (app->enable_snapshot && !hive_snapshot_init(app))
+    {
+        fprintf(stderr, "unable to publish snapshots to: %s\n", app->snapshot.name->data);
+        app->enable_snapshot = false;
+    }
+    
+    // Record the source tree and inotify events (only if main set app->record.path).
+    if (!hive_record_open(app))
+        fprintf(stderr, "unable to record to: %s\n", app->record.path->data);
+    
+    // Load the rules for files that are never sources (such as editor swap files).
+    hive_ignore_init(app);
+    
+    // Watch the source directory (with the backend main selected in app->source.backend,
+    // or inotify by default).
+    if (!hive_watch_init(app))
+        fprintf(stderr, "unable to watch: %s\n", app->source.path->data);
+    if (app->source.backend != &hive_inotify_backend && app->record.file != NULL)
+        fprintf(stderr, "recordings only capture inotify events; nothing will be recorded\n");
+    
+    // Index the source files so that lost events can be recovered from.
+    hive_resync_init(app);
+    
+    // Set watch callbacks; changes are queued and then handled in priority order.
+    hive_watch_set_callback_updated(app, &hive_sched_updated);
+    hive_watch_set_callback_deleted(app, &hive_sched_deleted);
+    hive_sched_set_callback_updated(app, &app_on_updated);
+    hive_sched_set_callback_deleted(app, &app_on_deleted);
 }
 
 ///
@@ -116,7 +255,15 @@ void app_init(app_t* app)
 ///
 void app_run(app_t* app)
 {
-    // Handle inotify.
+    // Handle source changes and any requests to dump statistics or traces.
     while (true)
-        hive_inotify_poll(app);
+    {
+        hive_watch_poll(app);
+        hive_sched_poll(app);
+        hive_stats_poll(app);
+        hive_trace_poll(app);
+        
+        // Sleep until there are changes, unless queued files are still waiting.
+        hive_watch_wait(app, app->sched.pending > 0 ? 0 : UINT64_MAX);
+    }
 }
\ No newline at end of file
@@ -2,10 +2,20 @@
 #define __HIVE_APP_H
 
 #include <dirent.h>
+#include <stdio.h>
 #include <simclist.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <bstrlib.h>
 
+struct hive_histogram;
+struct hive_ignore_rule;
+struct hive_path_info;
+struct hive_resync_entry;
+struct hive_sched_class;
+struct hive_sched_rule;
+struct hive_watch_backend;
+
 ///
 /// @brief A structure representing the configd application.
 ///
@@ -16,6 +26,16 @@ struct __app
     ///
     bool enable_fuse;
     
+    ///
+    /// @brief Whether configuration snapshots should be published to shared memory.
+    ///
+    bool enable_snapshot;
+    
+    ///
+    /// @brief Whether per-stage latency statistics should be recorded.
+    ///
+    bool enable_stats;
+    
     ///
     /// @brief The active configuration information (often stored in /etc).
     ///
@@ -36,11 +56,208 @@ struct __app
     {
         bstring path;
         DIR* content;
-        int inotify;
-        list_t watches;
+        const struct hive_watch_backend* backend;
         void (*updated)(struct __app* app, bstring path);
         void (*deleted)(struct __app* app, bstring path);
     } source;
+    
+    ///
+    /// @brief The inotify watches on every source directory (if source.backend is inotify).
+    ///
+    struct
+    {
+        int fd;
+        list_t watches;
+        char* events;
+        size_t events_size;
+    } inotify;
+    
+    ///
+    /// @brief The fanotify mark on the filesystem of the source directory (if source.backend is fanotify).
+    ///
+    struct
+    {
+        int fd;
+        int mount;
+        bstring root;
+        bstring handle;
+        bstring directory;
+        bstring* rejected;
+        size_t rejected_count;
+        char* events;
+        size_t events_size;
+    } fanotify;
+    
+    ///
+    /// @brief The schedule of scans of the source directory (if source.backend is poll).
+    ///
+    struct
+    {
+        uint64_t interval;
+        uint64_t next;
+    } poll;
+    
+    ///
+    /// @brief The last known state of every source file, sorted by path.
+    ///
+    struct
+    {
+        struct hive_resync_entry* entries;
+        size_t count;
+        size_t capacity;
+    } resync;
+    
+    ///
+    /// @brief The rules for source files that are ignored, such as editor swap files.
+    ///
+    struct
+    {
+        struct hive_ignore_rule* rules;
+        size_t count;
+        size_t capacity;
+        uint64_t filtered;
+        uint64_t digest;
+    } ignore;
+    
+    ///
+    /// @brief The paths derived from each source file, in an open addressing hash table.
+    ///
+    struct
+    {
+        struct hive_path_info* entries;
+        size_t count;
+        size_t capacity;
+    } paths;
+    
+    ///
+    /// @brief The queues of changes waiting to be handled, by priority class.
+    ///
+    struct
+    {
+        bstring path;
+        struct hive_sched_class* classes;
+        size_t current;
+        size_t pending;
+        struct hive_sched_rule* rules;
+        size_t rule_count;
+        size_t rule_capacity;
+        void (*updated)(struct __app* app, bstring path);
+        void (*deleted)(struct __app* app, bstring path);
+    } sched;
+    
+    ///
+    /// @brief The compiled native templates (struct hive_cache_loaded holding a struct hive_template).
+    ///
+    struct
+    {
+        list_t entries;
+    } templates;
+    
+    ///
+    /// @brief The parsed .emit files (struct hive_cache_loaded holding a struct hive_emit_spec).
+    ///
+    struct
+    {
+        list_t entries;
+    } emitters;
+    
+    ///
+    /// @brief The compiled XSLT stylesheets (struct hive_xslt_stylesheet).
+    ///
+    struct
+    {
+        list_t entries;
+    } stylesheets;
+    
+    ///
+    /// @brief How stylesheets that declare cfg:records="yes" are rendered.
+    ///
+    struct
+    {
+        size_t threads; ///< The number of threads, or 0 to pick by size and processors.
+    } render;
+    
+    ///
+    /// @brief The source documents kept for reuse (struct hive_xslt_document).
+    ///
+    struct
+    {
+        list_t entries;
+    } documents;
+    
+    ///
+    /// @brief What was last written to each output (struct hive_output_entry).
+    ///
+    struct
+    {
+        list_t entries;
+        unsigned int mode;
+    } outputs;
+    
+    ///
+    /// @brief What the records of each record-oriented output rendered to (struct hive_records_output).
+    ///
+    struct
+    {
+        list_t entries;
+    } records;
+    
+    ///
+    /// @brief The parsed .outputs manifests (struct hive_params_manifest).
+    ///
+    struct
+    {
+        list_t entries;
+    } manifests;
+    
+    ///
+    /// @brief The cache of parsed YAML sources.
+    ///
+    struct
+    {
+        bstring path;
+        list_t entries;
+    } cache;
+    
+    ///
+    /// @brief The per-stage latency statistics of each output.
+    ///
+    struct
+    {
+        bstring path;
+        list_t outputs;
+        struct hive_histogram* wakeup_events;
+        struct hive_histogram* wakeup_reads;
+    } stats;
+    
+    ///
+    /// @brief The Chrome trace that is written on SIGUSR2.
+    ///
+    struct
+    {
+        bstring path;
+    } trace;
+    
+    ///
+    /// @brief The recording of inotify events for later replay.
+    ///
+    struct
+    {
+        bstring path;
+        FILE* file;
+    } record;
+    
+    ///
+    /// @brief The shared memory segment that configuration snapshots are published in.
+    ///
+    struct
+    {
+        bstring name;
+        int fd;
+        void* base;
+        size_t size;
+        list_t documents;
+    } snapshot;
 };
 typedef struct __app app_t;
 
@@ -0,0 +1,359 @@
+///
+/// @file
+/// @brief Converts object trees into their position-independent binary form.
+///
+/// The layout of the binary form is described in hive_binary_format.h.
+///
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "hive_binary.h"
+
+///
+/// @internal
+/// @brief A map key and its position in the map, used to build the sorted index.
+///
+struct hive_binary_sort_key
+{
+    struct object* key;
+    uint32_t position;
+};
+
+///
+/// @internal
+/// @brief Orders map keys in the same way as hive_binary_compare_key.
+///
+/// Ties keep document order, so the index is deterministic.
+///
+int hive_binary_sort_key_compare(const void* a, const void* b)
+{
+    const struct hive_binary_sort_key* left = a;
+    const struct hive_binary_sort_key* right = b;
+    bool left_string = left->key->type == OBJECT_TYPE_STRING;
+    bool right_string = right->key->type == OBJECT_TYPE_STRING;
+    int result = 0;
+    if (left_string && right_string)
+        result = hive_binary_compare_key((const char*)left->key->string->data, blength(left->key->string),
+                                         HIVE_BINARY_TYPE_STRING, (const char*)right->key->string->data, blength(right->key->string));
+    else if (left_string != right_string)
+        result = left_string ? -1 : 1;
+    if (result != 0)
+        return result;
+    return left->position < right->position ? -1 : (left->position > right->position ? 1 : 0);
+}
+
+///
+/// @internal
+/// @brief Reserves an aligned, zero-filled region at the end of the output.
+///
+/// @param out The output being built.
+/// @param size The number of bytes to reserve.
+/// @return The offset of the reserved region.
+///
+uint32_t hive_binary_reserve(bstring out, size_t size)
+{
+    int offset = blength(out);
+    int padding = (HIVE_BINARY_ALIGN - offset % HIVE_BINARY_ALIGN) % HIVE_BINARY_ALIGN;
+    binsertch(out, offset, padding + (int)size, '\0');
+    return (uint32_t)(offset + padding);
+}
+
+///
+/// @internal
+/// @brief Writes an object (and all of it's children) to the output.
+///
+/// @param out The output being built.
+/// @param object The object to write.
+/// @return The offset of the node that was written.
+///
+uint32_t hive_binary_encode_impl(bstring out, struct object* object)
+{
+    struct hive_binary_node node;
+    uint32_t offset;
+    uint32_t index = 0;
+    node.type = object->type;
+    node.count = 0;
+    switch (object->type)
+    {
+        case OBJECT_TYPE_NIL:
+            offset = hive_binary_reserve(out, sizeof(node));
+            break;
+        case OBJECT_TYPE_NUMBER:
+        {
+            int64_t number = object->number;
+            offset = hive_binary_reserve(out, sizeof(node) + sizeof(number));
+            memcpy(out->data + offset + sizeof(node), &number, sizeof(number));
+            break;
+        }
+        case OBJECT_TYPE_STRING:
+            node.count = blength(object->string);
+            offset = hive_binary_reserve(out, sizeof(node) + node.count + 1);
+            memcpy(out->data + offset + sizeof(node), object->string->data, node.count);
+            break;
+        case OBJECT_TYPE_LIST:
+            node.count = list_size(&object->list);
+            offset = hive_binary_reserve(out, sizeof(node) + node.count * sizeof(uint32_t));
+            list_iterator_start(&object->list);
+            while (list_iterator_hasnext(&object->list))
+            {
+                uint32_t child = hive_binary_encode_impl(out, list_iterator_next(&object->list));
+                memcpy(out->data + offset + sizeof(node) + index * sizeof(uint32_t), &child, sizeof(child));
+                index++;
+            }
+            list_iterator_stop(&object->list);
+            break;
+        case OBJECT_TYPE_MAP:
+        {
+            node.count = list_size(&object->map);
+            offset = hive_binary_reserve(out, sizeof(node) + node.count * (sizeof(struct hive_binary_pair) + sizeof(uint32_t)));
+            struct hive_binary_sort_key* keys = malloc((node.count + 1) * sizeof(struct hive_binary_sort_key));
+            list_iterator_start(&object->map);
+            while (list_iterator_hasnext(&object->map))
+            {
+                struct map_entry* entry = list_iterator_next(&object->map);
+                struct hive_binary_pair pair;
+                pair.key = hive_binary_encode_impl(out, entry->key);
+                pair.value = hive_binary_encode_impl(out, entry->value);
+                memcpy(out->data + offset + sizeof(node) + index * sizeof(pair), &pair, sizeof(pair));
+                keys[index].key = entry->key;
+                keys[index].position = index;
+                index++;
+            }
+            list_iterator_stop(&object->map);
+            
+            // Write the index of positions sorted by key.
+            qsort(keys, node.count, sizeof(struct hive_binary_sort_key), hive_binary_sort_key_compare);
+            unsigned char* sorted = out->data + offset + sizeof(node) + node.count * sizeof(struct hive_binary_pair);
+            for (index = 0; index < node.count; index++)
+                memcpy(sorted + index * sizeof(uint32_t), &keys[index].position, sizeof(uint32_t));
+            free(keys);
+            break;
+        }
+        default:
+            assert(false);
+            return 0;
+    }
+    memcpy(out->data + offset, &node, sizeof(node));
+    return offset;
+}
+
+///
+/// @brief Encodes an object tree into a single position-independent block.
+///
+/// @param object The root of the object tree.
+/// @return The encoded block, which the caller must free with bdestroy.
+///
+bstring hive_binary_encode(struct object* object)
+{
+    struct hive_binary_header header;
+    bstring out = bfromcstralloc(256, "");
+    hive_binary_reserve(out, sizeof(header));
+    header.magic = HIVE_BINARY_MAGIC;
+    header.version = HIVE_BINARY_VERSION;
+    header.root = hive_binary_encode_impl(out, object);
+    header.length = blength(out);
+    memcpy(out->data, &header, sizeof(header));
+    return out;
+}
+
+///
+/// @internal
+/// @brief Reconstructs an object (and all of it's children) from a node.
+///
+/// Child offsets must point forward from their parent, which guarantees
+/// that a corrupt block can not cause infinite recursion.
+///
+/// @param base The start of the block.
+/// @param length The length of the block.
+/// @param offset The offset of the node to decode.
+/// @return The object, or NULL if the node is invalid.
+///
+struct object* hive_binary_decode_impl(const unsigned char* base, uint32_t length, uint32_t offset)
+{
+    struct hive_binary_node node;
+    const unsigned char* payload = hive_binary_read_node(base, length, offset, &node);
+    if (payload == NULL)
+        return NULL;
+    
+    struct object* result = malloc(sizeof(struct object));
+    memset(result, 0, sizeof(struct object));
+    result->type = node.type;
+    switch (node.type)
+    {
+        case HIVE_BINARY_TYPE_NIL:
+            hive_object_hash(result);
+            return result;
+        case HIVE_BINARY_TYPE_NUMBER:
+        {
+            int64_t number;
+            memcpy(&number, payload, sizeof(number));
+            result->number = number;
+            hive_object_hash(result);
+            return result;
+        }
+        case HIVE_BINARY_TYPE_STRING:
+            result->string = blk2bstr(payload, node.count);
+            hive_object_hash(result);
+            return result;
+        case HIVE_BINARY_TYPE_LIST:
+            list_init(&result->list);
+            for (uint32_t i = 0; i < node.count; i++)
+            {
+                uint32_t child_offset;
+                memcpy(&child_offset, payload + i * sizeof(uint32_t), sizeof(child_offset));
+                struct object* child = child_offset > offset ? hive_binary_decode_impl(base, length, child_offset) : NULL;
+                if (child == NULL)
+                {
+                    hive_object_free(result);
+                    return NULL;
+                }
+                list_append(&result->list, child);
+            }
+            hive_object_hash(result);
+            return result;
+        case HIVE_BINARY_TYPE_MAP:
+            list_init(&result->map);
+            for (uint32_t i = 0; i < node.count; i++)
+            {
+                struct hive_binary_pair pair;
+                memcpy(&pair, payload + i * sizeof(pair), sizeof(pair));
+                struct map_entry* entry = malloc(sizeof(struct map_entry));
+                entry->key = pair.key > offset ? hive_binary_decode_impl(base, length, pair.key) : NULL;
+                entry->value = pair.value > offset ? hive_binary_decode_impl(base, length, pair.value) : NULL;
+                if (entry->key == NULL || entry->value == NULL)
+                {
+                    if (entry->key != NULL)
+                        hive_object_free(entry->key);
+                    if (entry->value != NULL)
+                        hive_object_free(entry->value);
+                    free(entry);
+                    hive_object_free(result);
+                    return NULL;
+                }
+                list_append(&result->map, entry);
+            }
+            hive_object_hash(result);
+            return result;
+        default:
+            free(result);
+            return NULL;
+    }
+}
+
+///
+/// @brief Decodes a binary object tree back into an object tree.
+///
+/// Most readers should use the block in place (see hive_binary_format.h);
+/// this is for callers that need a mutable struct object.
+///
+/// @param data The start of the block.
+/// @param length The number of bytes that are readable at data.
+/// @return The resulting object structure, or NULL if the block is invalid.
+///
+struct object* hive_binary_decode(const void* data, size_t length)
+{
+    struct hive_binary_header header;
+    if (!hive_binary_read_header(data, length, &header))
+        return NULL;
+    return hive_binary_decode_impl(data, header.length, header.root);
+}
+
+///
+/// @brief Encodes an object tree and writes it to a file.
+///
+/// The file is written to a temporary path and renamed into place, so that
+/// readers which map the file never observe a partially written block.
+///
+/// @param path The path to write to.
+/// @param object The root of the object tree.
+/// @return Whether the file was written.
+///
+bool hive_binary_write_file(bstring path, struct object* object)
+{
+    bstring data = hive_binary_encode(object);
+    bstring temporary = bformat("%s.tmp", (const char*)path->data);
+    FILE* file = fopen((const char*)temporary->data, "wb");
+    bool result = file != NULL;
+    if (result)
+    {
+        result = fwrite(data->data, 1, blength(data), file) == (size_t)blength(data);
+        result = fclose(file) == 0 && result;
+        result = result && rename((const char*)temporary->data, (const char*)path->data) == 0;
+        if (!result)
+            unlink((const char*)temporary->data);
+    }
+    bdestroy(temporary);
+    bdestroy(data);
+    return result;
+}
+
+///
+/// @brief Maps a file that contains a block after some header of it's own, for
+///        reading in place.
+///
+/// Nothing about the content is checked; the block is checked when it is
+/// decoded with hive_binary_decode.
+///
+/// @param path The path to map.
+/// @param length Receives the length of the mapping.
+/// @return The start of the file, or NULL if the file is missing or empty.
+///         Release it with hive_binary_unmap_file.
+///
+const void* hive_binary_map_raw(bstring path, size_t* length)
+{
+    struct stat st;
+    int fd = open((const char*)path->data, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return NULL;
+    }
+    void* data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return NULL;
+    *length = st.st_size;
+    return data;
+}
+
+///
+/// @brief Maps a file written by hive_binary_write_file for reading in place.
+///
+/// @param path The path to map.
+/// @param length Receives the length of the mapping.
+/// @return The start of the block, or NULL if the file is missing or invalid.
+///         Release it with hive_binary_unmap_file.
+///
+const void* hive_binary_map_file(bstring path, size_t* length)
+{
+    struct hive_binary_header header;
+    const void* data = hive_binary_map_raw(path, length);
+    if (data == NULL)
+        return NULL;
+    if (!hive_binary_read_header(data, *length, &header))
+    {
+        hive_binary_unmap_file(data, *length);
+        return NULL;
+    }
+    return data;
+}
+
+///
+/// @brief Releases a mapping returned by hive_binary_map_file.
+///
+/// @param data The start of the block.
+/// @param length The length of the mapping.
+///
+void hive_binary_unmap_file(const void* data, size_t length)
+{
+    munmap((void*)data, length);
+}
@@ -0,0 +1,15 @@
+#ifndef __HIVE_BINARY_H
+#define __HIVE_BINARY_H
+
+#include <bstrlib.h>
+#include "hive_object.h"
+#include "hive_binary_format.h"
+
+bstring hive_binary_encode(struct object* object);
+struct object* hive_binary_decode(const void* data, size_t length);
+bool hive_binary_write_file(bstring path, struct object* object);
+const void* hive_binary_map_raw(bstring path, size_t* length);
+const void* hive_binary_map_file(bstring path, size_t* length);
+void hive_binary_unmap_file(const void* data, size_t length);
+
+#endif
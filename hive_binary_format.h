@@ -0,0 +1,195 @@
+///
+/// @file
+/// @brief Describes the position-independent binary form of an object tree.
+///
+/// A binary object tree is a single contiguous block that starts with a
+/// struct hive_binary_header.  Every node is addressed by its byte offset
+/// from the start of the block, so the block can be mapped anywhere (and
+/// shared between processes) and read in place without any parsing.  Child
+/// nodes are always stored after their parents, so offsets only ever point
+/// forward.
+///
+/// Map entries are kept in document order, and each map also carries an
+/// index of entry positions sorted by key so that lookups are a binary
+/// search rather than a scan.
+///
+/// This header deliberately depends only on the C standard library so that
+/// it can be shared with the client library.
+///
+
+#ifndef __HIVE_BINARY_FORMAT_H
+#define __HIVE_BINARY_FORMAT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define HIVE_BINARY_MAGIC 0x42474643 ///< The magic number at the start of a block ("CFGB").
+#define HIVE_BINARY_VERSION 2 ///< The current version of the binary format.
+#define HIVE_BINARY_ALIGN 8 ///< The alignment of every node in the block.
+
+#define HIVE_BINARY_TYPE_NIL 0 ///< Node has no payload.
+#define HIVE_BINARY_TYPE_NUMBER 1 ///< Node is followed by an int64_t.
+#define HIVE_BINARY_TYPE_STRING 2 ///< Node is followed by count bytes and a terminating NUL.
+#define HIVE_BINARY_TYPE_LIST 3 ///< Node is followed by count uint32_t child offsets.
+#define HIVE_BINARY_TYPE_MAP 4 ///< Node is followed by count (key, value) uint32_t offset pairs, then count uint32_t sorted positions.
+
+///
+/// @brief The header at the start of every binary object tree.
+///
+struct hive_binary_header
+{
+    uint32_t magic; ///< Always HIVE_BINARY_MAGIC.
+    uint32_t version; ///< Always HIVE_BINARY_VERSION.
+    uint32_t length; ///< The total length of the block in bytes, including this header.
+    uint32_t root; ///< The offset of the root node.
+};
+
+///
+/// @brief The fixed part of every node in a binary object tree.
+///
+struct hive_binary_node
+{
+    uint32_t type; ///< The type of this node, one of the HIVE_BINARY_TYPE_* constants.
+    uint32_t count; ///< The string length, or the number of list items or map entries.
+};
+
+///
+/// @brief A map entry in a binary object tree.
+///
+struct hive_binary_pair
+{
+    uint32_t key; ///< The offset of the key node.
+    uint32_t value; ///< The offset of the value node.
+};
+
+///
+/// @brief Validates a binary object tree header.
+///
+/// @param base The start of the block.
+/// @param length The number of bytes that are readable at base.
+/// @param header Receives a copy of the header.
+/// @return Whether the header is valid and fits within length.
+///
+static inline bool hive_binary_read_header(const void* base, size_t length, struct hive_binary_header* header)
+{
+    if (length < sizeof(struct hive_binary_header))
+        return false;
+    memcpy(header, base, sizeof(struct hive_binary_header));
+    return header->magic == HIVE_BINARY_MAGIC &&
+           header->version == HIVE_BINARY_VERSION &&
+           header->length >= sizeof(struct hive_binary_header) &&
+           header->length <= length;
+}
+
+///
+/// @brief Reads and validates a node from a binary object tree.
+///
+/// The node is copied out so that the caller works on a consistent view even
+/// if the block is concurrently being rewritten; the payload is guaranteed
+/// to lie within the block.
+///
+/// @param base The start of the block.
+/// @param length The length of the block, as recorded in the header.
+/// @param offset The offset of the node to read.
+/// @param node Receives a copy of the node.
+/// @return A pointer to the payload of the node, or NULL if the node is invalid.
+///
+static inline const void* hive_binary_read_node(const void* base, uint32_t length, uint32_t offset, struct hive_binary_node* node)
+{
+    uint64_t payload;
+    if (offset % HIVE_BINARY_ALIGN != 0 || offset < sizeof(struct hive_binary_header) ||
+        offset > length || length - offset < sizeof(struct hive_binary_node))
+        return NULL;
+    memcpy(node, (const char*)base + offset, sizeof(struct hive_binary_node));
+    switch (node->type)
+    {
+        case HIVE_BINARY_TYPE_NIL:
+            payload = 0;
+            break;
+        case HIVE_BINARY_TYPE_NUMBER:
+            payload = sizeof(int64_t);
+            break;
+        case HIVE_BINARY_TYPE_STRING:
+            payload = (uint64_t)node->count + 1;
+            break;
+        case HIVE_BINARY_TYPE_LIST:
+            payload = (uint64_t)node->count * sizeof(uint32_t);
+            break;
+        case HIVE_BINARY_TYPE_MAP:
+            payload = (uint64_t)node->count * (sizeof(struct hive_binary_pair) + sizeof(uint32_t));
+            break;
+        default:
+            return NULL;
+    }
+    if (length - offset - sizeof(struct hive_binary_node) < payload)
+        return NULL;
+    return (const char*)base + offset + sizeof(struct hive_binary_node);
+}
+
+///
+/// @brief Compares a string against a map key, in sorted index order.
+///
+/// String keys are ordered bytewise (shorter first on a common prefix) and
+/// sort before keys of any other type.
+///
+/// @param key The string to compare.
+/// @param key_length The length of key.
+/// @param type The type of the map key.
+/// @param data The bytes of the map key, if it is a string.
+/// @param length The length of the map key, if it is a string.
+/// @return Less than, equal to or greater than zero, as with memcmp.
+///
+static inline int hive_binary_compare_key(const char* key, size_t key_length, uint32_t type, const char* data, size_t length)
+{
+    if (type != HIVE_BINARY_TYPE_STRING)
+        return -1;
+    int result = memcmp(key, data, key_length < length ? key_length : length);
+    if (result != 0)
+        return result;
+    return key_length < length ? -1 : (key_length > length ? 1 : 0);
+}
+
+///
+/// @brief Finds the value of a map entry whose key is the given string.
+///
+/// @param base The start of the block.
+/// @param length The length of the block, as recorded in the header.
+/// @param payload The payload of the map node, as returned by hive_binary_read_node.
+/// @param count The number of entries in the map.
+/// @param key The key to look for.
+/// @param key_length The length of key.
+/// @return The offset of the value node, or 0 if there is no such entry.
+///
+static inline uint32_t hive_binary_map_find(const void* base, uint32_t length, const void* payload, uint32_t count, const char* key, size_t key_length)
+{
+    const struct hive_binary_pair* pairs = payload;
+    const uint32_t* sorted = (const uint32_t*)(pairs + count);
+    uint32_t low = 0;
+    uint32_t high = count;
+    while (low < high)
+    {
+        uint32_t middle = low + (high - low) / 2;
+        uint32_t position;
+        struct hive_binary_pair pair;
+        struct hive_binary_node node;
+        memcpy(&position, &sorted[middle], sizeof(position));
+        if (position >= count)
+            return 0;
+        memcpy(&pair, &pairs[position], sizeof(pair));
+        const char* data = hive_binary_read_node(base, length, pair.key, &node);
+        if (data == NULL)
+            return 0;
+        int result = hive_binary_compare_key(key, key_length, node.type, data, node.count);
+        if (result == 0)
+            return pair.value;
+        else if (result < 0)
+            high = middle;
+        else
+            low = middle + 1;
+    }
+    return 0;
+}
+
+#endif
@@ -0,0 +1,411 @@
+///
+/// @file
+/// @brief Caches parsed YAML sources so that they are only parsed when they change.
+///
+/// Each source is keyed by its path, device, inode, size and modification
+/// time; if those all match the file is not even read.  If they do not
+/// match the content is read and hashed, and it is only parsed if the hash
+/// differs (for example, a touch or a rewrite with identical content is
+/// free).  If the parsed tree is the same as before (only comments or
+/// formatting changed), the old tree is kept, so that the documents and
+/// renders built from it are still reused.  When app->cache.path is set, every parsed document is also
+/// persisted there in the binary object format, so that a restart does not
+/// need to parse unchanged sources again.
+///
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "hive_cache.h"
+#include "hive_binary.h"
+#include "hive_yaml.h"
+#include "hive_xslt.h"
+#include "hive_snapshot.h"
+
+#define HIVE_CACHE_MAGIC 0x43594643 ///< The magic number at the start of a persisted entry ("CFYC").
+#define HIVE_CACHE_VERSION 1 ///< The current version of persisted entries.
+
+///
+/// @brief The key that identifies the exact content of a source file.
+///
+struct hive_cache_key
+{
+    uint64_t device; ///< The device the file lives on.
+    uint64_t inode; ///< The inode of the file.
+    uint64_t size; ///< The size of the file in bytes.
+    int64_t mtime_sec; ///< The modification time of the file (seconds).
+    int64_t mtime_nsec; ///< The modification time of the file (nanoseconds).
+    int64_t cached_sec; ///< When the content was read (seconds).
+    int64_t cached_nsec; ///< When the content was read (nanoseconds).
+    uint64_t hash; ///< The FNV-1a hash of the content.
+};
+
+///
+/// @brief The header of a persisted entry.
+///
+/// It is followed by the path (padded to HIVE_BINARY_ALIGN) and then the
+/// document as a binary object tree.
+///
+struct hive_cache_record
+{
+    uint32_t magic; ///< Always HIVE_CACHE_MAGIC.
+    uint32_t version; ///< Always HIVE_CACHE_VERSION.
+    struct hive_cache_key key; ///< The key of the content.
+    uint32_t path_length; ///< The length of the source path.
+    uint32_t reserved; ///< Padding; always zero.
+};
+
+///
+/// @brief A parsed source in the cache.
+///
+struct hive_cache_entry
+{
+    ///
+    /// @brief The path of the source.
+    ///
+    bstring path;
+    
+    ///
+    /// @brief The key of the content that root was parsed from.
+    ///
+    struct hive_cache_key key;
+    
+    ///
+    /// @brief The parsed content.
+    ///
+    struct object* root;
+};
+
+///
+/// @brief Finds an element in the cache based on path.
+///
+/// @param el The current element that is being found.
+/// @param key The path of the source.
+///
+int hive_cache_entry_seeker(const void* el, const void* key)
+{
+    return biseq(((struct hive_cache_entry*)el)->path, (const_bstring)key);
+}
+
+///
+/// @brief Computes the 64-bit FNV-1a hash of a block of memory.
+///
+/// @param data The memory to hash.
+/// @param length The length of the memory.
+/// @return The hash.
+///
+uint64_t hive_cache_hash(const void* data, size_t length)
+{
+    return hive_object_mix(HIVE_OBJECT_HASH_SEED, data, length);
+}
+
+///
+/// @internal
+/// @brief Returns whether the file status still matches a cached key.
+///
+/// A file that was modified in the same instant that it was read may have
+/// been modified again without changing it's status, so such entries are
+/// never trusted on status alone.
+///
+bool hive_cache_key_matches(struct hive_cache_key* key, struct stat* st)
+{
+    if (key->device != (uint64_t)st->st_dev || key->inode != (uint64_t)st->st_ino ||
+        key->size != (uint64_t)st->st_size || key->mtime_sec != st->st_mtim.tv_sec ||
+        key->mtime_nsec != st->st_mtim.tv_nsec)
+        return false;
+    return key->cached_sec > key->mtime_sec ||
+           (key->cached_sec == key->mtime_sec && key->cached_nsec > key->mtime_nsec);
+}
+
+///
+/// @internal
+/// @brief Updates a cached key from the file status.
+///
+void hive_cache_key_update(struct hive_cache_key* key, struct stat* st, struct timespec* cached)
+{
+    key->device = st->st_dev;
+    key->inode = st->st_ino;
+    key->size = st->st_size;
+    key->mtime_sec = st->st_mtim.tv_sec;
+    key->mtime_nsec = st->st_mtim.tv_nsec;
+    key->cached_sec = cached->tv_sec;
+    key->cached_nsec = cached->tv_nsec;
+}
+
+///
+/// @internal
+/// @brief Returns the path that a source is persisted at.
+///
+bstring hive_cache_record_path(app_t* app, bstring path)
+{
+    return bformat("%s/%016llx.bin", (const char*)app->cache.path->data,
+                   (unsigned long long)hive_cache_hash(path->data, blength(path)));
+}
+
+///
+/// @internal
+/// @brief Persists a cache entry, if persistence is enabled.
+///
+void hive_cache_save(app_t* app, struct hive_cache_entry* entry)
+{
+    if (app->cache.path == NULL)
+        return;
+    struct hive_cache_record record;
+    memset(&record, 0, sizeof(record));
+    record.magic = HIVE_CACHE_MAGIC;
+    record.version = HIVE_CACHE_VERSION;
+    record.key = entry->key;
+    record.path_length = blength(entry->path);
+    
+    bstring data = blk2bstr(&record, sizeof(record));
+    bconcat(data, entry->path);
+    binsertch(data, blength(data), (HIVE_BINARY_ALIGN - blength(data) % HIVE_BINARY_ALIGN) % HIVE_BINARY_ALIGN, '\0');
+    bstring document = hive_binary_encode(entry->root);
+    bconcat(data, document);
+    bdestroy(document);
+    
+    bstring path = hive_cache_record_path(app, entry->path);
+    bstring temporary = bformat("%s.tmp", (const char*)path->data);
+    FILE* file = fopen((const char*)temporary->data, "wb");
+    bool result = file != NULL;
+    if (result)
+    {
+        result = fwrite(data->data, 1, blength(data), file) == (size_t)blength(data);
+        result = fclose(file) == 0 && result;
+        result = result && rename((const char*)temporary->data, (const char*)path->data) == 0;
+        if (!result)
+            unlink((const char*)temporary->data);
+    }
+    if (!result)
+        fprintf(stderr, "unable to persist cache: %s\n", path->data);
+    bdestroy(temporary);
+    bdestroy(path);
+    bdestroy(data);
+}
+
+///
+/// @internal
+/// @brief Loads a persisted cache entry, if persistence is enabled.
+///
+/// @return The entry, or NULL if there is no valid persisted entry for the path.
+///
+struct hive_cache_entry* hive_cache_load(app_t* app, bstring path)
+{
+    if (app->cache.path == NULL)
+        return NULL;
+    struct hive_cache_record record;
+    size_t length;
+    bstring record_path = hive_cache_record_path(app, path);
+    const unsigned char* data = hive_binary_map_raw(record_path, &length);
+    bdestroy(record_path);
+    if (data == NULL)
+        return NULL;
+    
+    // The record comes first, then the path, then the block (which checks
+    // it's own header when it is decoded).
+    struct hive_cache_entry* entry = NULL;
+    size_t offset = sizeof(record) + blength(path);
+    offset += (HIVE_BINARY_ALIGN - offset % HIVE_BINARY_ALIGN) % HIVE_BINARY_ALIGN;
+    memset(&record, 0, sizeof(record));
+    if (length >= sizeof(record))
+        memcpy(&record, data, sizeof(record));
+    if (record.magic == HIVE_CACHE_MAGIC && record.version == HIVE_CACHE_VERSION &&
+        record.path_length == (uint32_t)blength(path) && offset <= length &&
+        memcmp(data + sizeof(record), path->data, blength(path)) == 0)
+    {
+        struct object* root = hive_binary_decode(data + offset, length - offset);
+        if (root != NULL)
+        {
+            entry = malloc(sizeof(struct hive_cache_entry));
+            entry->path = bstrcpy(path);
+            entry->key = record.key;
+            entry->root = root;
+        }
+    }
+    hive_binary_unmap_file(data, length);
+    return entry;
+}
+
+///
+/// @brief Initializes the parsed source cache.
+///
+/// app->cache.path must already be set to the directory to persist
+/// entries in, or NULL to only cache in memory.
+///
+/// @param app The application.
+///
+void hive_cache_init(app_t* app)
+{
+    list_init(&app->cache.entries);
+    list_attributes_seeker(&app->cache.entries, hive_cache_entry_seeker);
+}
+
+///
+/// @brief Returns the parsed content of a YAML source, parsing it only if it has changed.
+///
+/// The result is owned by the cache.  It remains valid until the source is
+/// parsed again after a change, or it is removed with hive_cache_remove.
+///
+/// @param app The application.
+/// @param path The path of the YAML source.
+/// @return The parsed content, or NULL if the source is missing or invalid.
+///
+struct object* hive_cache_parse_file(app_t* app, bstring path)
+{
+    struct stat st;
+    struct timespec cached;
+    if (stat((const char*)path->data, &st) != 0)
+        return NULL;
+    struct hive_cache_entry* entry = list_seek(&app->cache.entries, path);
+    if (entry == NULL)
+    {
+        entry = hive_cache_load(app, path);
+        if (entry != NULL)
+            list_append(&app->cache.entries, entry);
+    }
+    if (entry != NULL && hive_cache_key_matches(&entry->key, &st))
+        return entry->root;
+    
+    // Read the content and see whether it actually changed.
+    clock_gettime(CLOCK_REALTIME, &cached);
+    FILE* file = fopen((const char*)path->data, "rb");
+    if (file == NULL)
+        return NULL;
+    bstring content = bread((bNread)fread, file);
+    fclose(file);
+    uint64_t hash = hive_cache_hash(content->data, blength(content));
+    if (entry != NULL && entry->key.hash == hash && entry->key.size == (uint64_t)blength(content))
+    {
+        bdestroy(content);
+        hive_cache_key_update(&entry->key, &st, &cached);
+        hive_cache_save(app, entry);
+        return entry->root;
+    }
+    
+    // The content changed, so parse it.
+    struct object* root = hive_yaml_parse_string(content);
+    bdestroy(content);
+    if (root == NULL)
+        return NULL;
+    if (entry == NULL)
+    {
+        entry = malloc(sizeof(struct hive_cache_entry));
+        entry->path = bstrcpy(path);
+        entry->root = NULL;
+        list_append(&app->cache.entries, entry);
+    }
+    if (entry->root != NULL && hive_object_hash(entry->root) == hive_object_hash(root))
+    {
+        // Only comments or formatting changed, so keep the old tree (and
+        // everything that was built from it).
+        hive_object_free(root);
+        root = entry->root;
+    }
+    else if (entry->root != NULL)
+    {
+        hive_xslt_release(app, entry->root);
+        if (app->enable_snapshot)
+            hive_snapshot_release(app, entry->root, root);
+        hive_object_free(entry->root);
+    }
+    entry->root = root;
+    hive_cache_key_update(&entry->key, &st, &cached);
+    entry->key.hash = hash;
+    hive_cache_save(app, entry);
+    return entry->root;
+}
+
+///
+/// @brief Removes a source from the cache, including any persisted entry.
+///
+/// @param app The application.
+/// @param path The path of the YAML source.
+///
+void hive_cache_remove(app_t* app, bstring path)
+{
+    struct hive_cache_entry* entry = list_seek(&app->cache.entries, path);
+    if (entry != NULL)
+    {
+        list_delete(&app->cache.entries, entry);
+        bdestroy(entry->path);
+        hive_xslt_release(app, entry->root);
+        if (app->enable_snapshot)
+            hive_snapshot_release(app, entry->root, NULL);
+        hive_object_free(entry->root);
+        free(entry);
+    }
+    if (app->cache.path != NULL)
+    {
+        bstring record_path = hive_cache_record_path(app, path);
+        unlink((const char*)record_path->data);
+        bdestroy(record_path);
+    }
+}
+
+///
+/// @brief Returns what was parsed from a file, parsing it again only if it is new or has changed.
+///
+/// This is the cache for small files that are parsed into something other
+/// than an object tree, such as templates and .emit files.  Unlike sources,
+/// they are compared by modification time and size alone, and read in full
+/// when those change.
+///
+/// @param entries The cache, a list of struct hive_cache_loaded.
+/// @param path The path of the file.
+/// @param kind What the file is, for messages ("template", for example).
+/// @param parse Parses the content of the file; returns NULL if it is invalid.
+/// @param release Frees what parse returned.
+/// @return What was parsed from the file (owned by the cache), or NULL if it is missing or invalid.
+///
+void* hive_cache_load_file(list_t* entries, bstring path, const char* kind,
+                           void* (*parse)(bstring source, const char* name), void (*release)(void* value))
+{
+    struct stat st;
+    if (stat((const char*)path->data, &st) != 0)
+    {
+        fprintf(stderr, "missing %s: %s\n", kind, path->data);
+        return NULL;
+    }
+    struct hive_cache_loaded* cached = NULL;
+    list_iterator_start(entries);
+    while (cached == NULL && list_iterator_hasnext(entries))
+    {
+        struct hive_cache_loaded* loaded = list_iterator_next(entries);
+        if (biseq(loaded->path, path))
+            cached = loaded;
+    }
+    list_iterator_stop(entries);
+    if (cached != NULL)
+    {
+        if (cached->mtime.tv_sec == st.st_mtim.tv_sec && cached->mtime.tv_nsec == st.st_mtim.tv_nsec &&
+            cached->size == st.st_size)
+            return cached->value;
+        list_delete(entries, cached);
+        release(cached->value);
+        bdestroy(cached->path);
+        free(cached);
+    }
+
+    FILE* file = fopen((const char*)path->data, "rb");
+    if (file == NULL)
+    {
+        fprintf(stderr, "missing %s: %s\n", kind, path->data);
+        return NULL;
+    }
+    bstring source = bread((bNread)fread, file);
+    fclose(file);
+    void* value = parse(source, (const char*)path->data);
+    bdestroy(source);
+    if (value == NULL)
+        return NULL;
+    struct hive_cache_loaded* loaded = malloc(sizeof(struct hive_cache_loaded));
+    loaded->path = bstrcpy(path);
+    loaded->mtime = st.st_mtim;
+    loaded->size = st.st_size;
+    loaded->value = value;
+    list_append(entries, loaded);
+    return value;
+}
@@ -0,0 +1,31 @@
+#ifndef __HIVE_CACHE_H
+#define __HIVE_CACHE_H
+
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+#include <bstrlib.h>
+#include <simclist.h>
+#include "hive_app.h"
+#include "hive_object.h"
+
+///
+/// @brief Something that was parsed from a file, such as a compiled template,
+///        and the status of the file when it was read.
+///
+struct hive_cache_loaded
+{
+    bstring path; ///< The path of the file.
+    struct timespec mtime; ///< The modification time of the file when it was read.
+    off_t size; ///< The size of the file when it was read.
+    void* value; ///< What was parsed from the file.
+};
+
+void hive_cache_init(app_t* app);
+struct object* hive_cache_parse_file(app_t* app, bstring path);
+void hive_cache_remove(app_t* app, bstring path);
+uint64_t hive_cache_hash(const void* data, size_t length);
+void* hive_cache_load_file(list_t* entries, bstring path, const char* kind,
+                           void* (*parse)(bstring source, const char* name), void (*release)(void* value));
+
+#endif
@@ -0,0 +1,437 @@
+///
+/// @file
+/// @brief Compares two object trees, such as two versions of a parsed source.
+///
+/// The result is the list of paths that were added, removed or modified,
+/// in the same form that cfg:get takes (keys and list positions separated
+/// by '/').  Subtrees whose hashes are equal are skipped without looking
+/// inside them, and map entries are matched by key through a hash table.
+/// List items are matched by hash the way a patience diff matches lines:
+/// after trimming the common prefix and suffix, the items that occur once
+/// in each list anchor the match (the longest run of them that is in the
+/// same order in both), and the gaps between the anchors are matched in
+/// the same way in turn.  Moving one item in a list is then one removal
+/// and one addition, and the work stays close to linear in the size of
+/// the trees.
+///
+/// Containers are never reported as modified themselves; the difference
+/// is reported at the deepest path where the trees diverge, which is
+/// either a scalar that changed, or a value whose type changed.  Items of
+/// a gap without unique items are paired up in order and compared in
+/// turn; what is left over is reported as added (at the position in the
+/// new list) or removed (at the position in the old list).
+///
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hive_diff.h"
+#include "hive_cache.h"
+#include "hive_index.h"
+
+#define HIVE_DIFF_NONE ((size_t)-1) ///< Marks the start of a run of anchors.
+
+///
+/// @brief How often an item hash occurs in the parts of two lists being matched.
+///
+struct hive_diff_occurrence
+{
+    uint64_t hash; ///< The hash of the items.
+    size_t old_count; ///< The number of old items with the hash.
+    size_t new_count; ///< The number of new items with the hash.
+    size_t old_position; ///< The position of the last old item with the hash.
+};
+
+void hive_diff_objects(struct hive_diff* diff, bstring path, struct object* old, struct object* new);
+
+///
+/// @internal
+/// @brief Appends a difference.
+///
+void hive_diff_add(struct hive_diff* diff, int kind, bstring path, struct object* old, struct object* new)
+{
+    if (diff->count == diff->capacity)
+    {
+        diff->capacity = diff->capacity == 0 ? 16 : diff->capacity * 2;
+        diff->changes = realloc(diff->changes, diff->capacity * sizeof(struct hive_diff_change));
+    }
+    struct hive_diff_change* change = &diff->changes[diff->count++];
+    change->kind = kind;
+    change->path = bstrcpy(path);
+    change->old = old;
+    change->new = new;
+}
+
+///
+/// @internal
+/// @brief Returns the path of a child.
+///
+bstring hive_diff_child(bstring path, const char* key, size_t length)
+{
+    bstring child = bstrcpy(path);
+    if (blength(child) > 0)
+        bconchar(child, '/');
+    bcatblk(child, key, length);
+    return child;
+}
+
+///
+/// @internal
+/// @brief Returns the path of a list item.
+///
+bstring hive_diff_item(bstring path, size_t position)
+{
+    char buffer[32];
+    size_t length = snprintf(buffer, sizeof(buffer), "%zu", position);
+    return hive_diff_child(path, buffer, length);
+}
+
+///
+/// @internal
+/// @brief Compares two maps, matching their entries by key.
+///
+void hive_diff_maps(struct hive_diff* diff, bstring path, struct object* old, struct object* new)
+{
+    // Index the old entries by key (the first of any duplicate keys wins).
+    size_t count = list_size(&old->map);
+    struct map_entry** entries = malloc((count + 1) * sizeof(struct map_entry*));
+    bool* matched = calloc(count + 1, sizeof(bool));
+    size_t capacity = 16;
+    while (capacity < count * 2)
+        capacity *= 2;
+    size_t* table = calloc(capacity, sizeof(size_t));
+    char buffer[32];
+    char other[32];
+    size_t length;
+    size_t other_length;
+    size_t position = 0;
+    list_iterator_start(&old->map);
+    while (list_iterator_hasnext(&old->map))
+    {
+        struct map_entry* entry = list_iterator_next(&old->map);
+        entries[position] = entry;
+        const char* key = hive_index_key(entry->key, buffer, sizeof(buffer), &length);
+        size_t slot = hive_cache_hash(key, length) & (capacity - 1);
+        bool duplicate = false;
+        while (!duplicate && table[slot] != 0)
+        {
+            const char* existing = hive_index_key(entries[table[slot] - 1]->key, other, sizeof(other), &other_length);
+            duplicate = other_length == length && memcmp(existing, key, length) == 0;
+            slot = (slot + 1) & (capacity - 1);
+        }
+        if (!duplicate)
+            table[slot] = position + 1;
+        position++;
+    }
+    list_iterator_stop(&old->map);
+
+    // Compare the entries with the same key, in the order of the new map.
+    list_iterator_start(&new->map);
+    while (list_iterator_hasnext(&new->map))
+    {
+        struct map_entry* entry = list_iterator_next(&new->map);
+        const char* key = hive_index_key(entry->key, buffer, sizeof(buffer), &length);
+        size_t slot = hive_cache_hash(key, length) & (capacity - 1);
+        size_t found = 0;
+        while (found == 0 && table[slot] != 0)
+        {
+            const char* existing = hive_index_key(entries[table[slot] - 1]->key, other, sizeof(other), &other_length);
+            if (other_length == length && memcmp(existing, key, length) == 0)
+                found = table[slot];
+            slot = (slot + 1) & (capacity - 1);
+        }
+        if (found != 0 && !matched[found - 1])
+        {
+            matched[found - 1] = true;
+            if (hive_object_hash(entries[found - 1]->value) == hive_object_hash(entry->value))
+                continue;
+        }
+        else
+            found = 0;
+        bstring child = hive_diff_child(path, key, length);
+        if (found != 0)
+            hive_diff_objects(diff, child, entries[found - 1]->value, entry->value);
+        else
+            hive_diff_add(diff, HIVE_DIFF_ADDED, child, NULL, entry->value);
+        bdestroy(child);
+    }
+    list_iterator_stop(&new->map);
+
+    // Whatever was not matched is gone.
+    for (size_t i = 0; i < count; i++)
+    {
+        if (matched[i])
+            continue;
+        const char* key = hive_index_key(entries[i]->key, buffer, sizeof(buffer), &length);
+        bstring child = hive_diff_child(path, key, length);
+        hive_diff_add(diff, HIVE_DIFF_REMOVED, child, entries[i]->value, NULL);
+        bdestroy(child);
+    }
+    free(table);
+    free(matched);
+    free(entries);
+}
+
+///
+/// @internal
+/// @brief Collects the items of a list and their hashes.
+///
+struct object** hive_diff_items(struct object* list, uint64_t** hashes, size_t* count)
+{
+    *count = list_size(&list->list);
+    struct object** items = malloc((*count + 1) * sizeof(struct object*));
+    *hashes = malloc((*count + 1) * sizeof(uint64_t));
+    size_t position = 0;
+    list_iterator_start(&list->list);
+    while (list_iterator_hasnext(&list->list))
+    {
+        items[position] = list_iterator_next(&list->list);
+        (*hashes)[position] = hive_object_hash(items[position]);
+        position++;
+    }
+    list_iterator_stop(&list->list);
+    return items;
+}
+
+///
+/// @internal
+/// @brief Compares the items between two matches in two lists: they are paired
+///        up in order, and the rest were added or removed.
+///
+void hive_diff_gap(struct hive_diff* diff, bstring path, struct object** old, size_t old_start, size_t old_end,
+                   struct object** new, size_t new_start, size_t new_end)
+{
+    while (old_start < old_end || new_start < new_end)
+    {
+        bstring child = hive_diff_item(path, new_start < new_end ? new_start : old_start);
+        if (old_start < old_end && new_start < new_end)
+            hive_diff_objects(diff, child, old[old_start++], new[new_start++]);
+        else if (old_start < old_end)
+            hive_diff_add(diff, HIVE_DIFF_REMOVED, child, old[old_start++], NULL);
+        else
+            hive_diff_add(diff, HIVE_DIFF_ADDED, child, NULL, new[new_start++]);
+        bdestroy(child);
+    }
+}
+
+///
+/// @internal
+/// @brief Counts an item hash in a table of occurrences.
+///
+/// @return The occurrence of the hash.
+///
+struct hive_diff_occurrence* hive_diff_occurrence(struct hive_diff_occurrence* table, size_t capacity, uint64_t hash)
+{
+    size_t slot = hash & (capacity - 1);
+    while ((table[slot].old_count != 0 || table[slot].new_count != 0) && table[slot].hash != hash)
+        slot = (slot + 1) & (capacity - 1);
+    table[slot].hash = hash;
+    return &table[slot];
+}
+
+///
+/// @internal
+/// @brief Finds the items that occur once in each part of two lists, and
+///        returns the longest run of them that is in the same order in both.
+///
+/// @return The number of anchors, whose positions are stored in
+///         old_anchors and new_anchors in order.
+///
+size_t hive_diff_anchors(uint64_t* old_hashes, size_t old_start, size_t old_end, uint64_t* new_hashes,
+                         size_t new_start, size_t new_end, size_t* old_anchors, size_t* new_anchors)
+{
+    size_t capacity = 16;
+    while (capacity < (old_end - old_start + new_end - new_start) * 2)
+        capacity *= 2;
+    struct hive_diff_occurrence* table = calloc(capacity, sizeof(struct hive_diff_occurrence));
+    for (size_t i = old_start; i < old_end; i++)
+    {
+        struct hive_diff_occurrence* occurrence = hive_diff_occurrence(table, capacity, old_hashes[i]);
+        occurrence->old_count++;
+        occurrence->old_position = i;
+    }
+    for (size_t i = new_start; i < new_end; i++)
+        hive_diff_occurrence(table, capacity, new_hashes[i])->new_count++;
+
+    // Sort the unique items into piles by their old position, in the order
+    // of the new list; the top of each pile links to the top of the pile
+    // before it, so the last pile ends the longest increasing run.
+    size_t count = 0;
+    size_t piles = 0;
+    size_t* tops = malloc((new_end - new_start + 1) * sizeof(size_t));
+    size_t* previous = malloc((new_end - new_start + 1) * sizeof(size_t));
+    for (size_t i = new_start; i < new_end; i++)
+    {
+        struct hive_diff_occurrence* occurrence = hive_diff_occurrence(table, capacity, new_hashes[i]);
+        if (occurrence->old_count != 1 || occurrence->new_count != 1)
+            continue;
+        old_anchors[count] = occurrence->old_position;
+        new_anchors[count] = i;
+        size_t low = 0;
+        size_t high = piles;
+        while (low < high)
+        {
+            size_t middle = (low + high) / 2;
+            if (old_anchors[tops[middle]] < occurrence->old_position)
+                low = middle + 1;
+            else
+                high = middle;
+        }
+        previous[count] = low == 0 ? HIVE_DIFF_NONE : tops[low - 1];
+        tops[low] = count++;
+        if (low == piles)
+            piles++;
+    }
+
+    // Walk the run back from the last pile, then move the anchors into place
+    // (each is at or after the place it moves to).
+    size_t anchor = piles == 0 ? HIVE_DIFF_NONE : tops[piles - 1];
+    for (size_t i = piles; i-- > 0;)
+    {
+        tops[i] = anchor;
+        anchor = previous[anchor];
+    }
+    for (size_t i = 0; i < piles; i++)
+    {
+        old_anchors[i] = old_anchors[tops[i]];
+        new_anchors[i] = new_anchors[tops[i]];
+    }
+    free(previous);
+    free(tops);
+    free(table);
+    return piles;
+}
+
+///
+/// @internal
+/// @brief Compares parts of two lists, anchoring the match on the items that
+///        occur once in each.
+///
+void hive_diff_match(struct hive_diff* diff, bstring path, struct object** old_items, uint64_t* old_hashes,
+                     size_t old_start, size_t old_end, struct object** new_items, uint64_t* new_hashes,
+                     size_t new_start, size_t new_end)
+{
+    while (old_start < old_end && new_start < new_end && old_hashes[old_start] == new_hashes[new_start])
+    {
+        old_start++;
+        new_start++;
+    }
+    while (old_start < old_end && new_start < new_end && old_hashes[old_end - 1] == new_hashes[new_end - 1])
+    {
+        old_end--;
+        new_end--;
+    }
+    if (old_start == old_end || new_start == new_end)
+    {
+        hive_diff_gap(diff, path, old_items, old_start, old_end, new_items, new_start, new_end);
+        return;
+    }
+
+    size_t* old_anchors = malloc((new_end - new_start) * sizeof(size_t));
+    size_t* new_anchors = malloc((new_end - new_start) * sizeof(size_t));
+    size_t count = hive_diff_anchors(old_hashes, old_start, old_end, new_hashes, new_start, new_end, old_anchors, new_anchors);
+    if (count == 0)
+        hive_diff_gap(diff, path, old_items, old_start, old_end, new_items, new_start, new_end);
+    for (size_t i = 0; i < count; i++)
+    {
+        hive_diff_match(diff, path, old_items, old_hashes, old_start, old_anchors[i], new_items, new_hashes, new_start, new_anchors[i]);
+        old_start = old_anchors[i] + 1;
+        new_start = new_anchors[i] + 1;
+    }
+    if (count != 0)
+        hive_diff_match(diff, path, old_items, old_hashes, old_start, old_end, new_items, new_hashes, new_start, new_end);
+    free(new_anchors);
+    free(old_anchors);
+}
+
+///
+/// @internal
+/// @brief Compares two lists, matching their items by hash.
+///
+void hive_diff_lists(struct hive_diff* diff, bstring path, struct object* old, struct object* new)
+{
+    uint64_t* old_hashes;
+    uint64_t* new_hashes;
+    size_t old_count;
+    size_t new_count;
+    struct object** old_items = hive_diff_items(old, &old_hashes, &old_count);
+    struct object** new_items = hive_diff_items(new, &new_hashes, &new_count);
+    hive_diff_match(diff, path, old_items, old_hashes, 0, old_count, new_items, new_hashes, 0, new_count);
+    free(new_hashes);
+    free(old_hashes);
+    free(new_items);
+    free(old_items);
+}
+
+///
+/// @internal
+/// @brief Compares two objects at the same path.
+///
+void hive_diff_objects(struct hive_diff* diff, bstring path, struct object* old, struct object* new)
+{
+    if (hive_object_hash(old) == hive_object_hash(new))
+        return;
+    int old_type = old == NULL ? OBJECT_TYPE_NIL : old->type;
+    int new_type = new == NULL ? OBJECT_TYPE_NIL : new->type;
+    if (old_type == OBJECT_TYPE_MAP && new_type == OBJECT_TYPE_MAP)
+        hive_diff_maps(diff, path, old, new);
+    else if (old_type == OBJECT_TYPE_LIST && new_type == OBJECT_TYPE_LIST)
+        hive_diff_lists(diff, path, old, new);
+    else
+        hive_diff_add(diff, HIVE_DIFF_MODIFIED, path, old, new);
+}
+
+///
+/// @brief Computes the differences between two object trees.
+///
+/// The differences refer to objects in both trees, so they must be freed
+/// before either tree is.
+///
+/// @param old The old tree, or NULL.
+/// @param new The new tree, or NULL.
+/// @return The differences, which are empty if the trees are equal.
+///
+struct hive_diff* hive_diff_compute(struct object* old, struct object* new)
+{
+    struct hive_diff* diff = calloc(1, sizeof(struct hive_diff));
+    bstring path = bfromcstr("");
+    hive_diff_objects(diff, path, old, new);
+    bdestroy(path);
+    return diff;
+}
+
+///
+/// @brief Frees the differences between two object trees (but not the trees).
+///
+/// @param diff The differences.
+///
+void hive_diff_free(struct hive_diff* diff)
+{
+    if (diff == NULL)
+        return;
+    for (size_t i = 0; i < diff->count; i++)
+        bdestroy(diff->changes[i].path);
+    free(diff->changes);
+    free(diff);
+}
+
+///
+/// @brief Returns the name of a kind of difference, for logs.
+///
+/// @param kind One of the HIVE_DIFF_* constants.
+/// @return "added", "removed" or "modified".
+///
+const char* hive_diff_kind_name(int kind)
+{
+    switch (kind)
+    {
+        case HIVE_DIFF_ADDED:
+            return "added";
+        case HIVE_DIFF_REMOVED:
+            return "removed";
+        default:
+            return "modified";
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef __HIVE_DIFF_H
+#define __HIVE_DIFF_H
+
+#include <stddef.h>
+#include <bstrlib.h>
+#include "hive_object.h"
+
+#define HIVE_DIFF_ADDED 0 ///< The object only exists in the new tree.
+#define HIVE_DIFF_REMOVED 1 ///< The object only exists in the old tree.
+#define HIVE_DIFF_MODIFIED 2 ///< The object exists in both trees, with a different value or type.
+
+///
+/// @brief A difference between two object trees.
+///
+struct hive_diff_change
+{
+    int kind; ///< One of the HIVE_DIFF_* constants.
+    bstring path; ///< The path of the object, as keys and list positions separated by '/'.
+    struct object* old; ///< The object in the old tree, or NULL if it was added.
+    struct object* new; ///< The object in the new tree, or NULL if it was removed.
+};
+
+///
+/// @brief The differences between two object trees.
+///
+struct hive_diff
+{
+    struct hive_diff_change* changes; ///< The differences, in the order of the new tree.
+    size_t count; ///< The number of differences.
+    size_t capacity; ///< The number of differences there is room for.
+};
+
+struct hive_diff* hive_diff_compute(struct object* old, struct object* new);
+void hive_diff_free(struct hive_diff* diff);
+const char* hive_diff_kind_name(int kind);
+
+#endif
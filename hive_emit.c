@@ -0,0 +1,467 @@
+///
+/// @file
+/// @brief Writes outputs in common formats straight from the parsed source.
+///
+/// Most outputs are one of a few shapes, so instead of a stylesheet an
+/// output can name a built-in format in an .emit file:
+///
+///   format keyvalue
+///   separator " = "
+///
+/// The formats are:
+///
+///   keyvalue   "key value" for each entry of the top-level map; lists are
+///              joined with the list separator (", " by default) and maps
+///              become one "key subkey value" line per entry
+///   hosts      the same, with items separated by spaces ("addr name name")
+///   ini        top-level scalars, then a [section] for each top-level map,
+///              with deeper maps flattened to dotted keys
+///   json       the whole document
+///
+/// "separator" and "list-separator" override the text between keys and
+/// values, and between the items of a list; values may be quoted, with
+/// \n, \t, \" and \\ escapes.
+///
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hive_emit.h"
+#include "hive_cache.h"
+#include "hive_stats.h"
+#include "hive_template.h"
+#include "hive_output.h"
+#include "hive_trace.h"
+
+void hive_emit_keyvalue(const struct hive_emit_spec* spec, struct object* object, bstring output);
+void hive_emit_ini(const struct hive_emit_spec* spec, struct object* object, bstring output);
+void hive_emit_json(const struct hive_emit_spec* spec, struct object* object, bstring output);
+
+///
+/// @brief The built-in formats.
+///
+static const struct hive_emitter hive_emitters[] =
+{
+    { "keyvalue", hive_emit_keyvalue, " ", ", " },
+    { "hosts", hive_emit_keyvalue, " ", " " },
+    { "ini", hive_emit_ini, " = ", "," },
+    { "json", hive_emit_json, ": ", ", " },
+};
+
+///
+/// @brief Finds a format by name.
+///
+/// @param name The name of the format.
+/// @return The format, or NULL if there is no such format.
+///
+const struct hive_emitter* hive_emit_find(const char* name)
+{
+    for (size_t i = 0; i < sizeof(hive_emitters) / sizeof(hive_emitters[0]); i++)
+        if (strcmp(hive_emitters[i].name, name) == 0)
+            return &hive_emitters[i];
+    return NULL;
+}
+
+///
+/// @internal
+/// @brief Writes a scalar, or the scalars of a list separated by the list separator.
+///
+void hive_emit_joined(const struct hive_emit_spec* spec, struct object* object, bstring output)
+{
+    if (object == NULL || object->type != OBJECT_TYPE_LIST)
+    {
+        hive_object_write(object, output);
+        return;
+    }
+    bool first = true;
+    list_iterator_start(&object->list);
+    while (list_iterator_hasnext(&object->list))
+    {
+        if (!first)
+            bconcat(output, spec->list_separator);
+        first = false;
+        hive_object_write(list_iterator_next(&object->list), output);
+    }
+    list_iterator_stop(&object->list);
+}
+
+///
+/// @internal
+/// @brief Writes "key value" (or just "key", if there is no value) and a newline.
+///
+void hive_emit_line(const struct hive_emit_spec* spec, struct object* key, struct object* value, bstring output)
+{
+    hive_object_write(key, output);
+    if (value != NULL && value->type != OBJECT_TYPE_NIL)
+    {
+        bconcat(output, spec->separator);
+        hive_emit_joined(spec, value, output);
+    }
+    bconchar(output, '\n');
+}
+
+///
+/// @brief Writes "key value" lines (the keyvalue and hosts formats).
+///
+void hive_emit_keyvalue(const struct hive_emit_spec* spec, struct object* object, bstring output)
+{
+    if (object == NULL || object->type != OBJECT_TYPE_MAP)
+    {
+        // A list (or scalar) document is written one item per line.
+        if (object != NULL && object->type == OBJECT_TYPE_LIST)
+        {
+            list_iterator_start(&object->list);
+            while (list_iterator_hasnext(&object->list))
+                hive_emit_line(spec, list_iterator_next(&object->list), NULL, output);
+            list_iterator_stop(&object->list);
+        }
+        else if (object != NULL && object->type != OBJECT_TYPE_NIL)
+            hive_emit_line(spec, object, NULL, output);
+        return;
+    }
+    list_iterator_start(&object->map);
+    while (list_iterator_hasnext(&object->map))
+    {
+        struct map_entry* entry = list_iterator_next(&object->map);
+        if (entry->value == NULL || entry->value->type != OBJECT_TYPE_MAP)
+        {
+            hive_emit_line(spec, entry->key, entry->value, output);
+            continue;
+        }
+        list_iterator_start(&entry->value->map);
+        while (list_iterator_hasnext(&entry->value->map))
+        {
+            struct map_entry* child = list_iterator_next(&entry->value->map);
+            hive_object_write(entry->key, output);
+            bconcat(output, spec->separator);
+            hive_emit_line(spec, child->key, child->value, output);
+        }
+        list_iterator_stop(&entry->value->map);
+    }
+    list_iterator_stop(&object->map);
+}
+
+///
+/// @internal
+/// @brief Writes the entries of a map as INI keys, with nested maps as dotted keys.
+///
+void hive_emit_ini_entries(const struct hive_emit_spec* spec, struct object* map, bstring prefix, bstring output)
+{
+    list_iterator_start(&map->map);
+    while (list_iterator_hasnext(&map->map))
+    {
+        struct map_entry* entry = list_iterator_next(&map->map);
+        if (entry->value != NULL && entry->value->type == OBJECT_TYPE_MAP)
+        {
+            bstring nested = bstrcpy(prefix);
+            hive_object_write(entry->key, nested);
+            bconchar(nested, '.');
+            hive_emit_ini_entries(spec, entry->value, nested, output);
+            bdestroy(nested);
+            continue;
+        }
+        bconcat(output, prefix);
+        hive_object_write(entry->key, output);
+        bconcat(output, spec->separator);
+        hive_emit_joined(spec, entry->value, output);
+        bconchar(output, '\n');
+    }
+    list_iterator_stop(&map->map);
+}
+
+///
+/// @brief Writes an INI file.
+///
+void hive_emit_ini(const struct hive_emit_spec* spec, struct object* object, bstring output)
+{
+    if (object == NULL || object->type != OBJECT_TYPE_MAP)
+        return;
+    bstring prefix = bfromcstr("");
+
+    // Keys outside of any section have to come first.
+    list_iterator_start(&object->map);
+    while (list_iterator_hasnext(&object->map))
+    {
+        struct map_entry* entry = list_iterator_next(&object->map);
+        if (entry->value != NULL && entry->value->type == OBJECT_TYPE_MAP)
+            continue;
+        hive_object_write(entry->key, output);
+        bconcat(output, spec->separator);
+        hive_emit_joined(spec, entry->value, output);
+        bconchar(output, '\n');
+    }
+    list_iterator_stop(&object->map);
+
+    list_iterator_start(&object->map);
+    while (list_iterator_hasnext(&object->map))
+    {
+        struct map_entry* entry = list_iterator_next(&object->map);
+        if (entry->value == NULL || entry->value->type != OBJECT_TYPE_MAP)
+            continue;
+        if (blength(output) > 0)
+            bconchar(output, '\n');
+        bconchar(output, '[');
+        hive_object_write(entry->key, output);
+        bcatcstr(output, "]\n");
+        hive_emit_ini_entries(spec, entry->value, prefix, output);
+    }
+    list_iterator_stop(&object->map);
+    bdestroy(prefix);
+}
+
+///
+/// @internal
+/// @brief Writes a JSON string, escaping it as required.
+///
+void hive_emit_json_string(bstring string, bstring output)
+{
+    bconchar(output, '"');
+    for (int i = 0; i < blength(string); i++)
+    {
+        unsigned char c = string->data[i];
+        if (c == '"' || c == '\\')
+        {
+            bconchar(output, '\\');
+            bconchar(output, c);
+        }
+        else if (c == '\n')
+            bcatcstr(output, "\\n");
+        else if (c == '\t')
+            bcatcstr(output, "\\t");
+        else if (c < 0x20)
+            bformata(output, "\\u%04x", c);
+        else
+            bconchar(output, c);
+    }
+    bconchar(output, '"');
+}
+
+///
+/// @internal
+/// @brief Writes a JSON value, indented by four spaces per level.
+///
+void hive_emit_json_value(const struct hive_emit_spec* spec, struct object* object, int depth, bstring output)
+{
+    if (object == NULL || object->type == OBJECT_TYPE_NIL)
+    {
+        bcatcstr(output, "null");
+        return;
+    }
+    switch (object->type)
+    {
+        case OBJECT_TYPE_NUMBER:
+            bformata(output, "%ld", object->number);
+            return;
+        case OBJECT_TYPE_STRING:
+            hive_emit_json_string(object->string, output);
+            return;
+        case OBJECT_TYPE_LIST:
+        case OBJECT_TYPE_MAP:
+        {
+            bool map = object->type == OBJECT_TYPE_MAP;
+            list_t* list = map ? &object->map : &object->list;
+            if (list_size(list) == 0)
+            {
+                bcatcstr(output, map ? "{}" : "[]");
+                return;
+            }
+            bcatcstr(output, map ? "{\n" : "[\n");
+            bool first = true;
+            list_iterator_start(list);
+            while (list_iterator_hasnext(list))
+            {
+                void* item = list_iterator_next(list);
+                if (!first)
+                    bcatcstr(output, ",\n");
+                first = false;
+                for (int i = 0; i <= depth; i++)
+                    bcatcstr(output, "    ");
+                if (map)
+                {
+                    // JSON keys must be strings.
+                    struct map_entry* entry = item;
+                    bstring key = bfromcstr("");
+                    hive_object_write(entry->key, key);
+                    hive_emit_json_string(key, output);
+                    bdestroy(key);
+                    bconcat(output, spec->separator);
+                    hive_emit_json_value(spec, entry->value, depth + 1, output);
+                }
+                else
+                    hive_emit_json_value(spec, item, depth + 1, output);
+            }
+            list_iterator_stop(list);
+            bconchar(output, '\n');
+            for (int i = 0; i < depth; i++)
+                bcatcstr(output, "    ");
+            bconchar(output, map ? '}' : ']');
+            return;
+        }
+    }
+}
+
+///
+/// @brief Writes the whole document as JSON.
+///
+void hive_emit_json(const struct hive_emit_spec* spec, struct object* object, bstring output)
+{
+    hive_emit_json_value(spec, object, 0, output);
+    bconchar(output, '\n');
+}
+
+///
+/// @brief Parses the contents of an .emit file.
+///
+/// @param source The contents.
+/// @param name The name of the file, used in error messages.
+/// @return The specification, or NULL if it is invalid (the reason is printed).
+///
+struct hive_emit_spec* hive_emit_parse(bstring source, const char* name)
+{
+    struct hive_emit_spec* spec = calloc(1, sizeof(struct hive_emit_spec));
+    struct bstrList* lines = bsplit(source, '\n');
+    const char* error = NULL;
+    int line = 0;
+    for (int i = 0; i < lines->qty && error == NULL; i++)
+    {
+        line = i + 1;
+        bstring setting = lines->entry[i];
+        btrimws(setting);
+        if (blength(setting) == 0 || setting->data[0] == '#')
+            continue;
+        bstring value = NULL;
+        int space = bstrchr(setting, ' ');
+        if (space != BSTR_ERR)
+        {
+            value = bmidstr(setting, space + 1, blength(setting));
+            btrimws(value);
+            btrunc(setting, space);
+        }
+        bstring text = value == NULL ? NULL : hive_template_parse_text(value);
+        bdestroy(value);
+        if (text == NULL)
+            error = "missing or unbalanced value";
+        else if (biseqcstr(setting, "format"))
+        {
+            spec->emitter = hive_emit_find((const char*)text->data);
+            if (spec->emitter == NULL)
+                error = "unknown format";
+        }
+        else if (biseqcstr(setting, "separator"))
+        {
+            bdestroy(spec->separator);
+            spec->separator = bstrcpy(text);
+        }
+        else if (biseqcstr(setting, "list-separator"))
+        {
+            bdestroy(spec->list_separator);
+            spec->list_separator = bstrcpy(text);
+        }
+        else
+            error = "unknown setting";
+        bdestroy(text);
+    }
+    bstrListDestroy(lines);
+    if (error == NULL && spec->emitter == NULL)
+    {
+        error = "missing format";
+        line = 1;
+    }
+    if (error != NULL)
+    {
+        fprintf(stderr, "%s:%d: %s\n", name, line, error);
+        hive_emit_free(spec);
+        return NULL;
+    }
+    if (spec->separator == NULL)
+        spec->separator = bfromcstr(spec->emitter->separator);
+    if (spec->list_separator == NULL)
+        spec->list_separator = bfromcstr(spec->emitter->list_separator);
+    return spec;
+}
+
+///
+/// @brief Frees an .emit specification.
+///
+/// @param spec The specification.
+///
+void hive_emit_free(struct hive_emit_spec* spec)
+{
+    if (spec == NULL)
+        return;
+    bdestroy(spec->separator);
+    bdestroy(spec->list_separator);
+    free(spec);
+}
+
+///
+/// @brief Initializes the cache of .emit specifications.
+///
+/// @param app The application.
+///
+void hive_emit_init(app_t* app)
+{
+    list_init(&app->emitters.entries);
+}
+
+///
+/// @internal
+/// @brief Parses the content of an .emit file, for the cache.
+///
+void* hive_emit_parse_file(bstring source, const char* name)
+{
+    return hive_emit_parse(source, name);
+}
+
+///
+/// @internal
+/// @brief Frees a specification, for the cache.
+///
+void hive_emit_release(void* spec)
+{
+    hive_emit_free(spec);
+}
+
+///
+/// @brief Returns the specification in an .emit file, reading it if it is new or has changed.
+///
+/// @param app The application.
+/// @param path The path of the .emit file.
+/// @return The specification (owned by the cache), or NULL if it is missing or invalid.
+///
+struct hive_emit_spec* hive_emit_load(app_t* app, bstring path)
+{
+    return hive_cache_load_file(&app->emitters.entries, path, "emitter", hive_emit_parse_file, hive_emit_release);
+}
+
+///
+/// @brief Writes an object in the format named by an .emit file and saves the result.
+///
+/// @param app The application.
+/// @param spec_path The path of the .emit file.
+/// @param object The parsed source.
+/// @param output_path The path to save the result to.
+/// @param stats The statistics to record the latency of each stage in, or NULL.
+///
+void hive_emit_transform_with_path_to_file(app_t* app, bstring spec_path, struct object* object, bstring output_path, struct hive_stats_output* stats)
+{
+    uint64_t start = hive_stats_now();
+    hive_trace_begin("hive_emit_load", (const char*)spec_path->data);
+    struct hive_emit_spec* spec = hive_emit_load(app, spec_path);
+    hive_trace_end("hive_emit_load");
+    hive_stats_record(stats, HIVE_STAGE_COMPILE, hive_stats_now() - start);
+    if (spec == NULL)
+        return;
+    start = hive_stats_now();
+    hive_trace_begin("hive_emit", spec->emitter->name);
+    bstring result = hive_output_buffer();
+    spec->emitter->emit(spec, object, result);
+    hive_trace_end("hive_emit");
+    hive_stats_record(stats, HIVE_STAGE_APPLY, hive_stats_now() - start);
+    start = hive_stats_now();
+    hive_trace_begin("hive_output_write", (const char*)output_path->data);
+    hive_output_write(app, output_path, result);
+    hive_trace_end("hive_output_write");
+    hive_stats_record(stats, HIVE_STAGE_WRITE, hive_stats_now() - start);
+}
@@ -0,0 +1,39 @@
+#ifndef __HIVE_EMIT_H
+#define __HIVE_EMIT_H
+
+#include <bstrlib.h>
+#include "hive_app.h"
+#include "hive_object.h"
+
+struct hive_stats_output;
+struct hive_emit_spec;
+
+///
+/// @brief A built-in output format.
+///
+struct hive_emitter
+{
+    const char* name; ///< The name used in .emit files.
+    void (*emit)(const struct hive_emit_spec* spec, struct object* object, bstring output); ///< Appends the object in this format.
+    const char* separator; ///< The default text between a key and it's value.
+    const char* list_separator; ///< The default text between the items of a list.
+};
+
+///
+/// @brief The contents of an .emit file: which format an output uses, and how.
+///
+struct hive_emit_spec
+{
+    const struct hive_emitter* emitter; ///< The format.
+    bstring separator; ///< The text between a key and it's value.
+    bstring list_separator; ///< The text between the items of a list.
+};
+
+const struct hive_emitter* hive_emit_find(const char* name);
+struct hive_emit_spec* hive_emit_parse(bstring source, const char* name);
+void hive_emit_free(struct hive_emit_spec* spec);
+void hive_emit_init(app_t* app);
+struct hive_emit_spec* hive_emit_load(app_t* app, bstring path);
+void hive_emit_transform_with_path_to_file(app_t* app, bstring spec_path, struct object* object, bstring output_path, struct hive_stats_output* stats);
+
+#endif
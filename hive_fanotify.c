@@ -0,0 +1,388 @@
+///
+/// @file
+/// @brief Monitors configuration sources with a single fanotify filesystem mark.
+///
+/// inotify needs a watch for every directory in the source tree, which costs
+/// kernel memory per directory, runs into fs.inotify.max_user_watches on
+/// large trees, and misses files that are created in a new directory before
+/// it's watch has been added.  fanotify can instead mark the whole
+/// filesystem that the source directory lives on with one call, and with
+/// FAN_REPORT_DFID_NAME every event identifies the directory (by file handle)
+/// and the name of the file it happened to.  Events from outside the source
+/// directory are discarded after the directory handle has been resolved.
+///
+/// This requires CAP_SYS_ADMIN (and CAP_DAC_READ_SEARCH to resolve handles)
+/// and Linux 5.9 or later; when it is unavailable configd falls back to
+/// inotify.
+///
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/fanotify.h>
+#include <sys/select.h>
+#include <sys/stat.h>
+#include "hive_fanotify.h"
+#include "hive_cache.h"
+#include "hive_ignore.h"
+#include "hive_resync.h"
+#include "hive_stats.h"
+#include "hive_trace.h"
+
+#define HIVE_FANOTIFY_BUF_LEN ( 64 * 1024 ) ///< The size of the event buffer.
+#define HIVE_FANOTIFY_REJECTED_MAX 1024 ///< The number of slots for directory handles outside the source directory.
+#define HIVE_FANOTIFY_MASK ( FAN_CREATE | FAN_DELETE | FAN_MOVED_FROM | FAN_MOVED_TO | FAN_CLOSE_WRITE | FAN_ONDIR )
+
+///
+/// @brief Initializes fanotify.
+///
+/// @param app The application.
+/// @return Whether fanotify is available; if not, inotify should be used instead.
+///
+bool hive_fanotify_init(app_t* app)
+{
+    app->fanotify.mount = -1;
+    app->fanotify.root = NULL;
+    app->fanotify.handle = NULL;
+    app->fanotify.directory = NULL;
+    app->fanotify.rejected = NULL;
+    app->fanotify.rejected_count = 0;
+    app->fanotify.events = NULL;
+    app->fanotify.events_size = 0;
+    app->fanotify.fd = fanotify_init(FAN_CLASS_NOTIF | FAN_REPORT_DFID_NAME | FAN_NONBLOCK | FAN_CLOEXEC, O_RDONLY);
+    return app->fanotify.fd >= 0;
+}
+
+///
+/// @brief Starts watching the filesystem that a directory is on.
+///
+/// Only a single root is supported, since events are translated back into
+/// paths beneath it.
+///
+/// @param app The application.
+/// @param path The path of the directory.
+/// @return Whether the filesystem could be marked.
+///
+bool hive_fanotify_add_root(app_t* app, bstring path)
+{
+    char real[PATH_MAX];
+    if (app->fanotify.root != NULL || realpath((const char*)path->data, real) == NULL)
+        return false;
+    app->fanotify.mount = open((const char*)path->data, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (app->fanotify.mount < 0 ||
+        fanotify_mark(app->fanotify.fd, FAN_MARK_ADD | FAN_MARK_FILESYSTEM, HIVE_FANOTIFY_MASK, AT_FDCWD, real) != 0)
+        return false;
+    app->fanotify.root = bfromcstr(real);
+    printf("--> %s (fanotify)\n", real);
+    return true;
+}
+
+///
+/// @internal
+/// @brief Forgets every directory handle that was found to be outside the source directory.
+///
+/// A directory that is renamed may move into the source directory, so this
+/// is done whenever a directory is moved.
+///
+void hive_fanotify_forget_rejected(app_t* app)
+{
+    if (app->fanotify.rejected == NULL)
+        return;
+    for (size_t i = 0; i < HIVE_FANOTIFY_REJECTED_MAX; i++)
+        bdestroy(app->fanotify.rejected[i]);
+    memset(app->fanotify.rejected, 0, HIVE_FANOTIFY_REJECTED_MAX * sizeof(bstring));
+    app->fanotify.rejected_count = 0;
+}
+
+///
+/// @internal
+/// @brief Finds the slot of a directory handle in the table of rejected handles.
+///
+/// @return The slot that holds the handle, or the empty slot where it belongs.
+///
+size_t hive_fanotify_rejected_slot(app_t* app, struct file_handle* handle, size_t length)
+{
+    size_t slot = hive_cache_hash(handle, length) & (HIVE_FANOTIFY_REJECTED_MAX - 1);
+    while (app->fanotify.rejected[slot] != NULL &&
+           ((size_t)blength(app->fanotify.rejected[slot]) != length ||
+            memcmp(app->fanotify.rejected[slot]->data, handle, length) != 0))
+        slot = (slot + 1) & (HIVE_FANOTIFY_REJECTED_MAX - 1);
+    return slot;
+}
+
+///
+/// @internal
+/// @brief Remembers that a directory handle is outside the source directory.
+///
+/// The table is only a cache, so it is emptied rather than grown once it is
+/// half full.
+///
+void hive_fanotify_reject(app_t* app, struct file_handle* handle, size_t length)
+{
+    if (app->fanotify.rejected == NULL)
+        app->fanotify.rejected = calloc(HIVE_FANOTIFY_REJECTED_MAX, sizeof(bstring));
+    else if (app->fanotify.rejected_count >= HIVE_FANOTIFY_REJECTED_MAX / 2)
+        hive_fanotify_forget_rejected(app);
+    size_t slot = hive_fanotify_rejected_slot(app, handle, length);
+    if (app->fanotify.rejected[slot] != NULL)
+        return;
+    app->fanotify.rejected[slot] = blk2bstr(handle, length);
+    app->fanotify.rejected_count++;
+}
+
+///
+/// @brief Stops watching and releases fanotify.
+///
+/// @param app The application.
+///
+void hive_fanotify_close(app_t* app)
+{
+    if (app->fanotify.mount >= 0)
+        close(app->fanotify.mount);
+    if (app->fanotify.fd >= 0)
+        close(app->fanotify.fd);
+    app->fanotify.fd = -1;
+    app->fanotify.mount = -1;
+    bdestroy(app->fanotify.root);
+    bdestroy(app->fanotify.handle);
+    bdestroy(app->fanotify.directory);
+    hive_fanotify_forget_rejected(app);
+    free(app->fanotify.rejected);
+    free(app->fanotify.events);
+    app->fanotify.root = NULL;
+    app->fanotify.handle = NULL;
+    app->fanotify.directory = NULL;
+    app->fanotify.rejected = NULL;
+    app->fanotify.events = NULL;
+    app->fanotify.events_size = 0;
+}
+
+///
+/// @internal
+/// @brief Resolves the directory handle of an event to a path in the source directory.
+///
+/// The last resolved handle is remembered, since bursts of events tend to
+/// be in the same directory, and so are handles that are outside the source
+/// directory, since the mark covers the whole filesystem.
+///
+/// @return The source path of the directory (owned by app->fanotify), or NULL
+///         if it can not be resolved or is outside the source directory.
+///
+bstring hive_fanotify_resolve(app_t* app, struct file_handle* handle)
+{
+    size_t length = sizeof(struct file_handle) + handle->handle_bytes;
+    if (app->fanotify.handle != NULL && (size_t)blength(app->fanotify.handle) == length &&
+        memcmp(app->fanotify.handle->data, handle, length) == 0)
+        return app->fanotify.directory;
+    if (app->fanotify.rejected != NULL &&
+        app->fanotify.rejected[hive_fanotify_rejected_slot(app, handle, length)] != NULL)
+        return NULL;
+
+    // Resolve the handle through /proc, since there is no direct way to get a path.
+    char link[64];
+    char real[PATH_MAX];
+    int dir = open_by_handle_at(app->fanotify.mount, handle, O_PATH);
+    if (dir < 0)
+    {
+        // The directory is gone (handles are never reused), or we may not resolve it.
+        hive_fanotify_reject(app, handle, length);
+        return NULL;
+    }
+    snprintf(link, sizeof(link), "/proc/self/fd/%d", dir);
+    ssize_t result = readlink(link, real, sizeof(real) - 1);
+    close(dir);
+    if (result < 0)
+        return NULL;
+    real[result] = '\0';
+
+    // Translate it into the source directory, so that paths match those from inotify.
+    int root = blength(app->fanotify.root);
+    if (strncmp(real, (const char*)app->fanotify.root->data, root) != 0 ||
+        (real[root] != '\0' && real[root] != '/'))
+    {
+        hive_fanotify_reject(app, handle, length);
+        return NULL;
+    }
+    bdestroy(app->fanotify.handle);
+    bdestroy(app->fanotify.directory);
+    app->fanotify.handle = blk2bstr(handle, length);
+    app->fanotify.directory = bstrcpy(app->source.path);
+    bcatcstr(app->fanotify.directory, real + root);
+    return app->fanotify.directory;
+}
+
+///
+/// @brief Converts a buffer of raw fanotify events into changes.
+///
+/// @param app The application.
+/// @param buffer The events, exactly as they were read from the fanotify descriptor.
+/// @param length The length of the buffer.
+/// @param batch The batch to add changes to.
+///
+void hive_fanotify_parse(app_t* app, const char* buffer, size_t length, struct hive_watch_batch* batch)
+{
+    const struct fanotify_event_metadata* event = (const struct fanotify_event_metadata*)buffer;
+    ssize_t remaining = length;
+    for (; FAN_EVENT_OK(event, remaining); event = FAN_EVENT_NEXT(event, remaining))
+    {
+        // If the kernel queue overflowed, fall back to comparing the whole tree.
+        if (event->mask & FAN_Q_OVERFLOW)
+        {
+            hive_watch_batch_add(batch, HIVE_WATCH_OVERFLOW, NULL);
+            continue;
+        }
+
+        // Find the directory and name record.
+        const struct fanotify_event_info_fid* fid = (const struct fanotify_event_info_fid*)(event + 1);
+        if (event->event_len < event->metadata_len + sizeof(struct fanotify_event_info_fid) ||
+            fid->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME)
+            continue;
+        struct file_handle* handle = (struct file_handle*)fid->handle;
+        const char* name = (const char*)(handle->f_handle + handle->handle_bytes);
+        bool is_directory = (event->mask & FAN_ONDIR) != 0;
+
+        // A renamed or deleted directory invalidates the resolved handles,
+        // since paths beneath it have changed, and it may have been moved
+        // into the source directory from elsewhere.
+        if (is_directory && (event->mask & (FAN_DELETE | FAN_MOVED_FROM | FAN_MOVED_TO)))
+        {
+            bdestroy(app->fanotify.handle);
+            app->fanotify.handle = NULL;
+            hive_fanotify_forget_rejected(app);
+        }
+        bstring directory = hive_fanotify_resolve(app, handle);
+        if (directory == NULL)
+            continue;
+        size_t relative_length;
+        const char* relative = hive_ignore_relative(app, directory, &relative_length);
+        if (!is_directory && hive_ignore_is_rules_file(app, relative, relative_length, name) && hive_ignore_load(app))
+            hive_watch_batch_add(batch, HIVE_WATCH_RESCAN, NULL);
+        if (hive_ignore_match(app, relative, relative_length, name, is_directory))
+            continue;
+        bstring joined = bstrcpy(directory);
+        bconchar(joined, '/');
+        bcatcstr(joined, name);
+        hive_trace_instant("fanotify event", name);
+
+        // There is no event for anything that was already inside a directory
+        // when it was moved (or extracted) into place, so it's files are
+        // found by walking it; a directory that was moved away takes every
+        // file beneath it with it.
+        if (is_directory)
+        {
+            if (event->mask & (FAN_CREATE | FAN_MOVED_TO))
+                hive_resync_discover_tree(app, joined, batch);
+            else if (event->mask & FAN_MOVED_FROM)
+                hive_resync_forget_tree(app, joined, batch);
+            bdestroy(joined);
+            continue;
+        }
+
+        // Events for the same file may have been merged, so whether it still
+        // exists decides between deleted and updated.
+        struct stat st;
+        bool exists = stat((const char*)joined->data, &st) == 0;
+        if ((event->mask & (FAN_DELETE | FAN_MOVED_FROM)) && !exists)
+            hive_watch_batch_add(batch, HIVE_WATCH_DELETED, joined);
+        else if ((event->mask & (FAN_CREATE | FAN_MOVED_TO | FAN_CLOSE_WRITE)) && exists)
+            hive_watch_batch_add(batch, HIVE_WATCH_UPDATED, joined);
+        bdestroy(joined);
+    }
+}
+
+///
+/// @brief Adds every pending fanotify event to a batch, without blocking.
+///
+/// As with inotify, all pending events are drained on each wake-up.
+///
+/// @param app The application.
+/// @param batch The batch to add changes to.
+///
+void hive_fanotify_next_batch(app_t* app, struct hive_watch_batch* batch)
+{
+    struct timeval timeout;
+    timeout.tv_sec = 0;
+    timeout.tv_usec = 0;
+
+    fd_set iwatch;
+    FD_ZERO(&iwatch);
+    FD_SET(app->fanotify.fd, &iwatch);
+    int retval = select(app->fanotify.fd + 1, &iwatch, NULL, NULL, &timeout);
+    if (retval == -1)
+    {
+        if (errno != EINTR)
+            fprintf(stderr, "error while using select()\n");
+        return;
+    }
+    if (!FD_ISSET(app->fanotify.fd, &iwatch))
+        return;
+
+    if (app->fanotify.events == NULL)
+    {
+        app->fanotify.events = malloc(HIVE_FANOTIFY_BUF_LEN);
+        if (app->fanotify.events == NULL)
+            return;
+        app->fanotify.events_size = HIVE_FANOTIFY_BUF_LEN;
+    }
+    hive_trace_begin("hive_fanotify_next_batch", NULL);
+    uint64_t events = 0;
+    uint64_t reads = 0;
+    while (true)
+    {
+        ssize_t length = read(app->fanotify.fd, app->fanotify.events, app->fanotify.events_size);
+        if (length > 0)
+        {
+            const struct fanotify_event_metadata* event = (const struct fanotify_event_metadata*)app->fanotify.events;
+            ssize_t remaining = length;
+            for (; FAN_EVENT_OK(event, remaining); event = FAN_EVENT_NEXT(event, remaining))
+                events++;
+            reads++;
+            hive_fanotify_parse(app, app->fanotify.events, length, batch);
+        }
+        else if (length < 0 && errno == EINTR)
+            continue;
+        else
+        {
+            if (length < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+                fprintf(stderr, "error while reading fanotify events\n");
+            break;
+        }
+    }
+    if (app->enable_stats && events > 0)
+    {
+        hive_histogram_record(app->stats.wakeup_events, events);
+        hive_histogram_record(app->stats.wakeup_reads, reads);
+    }
+    hive_trace_end("hive_fanotify_next_batch");
+}
+
+///
+/// @brief Returns the fanotify descriptor, which is readable while events are pending.
+///
+/// @param app The application.
+/// @param deadline Left as it is; fanotify reports every change as it happens.
+/// @return The descriptor.
+///
+int hive_fanotify_wakeup(app_t* app, uint64_t* deadline)
+{
+    return app->fanotify.fd;
+}
+
+///
+/// @brief Watches the whole filesystem of the source directory with a single fanotify mark.
+///
+const struct hive_watch_backend hive_fanotify_backend =
+{
+    "fanotify",
+    hive_fanotify_init,
+    hive_fanotify_add_root,
+    hive_fanotify_next_batch,
+    NULL,
+    hive_fanotify_wakeup,
+    hive_fanotify_close,
+};
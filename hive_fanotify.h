@@ -0,0 +1,17 @@
+#ifndef __HIVE_FANOTIFY_H
+#define __HIVE_FANOTIFY_H
+
+#include <stdbool.h>
+#include <bstrlib.h>
+#include "hive_app.h"
+#include "hive_watch.h"
+
+extern const struct hive_watch_backend hive_fanotify_backend;
+
+bool hive_fanotify_init(app_t* app);
+bool hive_fanotify_add_root(app_t* app, bstring path);
+void hive_fanotify_next_batch(app_t* app, struct hive_watch_batch* batch);
+void hive_fanotify_close(app_t* app);
+void hive_fanotify_parse(app_t* app, const char* buffer, size_t length, struct hive_watch_batch* batch);
+
+#endif
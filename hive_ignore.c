@@ -0,0 +1,374 @@
+///
+/// @file
+/// @brief Decides which source files are ignored before anything is allocated for them.
+///
+/// Editors and other tools create swap, backup and temporary files next to
+/// the files being edited (.swp, ~, 4913, .tmp and so on).  None of these can
+/// be sources, so they are dropped as soon as their name is known rather than
+/// being turned into changes.
+///
+/// The rules are a built-in set followed by the lines of .configdignore in the
+/// source directory, written like .gitignore: blank lines and lines starting
+/// with '#' are skipped, a leading '!' includes what an earlier rule ignored,
+/// a trailing '/' only matches directories, and a rule containing a '/' is
+/// matched against the path relative to the source directory instead of the
+/// name.  The last matching rule wins, and nothing beneath an ignored
+/// directory can be included again.  Rules that are a single literal with at
+/// most a leading or trailing '*' are compared directly; the rest use
+/// fnmatch.
+///
+
+#include <fnmatch.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hive_ignore.h"
+#include "hive_cache.h"
+
+///
+/// @brief The rules that are in effect before .configdignore is read.
+///
+static const char* hive_ignore_defaults[] =
+{
+    ".*",
+    "*~",
+    "#*#",
+    "*.swp",
+    "*.swx",
+    "*.tmp",
+    "4913",
+};
+
+///
+/// @internal
+/// @brief Compiles a single rule and appends it to the rule set.
+///
+/// @param app The application.
+/// @param pattern The rule, as written in .configdignore.
+///
+void hive_ignore_add(app_t* app, const char* pattern)
+{
+    struct hive_ignore_rule rule;
+    memset(&rule, 0, sizeof(rule));
+    rule.pattern = bfromcstr(pattern);
+    if (*pattern == '!')
+    {
+        rule.negate = true;
+        pattern++;
+    }
+    bstring literal = bfromcstr(pattern);
+    if (blength(literal) > 1 && literal->data[blength(literal) - 1] == '/')
+    {
+        rule.directory = true;
+        btrunc(literal, blength(literal) - 1);
+    }
+    // "**/name" matches in any directory, which is what "name" already does.
+    while (blength(literal) > 3 && strncmp((const char*)literal->data, "**/", 3) == 0)
+        bdelete(literal, 0, 3);
+    if (blength(literal) > 1 && literal->data[0] == '/')
+    {
+        rule.anchored = true;
+        bdelete(literal, 0, 1);
+    }
+    if (bstrchr(literal, '/') != BSTR_ERR)
+        rule.anchored = true;
+    if (blength(literal) == 0)
+    {
+        bdestroy(rule.pattern);
+        bdestroy(literal);
+        return;
+    }
+
+    // Work out whether the rule can be compared without fnmatch.
+    const char* data = (const char*)literal->data;
+    int length = blength(literal);
+    int stars = 0;
+    bool special = false;
+    for (int i = 0; i < length; i++)
+    {
+        if (data[i] == '*')
+            stars++;
+        else if (data[i] == '?' || data[i] == '[' || data[i] == '\\')
+            special = true;
+    }
+    if (rule.anchored || special || stars > 1)
+        rule.kind = HIVE_IGNORE_GLOB;
+    else if (stars == 0)
+        rule.kind = HIVE_IGNORE_EXACT;
+    else if (data[0] == '*')
+    {
+        rule.kind = HIVE_IGNORE_SUFFIX;
+        bdelete(literal, 0, 1);
+    }
+    else if (data[length - 1] == '*')
+    {
+        rule.kind = HIVE_IGNORE_PREFIX;
+        btrunc(literal, length - 1);
+    }
+    else
+        rule.kind = HIVE_IGNORE_GLOB;
+    rule.literal = literal;
+
+    if (app->ignore.count == app->ignore.capacity)
+    {
+        app->ignore.capacity = app->ignore.capacity == 0 ? 16 : app->ignore.capacity * 2;
+        app->ignore.rules = realloc(app->ignore.rules, app->ignore.capacity * sizeof(struct hive_ignore_rule));
+    }
+    app->ignore.rules[app->ignore.count++] = rule;
+}
+
+///
+/// @internal
+/// @brief Frees every rule.
+///
+void hive_ignore_clear(app_t* app)
+{
+    for (size_t i = 0; i < app->ignore.count; i++)
+    {
+        bdestroy(app->ignore.rules[i].pattern);
+        bdestroy(app->ignore.rules[i].literal);
+    }
+    app->ignore.count = 0;
+}
+
+///
+/// @brief Initializes the ignore rules.
+///
+/// @param app The application.
+///
+void hive_ignore_init(app_t* app)
+{
+    app->ignore.rules = NULL;
+    app->ignore.count = 0;
+    app->ignore.capacity = 0;
+    app->ignore.filtered = 0;
+    app->ignore.digest = 0;
+    hive_ignore_load(app);
+}
+
+///
+/// @brief (Re)loads the built-in rules and the rules in .configdignore.
+///
+/// The rules are only rebuilt if the content of .configdignore changed since
+/// they were last loaded, so that this can be called whenever the file may
+/// have changed without losing the number of hits per rule.
+///
+/// @param app The application.
+/// @return Whether the rules changed.
+///
+bool hive_ignore_load(app_t* app)
+{
+    bstring path = bformat("%s/%s", (const char*)app->source.path->data, HIVE_IGNORE_FILE);
+    FILE* file = fopen((const char*)path->data, "r");
+    bdestroy(path);
+    bstring content = NULL;
+    if (file != NULL)
+    {
+        content = bread((bNread)fread, file);
+        fclose(file);
+    }
+    if (content == NULL)
+        content = bfromcstr("");
+    uint64_t digest = hive_cache_hash(content->data, blength(content));
+    if (app->ignore.count > 0 && app->ignore.digest == digest)
+    {
+        bdestroy(content);
+        return false;
+    }
+    app->ignore.digest = digest;
+
+    hive_ignore_clear(app);
+    for (size_t i = 0; i < sizeof(hive_ignore_defaults) / sizeof(hive_ignore_defaults[0]); i++)
+        hive_ignore_add(app, hive_ignore_defaults[i]);
+    struct bstrList* lines = bsplit(content, '\n');
+    for (int i = 0; lines != NULL && i < lines->qty; i++)
+    {
+        bstring line = lines->entry[i];
+        int length = blength(line);
+        while (length > 0 && (line->data[length - 1] == '\r' ||
+               (line->data[length - 1] == ' ' && (length < 2 || line->data[length - 2] != '\\'))))
+            length--;
+        btrunc(line, length);
+        if (length == 0 || line->data[0] == '#')
+            continue;
+        hive_ignore_add(app, (const char*)line->data);
+    }
+    bstrListDestroy(lines);
+    bdestroy(content);
+    return true;
+}
+
+///
+/// @internal
+/// @brief Returns whether a rule matches a single path component.
+///
+/// @param rule The rule.
+/// @param relative The path relative to the source directory, ending with the component.
+/// @param name The component.
+/// @param length The length of the component.
+/// @param is_directory Whether the component is a directory.
+///
+bool hive_ignore_rule_match(const struct hive_ignore_rule* rule, const char* relative, const char* name, size_t length, bool is_directory)
+{
+    if (rule->directory && !is_directory)
+        return false;
+    const char* literal = (const char*)rule->literal->data;
+    size_t literal_length = blength(rule->literal);
+    switch (rule->kind)
+    {
+        case HIVE_IGNORE_EXACT:
+            return length == literal_length && memcmp(name, literal, length) == 0;
+        case HIVE_IGNORE_PREFIX:
+            return length >= literal_length && memcmp(name, literal, literal_length) == 0;
+        case HIVE_IGNORE_SUFFIX:
+            return length >= literal_length && memcmp(name + length - literal_length, literal, literal_length) == 0;
+        default:
+            if (!rule->anchored)
+                return fnmatch(literal, name, 0) == 0;
+            // "**" may match any number of directories.
+            return fnmatch(literal, relative, strstr(literal, "**") != NULL ? 0 : FNM_PATHNAME) == 0;
+    }
+}
+
+///
+/// @internal
+/// @brief Applies the rules to a single path component.
+///
+/// @return Whether the last rule that matches ignores it.
+///
+bool hive_ignore_decide(app_t* app, const char* relative, const char* name, size_t length, bool is_directory)
+{
+    for (size_t i = app->ignore.count; i > 0; i--)
+    {
+        struct hive_ignore_rule* rule = &app->ignore.rules[i - 1];
+        if (hive_ignore_rule_match(rule, relative, name, length, is_directory))
+        {
+            rule->hits++;
+            return !rule->negate;
+        }
+    }
+    return false;
+}
+
+///
+/// @brief Returns whether a file or directory is ignored.
+///
+/// Nothing is allocated, so this can be used on raw event names.
+///
+/// @param app The application.
+/// @param directory The directory that contains it, relative to the source directory (without a leading '/').
+/// @param directory_length The length of the directory; 0 for the source directory itself.
+/// @param name The name of the file or directory.
+/// @param is_directory Whether it is a directory.
+/// @return Whether it should be ignored.
+///
+bool hive_ignore_match(app_t* app, const char* directory, size_t directory_length, const char* name, bool is_directory)
+{
+    if (app->ignore.count == 0)
+        return false;
+    char relative[PATH_MAX];
+    size_t name_length = strlen(name);
+    if (directory_length + name_length + 2 > sizeof(relative))
+        return false;
+    size_t length = directory_length;
+    memcpy(relative, directory, directory_length);
+    if (length > 0)
+        relative[length++] = '/';
+    memcpy(relative + length, name, name_length + 1);
+
+    // Check every directory above it first.
+    size_t start = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        if (relative[i] != '/')
+            continue;
+        if (i > start)
+        {
+            relative[i] = '\0';
+            bool ignored = hive_ignore_decide(app, relative, relative + start, i - start, true);
+            relative[i] = '/';
+            if (ignored)
+            {
+                app->ignore.filtered++;
+                return true;
+            }
+        }
+        start = i + 1;
+    }
+    if (!hive_ignore_decide(app, relative, relative + length, name_length, is_directory))
+        return false;
+    app->ignore.filtered++;
+    return true;
+}
+
+///
+/// @brief Returns the part of a path beneath the source directory.
+///
+/// @param app The application.
+/// @param path A path that starts with the source directory.
+/// @param length Receives the length of the relative path.
+/// @return The relative path (without a leading '/'), which points into the given path.
+///
+const char* hive_ignore_relative(app_t* app, bstring path, size_t* length)
+{
+    size_t root = blength(app->source.path);
+    if ((size_t)blength(path) <= root)
+    {
+        *length = 0;
+        return "";
+    }
+    *length = blength(path) - root - 1;
+    return (const char*)path->data + root + 1;
+}
+
+///
+/// @brief Returns whether a file or directory is ignored, given it's full path.
+///
+/// @param app The application.
+/// @param path The path, which starts with the source directory.
+/// @param is_directory Whether it is a directory.
+/// @return Whether it should be ignored.
+///
+bool hive_ignore_path(app_t* app, bstring path, bool is_directory)
+{
+    size_t length;
+    const char* relative = hive_ignore_relative(app, path, &length);
+    size_t slash = length;
+    while (slash > 0 && relative[slash - 1] != '/')
+        slash--;
+    return hive_ignore_match(app, relative, slash > 0 ? slash - 1 : 0, relative + slash, is_directory);
+}
+
+///
+/// @brief Returns whether a name refers to .configdignore in the source directory.
+///
+/// @param app The application.
+/// @param directory The directory that contains it, relative to the source directory.
+/// @param directory_length The length of the directory.
+/// @param name The name.
+/// @return Whether it is the rules file.
+///
+bool hive_ignore_is_rules_file(app_t* app, const char* directory, size_t directory_length, const char* name)
+{
+    return directory_length == 0 && strcmp(name, HIVE_IGNORE_FILE) == 0;
+}
+
+///
+/// @brief Writes the number of ignored files and directories, per rule.
+///
+/// @param app The application.
+/// @param file The file to write to.
+///
+void hive_ignore_dump(app_t* app, FILE* file)
+{
+    if (app->ignore.filtered == 0)
+        return;
+    fprintf(file, "(ignored) %llu\n", (unsigned long long)app->ignore.filtered);
+    for (size_t i = 0; i < app->ignore.count; i++)
+    {
+        struct hive_ignore_rule* rule = &app->ignore.rules[i];
+        if (rule->hits > 0)
+            fprintf(file, "%-19s %10llu\n", (const char*)rule->pattern->data, (unsigned long long)rule->hits);
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef __HIVE_IGNORE_H
+#define __HIVE_IGNORE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <bstrlib.h>
+#include "hive_app.h"
+
+#define HIVE_IGNORE_FILE ".configdignore" ///< The name of the rules file in the source directory.
+
+#define HIVE_IGNORE_EXACT 0 ///< The name must equal the literal.
+#define HIVE_IGNORE_PREFIX 1 ///< The name must start with the literal ("literal*").
+#define HIVE_IGNORE_SUFFIX 2 ///< The name must end with the literal ("*literal").
+#define HIVE_IGNORE_GLOB 3 ///< Anything else, matched with fnmatch.
+
+///
+/// @brief A single compiled ignore (or, when negated, include) rule.
+///
+struct hive_ignore_rule
+{
+    bstring pattern; ///< The rule as it was written.
+    int kind; ///< How the rule is matched, one of the HIVE_IGNORE_* constants.
+    bstring literal; ///< The literal (or glob, for HIVE_IGNORE_GLOB) to match.
+    bool negate; ///< Whether the rule was written with a leading '!', so that matches are included.
+    bool anchored; ///< Whether the rule contains a '/', so that it matches the path relative to the source directory.
+    bool directory; ///< Whether the rule was written with a trailing '/', so that it only matches directories.
+    uint64_t hits; ///< The number of times this rule decided the outcome.
+};
+
+void hive_ignore_init(app_t* app);
+bool hive_ignore_load(app_t* app);
+bool hive_ignore_match(app_t* app, const char* directory, size_t directory_length, const char* name, bool is_directory);
+const char* hive_ignore_relative(app_t* app, bstring path, size_t* length);
+bool hive_ignore_path(app_t* app, bstring path, bool is_directory);
+bool hive_ignore_is_rules_file(app_t* app, const char* directory, size_t directory_length, const char* name);
+void hive_ignore_dump(app_t* app, FILE* file);
+
+#endif
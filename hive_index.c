@@ -0,0 +1,216 @@
+///
+/// @file
+/// @brief Indexes an object tree so that children can be found by key without a scan.
+///
+/// Maps and lists are lists of entries, so finding a key means walking
+/// them.  The index holds every child of every map and list in a single
+/// hash table keyed by the parent and the key (or the position, for
+/// lists), so that a path like "nss_map_attribute/uniqueMember" or
+/// "nss_initgroups_ignoreusers/0" resolves with one lookup per step.
+///
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hive_index.h"
+#include "hive_cache.h"
+
+///
+/// @internal
+/// @brief Hashes a key within a parent.
+///
+uint64_t hive_index_hash(struct object* parent, const char* key, size_t length)
+{
+    return hive_cache_hash(key, length) ^ ((uint64_t)(uintptr_t)parent * 0x9e3779b97f4a7c15ULL);
+}
+
+///
+/// @brief Returns the text of a map key, formatting numbers into a buffer.
+///
+/// @param key The key, or NULL.
+/// @param buffer The buffer a number is formatted into.
+/// @param size The size of the buffer.
+/// @param length Set to the length of the text.
+/// @return The text (the buffer, for numbers), or "" for other keys.
+///
+const char* hive_index_key(struct object* key, char* buffer, size_t size, size_t* length)
+{
+    if (key != NULL && key->type == OBJECT_TYPE_STRING)
+    {
+        *length = blength(key->string);
+        return (const char*)key->string->data;
+    }
+    if (key != NULL && key->type == OBJECT_TYPE_NUMBER)
+    {
+        *length = snprintf(buffer, size, "%ld", key->number);
+        return buffer;
+    }
+    *length = 0;
+    return "";
+}
+
+///
+/// @internal
+/// @brief Adds a child to the index, unless an earlier child has the same key.
+///
+void hive_index_insert(struct hive_index* index, struct object* parent, struct object* key, size_t position, struct object* value)
+{
+    char buffer[32];
+    size_t length;
+    const char* text = key != NULL ? hive_index_key(key, buffer, sizeof(buffer), &length) : buffer;
+    if (key == NULL)
+        length = snprintf(buffer, sizeof(buffer), "%zu", position);
+    uint64_t hash = hive_index_hash(parent, text, length);
+
+    if ((index->count + 1) * 4 > index->capacity * 3)
+    {
+        struct hive_index_entry* entries = index->entries;
+        size_t capacity = index->capacity;
+        index->capacity *= 2;
+        index->entries = calloc(index->capacity, sizeof(struct hive_index_entry));
+        for (size_t i = 0; i < capacity; i++)
+        {
+            if (entries[i].parent == NULL)
+                continue;
+            size_t slot = entries[i].hash & (index->capacity - 1);
+            while (index->entries[slot].parent != NULL)
+                slot = (slot + 1) & (index->capacity - 1);
+            index->entries[slot] = entries[i];
+        }
+        free(entries);
+    }
+
+    if (key != NULL && hive_index_child(index, parent, text, length) != NULL)
+        return;
+    size_t slot = hash & (index->capacity - 1);
+    while (index->entries[slot].parent != NULL)
+        slot = (slot + 1) & (index->capacity - 1);
+    index->entries[slot].hash = hash;
+    index->entries[slot].parent = parent;
+    index->entries[slot].key = key;
+    index->entries[slot].position = position;
+    index->entries[slot].value = value;
+    index->count++;
+}
+
+///
+/// @internal
+/// @brief Adds the children of an object, and their children, to the index.
+///
+void hive_index_add(struct hive_index* index, struct object* object)
+{
+    if (object == NULL)
+        return;
+    if (object->type == OBJECT_TYPE_MAP)
+    {
+        HIVE_LIST_FOREACH(&object->map, node)
+        {
+            struct map_entry* entry = node->data;
+            hive_index_insert(index, object, entry->key, 0, entry->value);
+            hive_index_add(index, entry->value);
+        }
+    }
+    else if (object->type == OBJECT_TYPE_LIST)
+    {
+        size_t position = 0;
+        HIVE_LIST_FOREACH(&object->list, node)
+        {
+            struct object* item = node->data;
+            hive_index_insert(index, object, NULL, position++, item);
+            hive_index_add(index, item);
+        }
+    }
+}
+
+///
+/// @brief Indexes an object tree.
+///
+/// The index refers to the objects in the tree, so it must be freed
+/// before the tree is.
+///
+/// @param root The root of the tree.
+/// @return The index.
+///
+struct hive_index* hive_index_build(struct object* root)
+{
+    struct hive_index* index = malloc(sizeof(struct hive_index));
+    index->capacity = 64;
+    index->count = 0;
+    index->entries = calloc(index->capacity, sizeof(struct hive_index_entry));
+    hive_index_add(index, root);
+    return index;
+}
+
+///
+/// @brief Finds the child of a map with a key, or the item of a list at a position.
+///
+/// @param index The index.
+/// @param parent The map or list.
+/// @param key The key, or the position in decimal.
+/// @param length The length of the key.
+/// @return The child, or NULL if there is none.
+///
+struct object* hive_index_child(struct hive_index* index, struct object* parent, const char* key, size_t length)
+{
+    if (parent == NULL || (parent->type != OBJECT_TYPE_MAP && parent->type != OBJECT_TYPE_LIST))
+        return NULL;
+    uint64_t hash = hive_index_hash(parent, key, length);
+    size_t slot = hash & (index->capacity - 1);
+    while (index->entries[slot].parent != NULL)
+    {
+        struct hive_index_entry* entry = &index->entries[slot];
+        if (entry->hash == hash && entry->parent == parent)
+        {
+            char buffer[32];
+            size_t entry_length;
+            const char* text = entry->key != NULL ? hive_index_key(entry->key, buffer, sizeof(buffer), &entry_length) : buffer;
+            if (entry->key == NULL)
+                entry_length = snprintf(buffer, sizeof(buffer), "%zu", entry->position);
+            if (entry_length == length && memcmp(text, key, length) == 0)
+                return entry->value;
+        }
+        slot = (slot + 1) & (index->capacity - 1);
+    }
+    return NULL;
+}
+
+///
+/// @brief Resolves a '/' separated path of keys and positions from the root of a tree.
+///
+/// Empty steps are skipped, so "" and "/" are the root itself.
+///
+/// @param index The index of the tree.
+/// @param root The root of the tree.
+/// @param path The path.
+/// @param length The length of the path.
+/// @return The object at the path, or NULL if there is none.
+///
+struct object* hive_index_resolve(struct hive_index* index, struct object* root, const char* path, size_t length)
+{
+    struct object* current = root;
+    size_t start = 0;
+    while (current != NULL && start < length)
+    {
+        size_t end = start;
+        while (end < length && path[end] != '/')
+            end++;
+        if (end > start)
+            current = hive_index_child(index, current, path + start, end - start);
+        start = end + 1;
+    }
+    return current;
+}
+
+///
+/// @brief Frees an index (but not the tree it refers to).
+///
+/// @param index The index.
+///
+void hive_index_free(struct hive_index* index)
+{
+    if (index == NULL)
+        return;
+    free(index->entries);
+    free(index);
+}
@@ -0,0 +1,36 @@
+#ifndef __HIVE_INDEX_H
+#define __HIVE_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "hive_object.h"
+
+///
+/// @brief A child of a map or list in the index.
+///
+struct hive_index_entry
+{
+    uint64_t hash; ///< The hash of the parent and key.
+    struct object* parent; ///< The map or list, or NULL if the slot is empty.
+    struct object* key; ///< The key, for children of maps.
+    size_t position; ///< The position, for items of lists.
+    struct object* value; ///< The child.
+};
+
+///
+/// @brief An index of every child in an object tree, by parent and key.
+///
+struct hive_index
+{
+    struct hive_index_entry* entries; ///< The open-addressed slots.
+    size_t count; ///< The number of children.
+    size_t capacity; ///< The number of slots (always a power of two).
+};
+
+const char* hive_index_key(struct object* key, char* buffer, size_t size, size_t* length);
+struct hive_index* hive_index_build(struct object* root);
+struct object* hive_index_child(struct hive_index* index, struct object* parent, const char* key, size_t length);
+struct object* hive_index_resolve(struct hive_index* index, struct object* root, const char* path, size_t length);
+void hive_index_free(struct hive_index* index);
+
+#endif
@@ -9,14 +9,26 @@
 
 #include <unistd.h>
 #include <assert.h>
+#include <errno.h>
+#include <limits.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/inotify.h>
 #include <simclist.h>
 #include <dirent.h>
+#include "hive_ignore.h"
 #include "hive_inotify.h"
+#include "hive_trace.h"
+#include "hive_record.h"
+#include "hive_resync.h"
+#include "hive_watch.h"
+#include "hive_stats.h"
 
 #define EVENT_SIZE  ( sizeof (struct inotify_event) )
-#define EVENT_BUF_LEN ( 1024 * ( EVENT_SIZE + 16 ) )
+#define EVENT_MAX ( EVENT_SIZE + NAME_MAX + 1 ) ///< The largest single event the kernel can return.
+#define EVENT_BUF_LEN ( 64 * 1024 ) ///< The initial size of the reusable event buffer.
+#define EVENT_BUF_MAX ( 4 * 1024 * 1024 ) ///< The buffer is dispatched rather than grown past this size.
 
 ///
 /// @brief A pair structure with the inotify watch descriptor and the actual file path.
@@ -55,97 +67,573 @@ int inotify_watch_seeker(const void* el, const void* key)
     return ((struct inotify_watch*)el)->wd == *(int*)key;
 }
 
+///
+/// @internal
+/// @brief Returns whether a path is a directory or something beneath it.
+///
+bool hive_inotify_is_beneath(bstring path, bstring directory)
+{
+    int length = blength(directory);
+    return blength(path) >= length && bstrncmp(path, directory, length) == 0 &&
+           (blength(path) == length || path->data[length] == '/');
+}
+
+///
+/// @internal
+/// @brief Updates the paths of a watched directory and every watch beneath it after it was renamed.
+///
+void hive_inotify_watch_rename(app_t* app, bstring from, bstring to)
+{
+    bstring old = bstrcpy(from);
+    list_iterator_start(&app->inotify.watches);
+    while (list_iterator_hasnext(&app->inotify.watches))
+    {
+        struct inotify_watch* watch = list_iterator_next(&app->inotify.watches);
+        if (!hive_inotify_is_beneath(watch->path, old))
+            continue;
+        bstring path = bstrcpy(to);
+        bcatblk(path, watch->path->data + blength(old), blength(watch->path) - blength(old));
+        printf("--> %s (was %s)\n", (const char*)path->data, (const char*)watch->path->data);
+        bdestroy(watch->path);
+        watch->path = path;
+        hive_record_watch_added(app, watch->wd, path);
+    }
+    list_iterator_stop(&app->inotify.watches);
+    bdestroy(old);
+}
+
 ///
 /// @brief Adds a new directory to the list of directories to watch.
 ///
+/// If the directory is already watched under another path, it was renamed
+/// without it's watch being removed, so the paths of it's watch and every
+/// watch beneath it are updated.
+///
 /// @param app The application.
 /// @param path The path of the directory to watch.
+/// @return Whether the directory is now watched at this path; false if it
+///         could not be watched, or if it is already watched at a path above
+///         this one (a bind mount loop).
 ///
-void hive_inotify_watch_add(app_t* app, bstring path)
+bool hive_inotify_watch_add(app_t* app, bstring path)
 {
     assert(path != NULL);
     struct inotify_watch watch;
+    if (app->inotify.fd < 0)
+        return false; // Detached for replay; watches come from the recording.
+    watch.wd = inotify_add_watch(app->inotify.fd, (const char*)path->data, IN_CREATE | IN_DELETE | IN_DELETE_SELF | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE);
+    if (watch.wd < 0)
+    {
+        // Most likely fs.inotify.max_user_watches has been reached.
+        fprintf(stderr, "unable to watch %s: %s\n", (const char*)path->data, strerror(errno));
+        return false;
+    }
+    struct inotify_watch* existing = list_seek(&app->inotify.watches, &watch.wd);
+    if (existing != NULL)
+    {
+        // The same directory (inode) is already watched.
+        if (biseq(existing->path, path))
+            return true;
+        if (hive_inotify_is_beneath(path, existing->path))
+            return false;
+        hive_inotify_watch_rename(app, existing->path, path);
+        return true;
+    }
     printf("--> %s\n", (const char*)path->data);
-    watch.wd = inotify_add_watch(app->source.inotify, (const char*)path->data, IN_CREATE | IN_DELETE | IN_DELETE_SELF | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE);
     watch.path = bstrcpy(path);
-    list_append(&app->source.watches, &watch);
+    list_append(&app->inotify.watches, &watch);
+    hive_record_watch_added(app, watch.wd, path);
+    return true;
 }
 
 ///
-/// @brief Removes a directory from the list of directories to watch.
+/// @brief Removes a directory, and every directory beneath it, from the list of directories to watch.
 ///
 /// @param app The application.
 /// @param path The path of the directory to stop watching.
 ///
 void hive_inotify_watch_remove(app_t* app, bstring path)
 {
-    struct inotify_watch* watch = NULL;
-    list_iterator_start(&app->source.watches);
-    while (list_iterator_hasnext(&app->source.watches))
+    // Collect the watches first, since deleting them changes the list.
+    list_t stale;
+    list_init(&stale);
+    list_iterator_start(&app->inotify.watches);
+    while (list_iterator_hasnext(&app->inotify.watches))
     {
-        struct inotify_watch* potential = list_iterator_next(&app->source.watches);
-        if (biseq(path, potential->path))
-        {
-            watch = potential;
-            break;
-        }
+        struct inotify_watch* potential = list_iterator_next(&app->inotify.watches);
+        if (hive_inotify_is_beneath(potential->path, path))
+            list_append(&stale, potential);
     }
-    list_iterator_stop(&app->source.watches);
+    list_iterator_stop(&app->inotify.watches);
+    list_iterator_start(&stale);
+    while (list_iterator_hasnext(&stale))
+    {
+        struct inotify_watch* watch = list_iterator_next(&stale);
+        inotify_rm_watch(app->inotify.fd, watch->wd);
+        printf("<-- %s\n", (const char*)watch->path->data);
+        hive_record_watch_removed(app, watch->wd);
+        bdestroy(watch->path);
+        list_delete(&app->inotify.watches, watch);
+    }
+    list_iterator_stop(&stale);
+    list_destroy(&stale);
+}
+
+///
+/// @brief Returns the directory that a watch descriptor refers to.
+///
+/// @param app The application.
+/// @param wd The watch descriptor.
+/// @return The path of the directory (owned by the watch list), or NULL if it is unknown.
+///
+bstring hive_inotify_watch_path(app_t* app, int wd)
+{
+    struct inotify_watch* watch = list_seek(&app->inotify.watches, &wd);
+    return watch == NULL ? NULL : watch->path;
+}
+
+///
+/// @brief Stops watching the filesystem, so that events only arrive through hive_inotify_dispatch.
+///
+/// This is used when replaying a recording: the watch descriptors are then
+/// defined by the recording with hive_inotify_watch_set.
+///
+/// @param app The application.
+///
+void hive_inotify_detach(app_t* app)
+{
+    close(app->inotify.fd);
+    app->inotify.fd = -1;
+    list_iterator_start(&app->inotify.watches);
+    while (list_iterator_hasnext(&app->inotify.watches))
+        bdestroy(((struct inotify_watch*)list_iterator_next(&app->inotify.watches))->path);
+    list_iterator_stop(&app->inotify.watches);
+    list_clear(&app->inotify.watches);
+}
+
+///
+/// @brief Associates a watch descriptor with a directory without touching the filesystem.
+///
+/// @param app The application.
+/// @param wd The watch descriptor.
+/// @param path The path of the directory.
+///
+void hive_inotify_watch_set(app_t* app, int wd, bstring path)
+{
+    struct inotify_watch watch;
+    hive_inotify_watch_unset(app, wd);
+    watch.wd = wd;
+    watch.path = bstrcpy(path);
+    list_append(&app->inotify.watches, &watch);
+}
+
+///
+/// @brief Forgets a watch descriptor without touching the filesystem.
+///
+/// @param app The application.
+/// @param wd The watch descriptor.
+///
+void hive_inotify_watch_unset(app_t* app, int wd)
+{
+    struct inotify_watch* watch = list_seek(&app->inotify.watches, &wd);
     if (watch == NULL)
-        return; // We weren't being notified of this directory anyway.
-    inotify_rm_watch(app->source.inotify, watch->wd);
-    printf("<-- %s\n", (const char*)watch->path->data);
+        return;
     bdestroy(watch->path);
-    list_delete(&app->source.watches, watch);
+    list_delete(&app->inotify.watches, watch);
+}
+
+///
+/// @internal
+/// @brief Orders watches by path.
+///
+int hive_inotify_watch_compare(const void* a, const void* b)
+{
+    return bstrcmp((*(struct inotify_watch* const*)a)->path, (*(struct inotify_watch* const*)b)->path);
+}
+
+///
+/// @brief Brings the watches up to date with the directories that exist.
+///
+/// Directories that are not being watched are added, and watches for
+/// directories that are not in the list are removed.
+///
+/// @param app The application.
+/// @param directories The paths of every directory in the source tree, sorted with bstrcmp.
+/// @param count The number of directories.
+///
+void hive_inotify_watch_sync(app_t* app, bstring* directories, size_t count)
+{
+    size_t watched = list_size(&app->inotify.watches);
+    struct inotify_watch** watches = malloc((watched + 1) * sizeof(struct inotify_watch*));
+    for (size_t i = 0; i < watched; i++)
+        watches[i] = list_get_at(&app->inotify.watches, i);
+    qsort(watches, watched, sizeof(struct inotify_watch*), hive_inotify_watch_compare);
+    
+    // Work out which watches to remove first, since removing them changes the list.
+    list_t stale;
+    list_init(&stale);
+    size_t i = 0;
+    size_t j = 0;
+    while (i < watched || j < count)
+    {
+        int result;
+        if (i >= watched)
+            result = 1;
+        else if (j >= count)
+            result = -1;
+        else
+            result = bstrcmp(watches[i]->path, directories[j]);
+        if (result < 0)
+            list_append(&stale, bstrcpy(watches[i]->path));
+        else if (result > 0)
+            hive_inotify_watch_add(app, directories[j]);
+        if (result <= 0)
+            i++;
+        if (result >= 0)
+            j++;
+    }
+    free(watches);
+    
+    list_iterator_start(&stale);
+    while (list_iterator_hasnext(&stale))
+    {
+        bstring path = list_iterator_next(&stale);
+        hive_inotify_watch_remove(app, path);
+        bdestroy(path);
+    }
+    list_iterator_stop(&stale);
+    list_destroy(&stale);
 }
 
 ///
 /// @internal
 /// @brief Recursively registers directories.
 ///
-void hive_inotify_register_recursive(app_t* app, bstring path)
+/// Directories that were already being watched are still descended into,
+/// since they may have been renamed (so the watches beneath them are
+/// updated), and their files are checked against the index anyway.
+/// Ignored files and directories are skipped.
+///
+/// @param app The application.
+/// @param path The directory to register.
+/// @param files If not NULL, receives a HIVE_WATCH_DISCOVERED change for
+///              every file found beneath the directory.
+///
+void hive_inotify_register_recursive(app_t* app, bstring path, struct hive_watch_batch* files)
 {
-    hive_inotify_watch_add(app, path);
+    // The watch is added before the directory is read, so anything created
+    // after the read is seen as an event.
+    if (!hive_inotify_watch_add(app, path))
+        return;
     DIR* dir = opendir((const char*)path->data);
     if (!dir) return;
+    size_t relative_length;
+    const char* relative = hive_ignore_relative(app, path, &relative_length);
     while (true)
     {
         struct dirent* entry;
         entry = readdir(dir);
-        if (!entry) return;
-        if (entry->d_type & DT_DIR)
+        if (!entry) break;
+        if (strcmp(entry->d_name, "..") == 0 ||
+            strcmp(entry->d_name, ".") == 0 ||
+            hive_ignore_match(app, relative, relative_length, entry->d_name, entry->d_type == DT_DIR))
+            continue;
+        bstring child = bstrcpy(path);
+        bconchar(child, '/');
+        bcatcstr(child, entry->d_name);
+        if (entry->d_type == DT_DIR)
+            hive_inotify_register_recursive(app, child, files);
+        else if (files != NULL)
+            hive_watch_batch_add(files, HIVE_WATCH_DISCOVERED, child);
+        bdestroy(child);
+    }
+    closedir(dir);
+}
+
+///
+/// @internal
+/// @brief Registers a directory that was created (or moved in) while being watched.
+///
+/// Files and directories may have been created inside it before it's watch
+/// was added (for example by cp -r or tar x), and those never produce
+/// events.  So the whole subtree is watched first and then every file in
+/// it is checked against the resync index (in parallel, for large trees);
+/// those that are not already known are added to the batch.  Events for the
+/// same files that arrive afterwards are dropped when the file has not
+/// changed since it was discovered.
+///
+/// @param app The application.
+/// @param path The path of the new directory.
+/// @param batch The batch to add changes to.
+///
+void hive_inotify_register_subtree(app_t* app, bstring path, struct hive_watch_batch* batch)
+{
+    struct hive_watch_batch files;
+    memset(&files, 0, sizeof(files));
+    hive_inotify_register_recursive(app, path, &files);
+    if (files.count > 0)
+        hive_resync_discover(app, &files, batch);
+    hive_watch_batch_clear(&files);
+}
+
+///
+/// @brief Initializes inotify.
+///
+/// The descriptor is non-blocking, so that polls can drain it.
+///
+/// @param app The application.
+/// @return Whether inotify could be initialized.
+///
+bool hive_inotify_init(app_t* app)
+{
+    // Initialize the list that we use for mapping watches to their parents.
+    list_init(&app->inotify.watches);
+    list_attributes_copy(&app->inotify.watches, inotify_watch_meter, true);
+    list_attributes_seeker(&app->inotify.watches, inotify_watch_seeker);
+    app->inotify.events = NULL;
+    app->inotify.events_size = 0;
+    app->inotify.fd = inotify_init1(IN_NONBLOCK);
+    return app->inotify.fd >= 0;
+}
+
+///
+/// @brief Watches a directory and every directory beneath it.
+///
+/// @param app The application.
+/// @param path The path of the directory.
+/// @return Always true; directories that can not be watched are reported individually.
+///
+bool hive_inotify_add_root(app_t* app, bstring path)
+{
+    hive_inotify_register_recursive(app, path, NULL);
+    return true;
+}
+
+///
+/// @brief Stops watching and releases inotify.
+///
+/// @param app The application.
+///
+void hive_inotify_close(app_t* app)
+{
+    hive_inotify_detach(app);
+    free(app->inotify.events);
+    app->inotify.events = NULL;
+    app->inotify.events_size = 0;
+}
+
+///
+/// @internal
+/// @brief Returns the name of the event type that is handled for an event mask.
+///
+const char* hive_inotify_describe(uint32_t mask)
+{
+    if (mask & IN_CREATE)
+        return "IN_CREATE";
+    else if (mask & IN_MOVED_TO)
+        return "IN_MOVED_TO";
+    else if (mask & IN_DELETE)
+        return "IN_DELETE";
+    else if (mask & IN_DELETE_SELF)
+        return "IN_DELETE_SELF";
+    else if (mask & IN_MOVED_FROM)
+        return "IN_MOVED_FROM";
+    else if (mask & IN_CLOSE_WRITE)
+        return "IN_CLOSE_WRITE";
+    else if (mask & IN_Q_OVERFLOW)
+        return "IN_Q_OVERFLOW";
+    else
+        return "IN_IGNORED";
+}
+
+///
+/// @brief Counts the complete events in a buffer of raw inotify events.
+///
+/// @param buffer The events, exactly as they were read from the inotify descriptor.
+/// @param length The length of the buffer.
+/// @return The number of events.
+///
+size_t hive_inotify_count(const char* buffer, size_t length)
+{
+    size_t count = 0;
+    size_t ii = 0;
+    while (length - ii >= EVENT_SIZE)
+    {
+        const struct inotify_event* event = (const struct inotify_event*)&buffer[ii];
+        if (length - ii - EVENT_SIZE < event->len)
+            break;
+        ii += EVENT_SIZE + event->len;
+        count++;
+    }
+    return count;
+}
+
+///
+/// @brief Converts a buffer of raw inotify events into changes.
+///
+/// Directory events are handled here, by adding and removing watches, so
+/// only file changes (and overflows) are added to the batch.  Ignored names
+/// are dropped, and the rules are reloaded when .configdignore changes (which
+/// queues a resync, as the change may include files again).  A truncated
+/// event at the end of the buffer is ignored.
+///
+/// @param app The application.
+/// @param buffer The events, exactly as they were read from the inotify descriptor.
+/// @param length The length of the buffer.
+/// @param batch The batch to add changes to.
+///
+void hive_inotify_parse(app_t* app, const char* buffer, size_t length, struct hive_watch_batch* batch)
+{
+    size_t ii = 0;
+    while (length - ii >= EVENT_SIZE)
+    {
+        // Get the event and the watch data.
+        struct inotify_event* event = (struct inotify_event*)&buffer[ii];
+        if (length - ii - EVENT_SIZE < event->len)
+            break;
+        ii += EVENT_SIZE + event->len;
+        if (hive_trace_active())
+        {
+            char detail[64];
+            snprintf(detail, sizeof(detail), "%s%s %s", hive_inotify_describe(event->mask),
+                     (event->mask & IN_ISDIR) ? "|IN_ISDIR" : "", event->len > 0 ? event->name : "");
+            hive_trace_instant("inotify event", detail);
+        }
+        
+        // If the kernel queue overflowed, events have been lost, so the whole
+        // source tree has to be compared against what we last knew about it.
+        if (event->mask & IN_Q_OVERFLOW)
+        {
+            hive_watch_batch_add(batch, HIVE_WATCH_OVERFLOW, NULL);
+            continue;
+        }
+        
+        // Events for watches that have already been removed (such as IN_IGNORED) have no path.
+        struct inotify_watch* watch = list_seek(&app->inotify.watches, &event->wd);
+        if (watch == NULL)
+            continue;
+        
+        // Editor swap files and the like are dropped before anything is allocated.
+        if (event->len > 0)
         {
-            if (strcmp(entry->d_name, "..") == 0 ||
-                strcmp(entry->d_name, ".") == 0)
+            size_t relative_length;
+            const char* relative = hive_ignore_relative(app, watch->path, &relative_length);
+            if (hive_ignore_is_rules_file(app, relative, relative_length, event->name) && hive_ignore_load(app))
+                hive_watch_batch_add(batch, HIVE_WATCH_RESCAN, NULL);
+            if (hive_ignore_match(app, relative, relative_length, event->name, (event->mask & IN_ISDIR) != 0))
                 continue;
-            bstring child = bstrcpy(path);
-            bconchar(child, '/');
-            bcatcstr(child, entry->d_name);
-            hive_inotify_register_recursive(app, child);
-            bdestroy(child);
         }
+        
+        // Construct a joined name automatically.
+        bstring joined = bstrcpy(watch->path);
+        bconchar(joined, '/');
+        bcatcstr(joined, event->name);
+        
+        // Check what type event it was and handle it.
+        if ((event->mask & IN_CREATE) || (event->mask & IN_MOVED_TO))
+        {
+            if (event->mask & IN_ISDIR)
+                hive_inotify_register_subtree(app, joined, batch);
+            else
+                hive_watch_batch_add(batch, HIVE_WATCH_UPDATED, joined);
+        }
+        else if ((event->mask & IN_DELETE) || (event->mask & IN_DELETE_SELF) || (event->mask & IN_MOVED_FROM))
+        {
+            // A directory that was moved takes everything beneath it along,
+            // without an event for any of it; if it was moved within the
+            // source tree, IN_MOVED_TO registers it again at it's new path.
+            if (event->mask & IN_ISDIR)
+            {
+                hive_inotify_watch_remove(app, joined);
+                if (event->mask & IN_MOVED_FROM)
+                    hive_resync_forget_tree(app, joined, batch);
+            }
+            else
+                hive_watch_batch_add(batch, HIVE_WATCH_DELETED, joined);
+        }
+        else if ((event->mask & IN_CLOSE_WRITE) && !(event->mask & IN_ISDIR))
+            hive_watch_batch_add(batch, HIVE_WATCH_UPDATED, joined);
+        
+        // Free data.
+        bdestroy(joined);
     }
 }
 
 ///
-/// @brief Registers inotify events.
+/// @brief Handles a buffer of raw inotify events.
 ///
-void hive_inotify_register(app_t* app)
+/// @param app The application.
+/// @param buffer The events, exactly as they were read from the inotify descriptor.
+/// @param length The length of the buffer.
+///
+void hive_inotify_dispatch(app_t* app, const char* buffer, size_t length)
 {
-    // Initialize the list that we use for mapping watches to their parents.
-    list_init(&app->source.watches);
-    list_attributes_copy(&app->source.watches, inotify_watch_meter, true);
-    list_attributes_seeker(&app->source.watches, inotify_watch_seeker);
-    
-    // Initialize inotify and monitor the source configuration directory.
-    app->source.inotify = inotify_init();
-    hive_inotify_register_recursive(app, app->source.path);
+    struct hive_watch_batch batch;
+    memset(&batch, 0, sizeof(batch));
+    hive_inotify_parse(app, buffer, length, &batch);
+    hive_watch_dispatch(app, &batch);
+    hive_watch_batch_clear(&batch);
+}
+
+///
+/// @internal
+/// @brief Reads every pending event into the reusable event buffer.
+///
+/// The descriptor is non-blocking, so reading stops when it would block.
+/// Interrupted reads are retried, and the buffer is grown whenever it cannot
+/// hold another event, up to EVENT_BUF_MAX.
+///
+/// @param app The application.
+/// @param reads Incremented for every read() that returned events.
+/// @return The number of bytes in the buffer; only whole events are ever returned.
+///
+size_t hive_inotify_drain(app_t* app, uint64_t* reads)
+{
+    size_t length = 0;
+    while (true)
+    {
+        if (app->inotify.events_size - length < EVENT_MAX)
+        {
+            if (app->inotify.events_size >= EVENT_BUF_MAX)
+                break; // Dispatch what we have; the rest is read on the next pass.
+            size_t size = app->inotify.events_size == 0 ? EVENT_BUF_LEN : app->inotify.events_size * 2;
+            char* events = realloc(app->inotify.events, size);
+            if (events == NULL)
+            {
+                fprintf(stderr, "unable to grow the inotify event buffer\n");
+                break;
+            }
+            app->inotify.events = events;
+            app->inotify.events_size = size;
+        }
+        ssize_t result = read(app->inotify.fd, app->inotify.events + length, app->inotify.events_size - length);
+        if (result > 0)
+        {
+            length += (size_t)result;
+            (*reads)++;
+        }
+        else if (result < 0 && errno == EINTR)
+            continue;
+        else
+        {
+            if (result < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+                fprintf(stderr, "error while reading inotify events\n");
+            break;
+        }
+    }
+    return length;
 }
 
 ///
-/// @brief Performs a single non-blocking poll of inotify events.
+/// @brief Adds every pending inotify event to a batch, without blocking.
+///
+/// All pending events are drained from the descriptor on each wake-up, so a
+/// burst of changes (such as a checkout) is handled as one batch.
+///
+/// @param app The application.
+/// @param batch The batch to add changes to.
 ///
-void hive_inotify_poll(app_t* app)
+void hive_inotify_next_batch(app_t* app, struct hive_watch_batch* batch)
 {
     struct timeval timeout;
     timeout.tv_sec = 0;
@@ -154,75 +642,63 @@ void hive_inotify_poll(app_t* app)
     // Check to see if there are any more events.
     fd_set iwatch;
     FD_ZERO(&iwatch);
-    FD_SET(app->source.inotify, &iwatch);
+    FD_SET(app->inotify.fd, &iwatch);
         
     // Attempt to read from the descriptor.
-    int retval = select(app->source.inotify + 1, &iwatch, NULL, NULL, &timeout);
+    int retval = select(app->inotify.fd + 1, &iwatch, NULL, NULL, &timeout);
     if (retval == -1)
-        fprintf(stderr, "error while using select()\n");
-    else if (FD_ISSET(app->source.inotify, &iwatch))
     {
-        char buffer[EVENT_BUF_LEN];
-        size_t length = read(app->source.inotify, buffer, EVENT_BUF_LEN);
-        int ii = 0;
-        while (ii < length)
+        // Signals (such as the SIGUSR1 and SIGUSR2 dump requests) interrupt select.
+        if (errno != EINTR)
+            fprintf(stderr, "error while using select()\n");
+    }
+    else if (FD_ISSET(app->inotify.fd, &iwatch))
+    {
+        hive_trace_begin("hive_inotify_next_batch", NULL);
+        uint64_t events = 0;
+        uint64_t reads = 0;
+        size_t length;
+        do
         {
-            // Get the event and the watch data.
-            struct inotify_event* event = (struct inotify_event*)&buffer[ii];
-            struct inotify_watch* watch = list_seek(&app->source.watches, &event->wd);
-            
-            // Construcwatcht a joined name automatically.
-            bstring joined = bstrcpy(watch->path);
-            bconchar(joined, '/');
-            bcatcstr(joined, event->name);
-            
-            // Check what type event it was and handle it.
-            if ((event->mask & IN_CREATE) || (event->mask & IN_MOVED_TO))
-            {
-                if (event->mask & IN_ISDIR)
-                    hive_inotify_watch_add(app, joined);
-                else if (app->source.updated != NULL)
-                    app->source.updated(app, joined);
-            }
-            else if ((event->mask & IN_DELETE) || (event->mask & IN_DELETE_SELF) || (event->mask & IN_MOVED_FROM))
-            {
-                if (event->mask & IN_ISDIR)
-                    hive_inotify_watch_remove(app, joined);
-                else if (app->source.deleted != NULL)
-                    app->source.deleted(app, joined);
-            }
-            else if ((event->mask & IN_CLOSE_WRITE) && !(event->mask & IN_ISDIR))
-            {
-                if (app->source.updated != NULL)
-                    app->source.updated(app, joined);
-            }
-            
-            // Free data.
-            bdestroy(joined);
-            
-            ii += EVENT_SIZE + event->len;
+            length = hive_inotify_drain(app, &reads);
+            if (length == 0)
+                break;
+            events += hive_inotify_count(app->inotify.events, length);
+            hive_record_events(app, app->inotify.events, length);
+            hive_inotify_parse(app, app->inotify.events, length, batch);
         }
+        while (app->inotify.events_size - length < EVENT_MAX);
+        if (app->enable_stats && events > 0)
+        {
+            hive_histogram_record(app->stats.wakeup_events, events);
+            hive_histogram_record(app->stats.wakeup_reads, reads);
+        }
+        hive_trace_end("hive_inotify_next_batch");
     }
 }
 
 ///
-/// @brief Sets the callback function for when a YAML file is created or updated.
+/// @brief Returns the inotify descriptor, which is readable while events are pending.
 ///
-/// @param app The main application.
-/// @param updated The callback function.
+/// @param app The application.
+/// @param deadline Left as it is; inotify reports every change as it happens.
+/// @return The descriptor.
 ///
-void hive_inotify_set_callback_updated(app_t* app, void (*updated)(app_t* app, bstring path))
+int hive_inotify_wakeup(app_t* app, uint64_t* deadline)
 {
-    app->source.updated = updated;
+    return app->inotify.fd;
 }
 
 ///
-/// @brief Sets the callback function for when a YAML file is deleted.
+/// @brief Watches every directory with it's own inotify watch.
 ///
-/// @param app The main application.
-/// @param updated The callback function.
-///
-void hive_inotify_set_callback_deleted(app_t* app, void (*deleted)(app_t* app, bstring path))
+const struct hive_watch_backend hive_inotify_backend =
 {
-    app->source.deleted = deleted;
-}
+    "inotify",
+    hive_inotify_init,
+    hive_inotify_add_root,
+    hive_inotify_next_batch,
+    hive_inotify_watch_sync,
+    hive_inotify_wakeup,
+    hive_inotify_close,
+};
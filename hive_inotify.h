@@ -3,10 +3,21 @@
 
 #include <bstrlib.h>
 #include "hive_app.h"
+#include "hive_watch.h"
 
-void hive_inotify_register(app_t* app);
-void hive_inotify_poll(app_t* app);
-void hive_inotify_set_callback_updated(app_t* app, void (*updated)(app_t* app, bstring path));
-void hive_inotify_set_callback_deleted(app_t* app, void (*deleted)(app_t* app, bstring path));
+extern const struct hive_watch_backend hive_inotify_backend;
 
-#endif
\ No newline at end of file
+bool hive_inotify_init(app_t* app);
+bool hive_inotify_add_root(app_t* app, bstring path);
+void hive_inotify_next_batch(app_t* app, struct hive_watch_batch* batch);
+void hive_inotify_close(app_t* app);
+size_t hive_inotify_count(const char* buffer, size_t length);
+void hive_inotify_parse(app_t* app, const char* buffer, size_t length, struct hive_watch_batch* batch);
+void hive_inotify_dispatch(app_t* app, const char* buffer, size_t length);
+bstring hive_inotify_watch_path(app_t* app, int wd);
+void hive_inotify_detach(app_t* app);
+void hive_inotify_watch_set(app_t* app, int wd, bstring path);
+void hive_inotify_watch_unset(app_t* app, int wd);
+void hive_inotify_watch_sync(app_t* app, bstring* directories, size_t count);
+
+#endif
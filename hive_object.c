@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <stdint.h>
 #include <stdio.h>
 #include "hive_object.h"
 
@@ -47,6 +48,134 @@ void hive_object_free(struct object* object)
     free(object);
 }
 
+///
+/// @brief Continues an FNV-1a hash with a block of memory.
+///
+/// @param hash The hash so far, or HIVE_OBJECT_HASH_SEED to start a new one.
+/// @param data The memory to hash.
+/// @param length The length of the memory.
+/// @return The hash.
+///
+uint64_t hive_object_mix(uint64_t hash, const void* data, size_t length)
+{
+    const unsigned char* bytes = data;
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+///
+/// @internal
+/// @brief Computes the hash of an object from it's content and the hashes of
+///        it's children.
+///
+uint64_t hive_object_compute_hash(struct object* object)
+{
+    unsigned char type = object == NULL ? OBJECT_TYPE_NIL : (unsigned char)object->type;
+    uint64_t hash = hive_object_mix(HIVE_OBJECT_HASH_SEED, &type, 1);
+    if (object == NULL)
+        return hash;
+    switch (object->type)
+    {
+        case OBJECT_TYPE_NUMBER:
+            return hive_object_mix(hash, &object->number, sizeof(object->number));
+        case OBJECT_TYPE_STRING:
+        {
+            int length = blength(object->string);
+            hash = hive_object_mix(hash, &length, sizeof(length));
+            return hive_object_mix(hash, object->string->data, length);
+        }
+        case OBJECT_TYPE_LIST:
+        {
+            unsigned int size = list_size(&object->list);
+            hash = hive_object_mix(hash, &size, sizeof(size));
+            list_iterator_start(&object->list);
+            while (list_iterator_hasnext(&object->list))
+            {
+                uint64_t child = hive_object_hash(list_iterator_next(&object->list));
+                hash = hive_object_mix(hash, &child, sizeof(child));
+            }
+            list_iterator_stop(&object->list);
+            return hash;
+        }
+        case OBJECT_TYPE_MAP:
+        {
+            unsigned int size = list_size(&object->map);
+            hash = hive_object_mix(hash, &size, sizeof(size));
+            list_iterator_start(&object->map);
+            while (list_iterator_hasnext(&object->map))
+            {
+                struct map_entry* entry = list_iterator_next(&object->map);
+                uint64_t children[2] = { hive_object_hash(entry->key), hive_object_hash(entry->value) };
+                hash = hive_object_mix(hash, children, sizeof(children));
+            }
+            list_iterator_stop(&object->map);
+            return hash;
+        }
+        default:
+            return hash;
+    }
+}
+
+///
+/// @brief Returns the hash of the content of an object tree.
+///
+/// The hash of a list or map is built from the hashes of it's children (in
+/// order, and for maps from both the key and the value), so equal subtrees
+/// hash the same wherever they are, and two trees are equal (barring a
+/// collision) if their roots have the same hash.  The type and size of each
+/// object is included, so that for example a list of one string and the
+/// string itself hash differently.
+///
+/// The hash is kept in the object once it has been computed (the parsers
+/// compute it for every object as they go), so this is normally a single
+/// read.  Code that changes an object after that must call
+/// hive_object_changed on it and on every object that contains it.
+///
+/// @param object The object, or NULL (which hashes like a nil object).
+/// @return The hash, which is never 0.
+///
+uint64_t hive_object_hash(struct object* object)
+{
+    if (object != NULL && object->hash != 0)
+        return object->hash;
+    uint64_t hash = hive_object_compute_hash(object);
+    if (hash == 0)
+        hash = 1;
+    if (object != NULL)
+        object->hash = hash;
+    return hash;
+}
+
+///
+/// @brief Forgets the hash of an object after it's content was changed.
+///
+/// @param object The object that was changed, or that contains an object that was.
+///
+void hive_object_changed(struct object* object)
+{
+    object->hash = 0;
+}
+
+///
+/// @brief Appends the text of a string or number; other objects are skipped.
+///
+/// @param object The object, or NULL.
+/// @param output The text to append to.
+///
+void hive_object_write(struct object* object, bstring output)
+{
+    if (object == NULL)
+        return;
+    if (object->type == OBJECT_TYPE_STRING)
+        bconcat(output, object->string);
+    else if (object->type == OBJECT_TYPE_NUMBER)
+        bformata(output, "%ld", object->number);
+}
+
 ///
 /// @brief Prints out the structure of an object to stdout for debugging.
 ///
@@ -1,6 +1,8 @@
 #ifndef __HIVE_OBJECT_H
 #define __HIVE_OBJECT_H
 
+#include <stddef.h>
+#include <stdint.h>
 #include <bstrlib.h>
 #include <simclist.h>
 
@@ -9,6 +11,7 @@
 #define OBJECT_TYPE_STRING 2 ///< Indicates this object is a string object.
 #define OBJECT_TYPE_LIST 3 ///< Indicates this object is a list object.
 #define OBJECT_TYPE_MAP 4 ///< Indicates this object is a map object.
+#define HIVE_OBJECT_HASH_SEED 14695981039346656037ULL ///< The FNV-1a offset basis, which hashes start from.
 
 ///
 /// @brief Represents a complex object (nil, number, string, list or map).
@@ -16,6 +19,7 @@
 struct object
 {
     int type; ///< The type of this object, one of the OBJECT_TYPE_* constants.   
+    uint64_t hash; ///< The hash of the content (see hive_object_hash), or 0 if it has not been computed yet.
     union
     {
         long number; ///< A numeric value.
@@ -34,7 +38,21 @@ struct map_entry
     struct object* value; ///< The value of the map pair.
 };
 
+///
+/// @brief Walks the nodes of a list without it's iterator.
+///
+/// A list has one iterator, which everyone walking it shares, so walks
+/// that can run on several threads at once (such as those made while
+/// rendering records) must use this instead; node->data is the item.
+///
+#define HIVE_LIST_FOREACH(list, node) \
+    for (struct list_entry_s* node = (list)->head_sentinel->next; node != (list)->tail_sentinel; node = node->next)
+
 void hive_object_free(struct object* object);
+uint64_t hive_object_mix(uint64_t hash, const void* data, size_t length);
+uint64_t hive_object_hash(struct object* object);
+void hive_object_changed(struct object* object);
+void hive_object_write(struct object* object, bstring output);
 void hive_object_print(struct object* object, bstring indent);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,164 @@
+///
+/// @file
+/// @brief Writes rendered outputs to the active directory.
+///
+/// Stylesheets, templates and emitters all render into an in-memory buffer
+/// (one per thread, reused so that it only grows to the largest output),
+/// and the same bytes are then hashed and written.  Outputs are written to
+/// a uniquely named temporary file in the same directory, flushed to disk
+/// and then renamed into place, so readers never see a partially written
+/// output, even after a crash.  The temporary file takes the mode and owner
+/// of the output it replaces, so that permissions set on an output are
+/// kept.  Outputs whose content has not changed are not written at all.
+///
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "hive_output.h"
+#include "hive_cache.h"
+#include "hive_records.h"
+
+///
+/// @internal
+/// @brief The render buffer of the current thread.
+///
+static _Thread_local bstring hive_output_buffer_data = NULL;
+
+///
+/// @internal
+/// @brief Finds the last written content of an output based on path.
+///
+/// @param el The current element that is being found.
+/// @param key The path of the output.
+///
+int hive_output_entry_seeker(const void* el, const void* key)
+{
+    return biseq(((struct hive_output_entry*)el)->path, (const_bstring)key);
+}
+
+///
+/// @brief Initializes the record of what was written to each output.
+///
+/// @param app The application.
+///
+void hive_output_init(app_t* app)
+{
+    list_init(&app->outputs.entries);
+    list_attributes_seeker(&app->outputs.entries, hive_output_entry_seeker);
+
+    // New outputs get the mode that creating them directly would give.
+    mode_t mask = umask(0);
+    umask(mask);
+    app->outputs.mode = 0666 & ~mask;
+}
+
+///
+/// @brief Returns the render buffer of the current thread, emptied.
+///
+/// The buffer is only valid until the next call on the same thread.
+///
+/// @return The buffer.
+///
+bstring hive_output_buffer()
+{
+    if (hive_output_buffer_data == NULL)
+        hive_output_buffer_data = bfromcstralloc(4096, "");
+    else
+        btrunc(hive_output_buffer_data, 0);
+    return hive_output_buffer_data;
+}
+
+///
+/// @brief Writes an output, unless it already has exactly this content.
+///
+/// @param app The application.
+/// @param path The path of the output.
+/// @param data The content.
+/// @return Whether the output has the content (the reason is printed if not).
+///
+bool hive_output_write(app_t* app, bstring path, bstring data)
+{
+    uint64_t hash = hive_cache_hash(data->data, blength(data));
+    struct hive_output_entry* entry = list_seek(&app->outputs.entries, path);
+    struct stat st;
+    if (entry != NULL && entry->hash == hash && entry->length == blength(data) &&
+        stat((const char*)path->data, &st) == 0 && st.st_size == blength(data))
+        return true;
+
+    // The temporary file is hidden next to the output, so that the rename
+    // stays on one filesystem.
+    int slash = bstrrchr(path, '/');
+    bstring temporary = bstrcpy(path);
+    binsertch(temporary, slash + 1, 1, '.');
+    bcatcstr(temporary, ".XXXXXX");
+    int fd = mkstemp((char*)temporary->data);
+    bool result = fd >= 0;
+    if (result)
+    {
+        if (stat((const char*)path->data, &st) == 0)
+        {
+            // Ownership can only be kept when running as root; the mode is kept regardless.
+            if (fchown(fd, st.st_uid, st.st_gid) != 0 && errno != EPERM)
+                result = false;
+            result = result && fchmod(fd, st.st_mode & 07777) == 0;
+        }
+        else
+            result = fchmod(fd, app->outputs.mode) == 0;
+        const unsigned char* remaining = data->data;
+        size_t length = blength(data);
+        while (result && length > 0)
+        {
+            ssize_t written = write(fd, remaining, length);
+            if (written < 0 && errno == EINTR)
+                continue;
+            result = written > 0;
+            if (result)
+            {
+                remaining += written;
+                length -= written;
+            }
+        }
+        result = result && fsync(fd) == 0;
+        result = close(fd) == 0 && result;
+        result = result && rename((const char*)temporary->data, (const char*)path->data) == 0;
+        if (!result)
+            unlink((const char*)temporary->data);
+    }
+    bdestroy(temporary);
+    if (!result)
+    {
+        fprintf(stderr, "unable to write: %s\n", path->data);
+        return false;
+    }
+    if (entry == NULL)
+    {
+        entry = malloc(sizeof(struct hive_output_entry));
+        entry->path = bstrcpy(path);
+        list_append(&app->outputs.entries, entry);
+    }
+    entry->hash = hash;
+    entry->length = blength(data);
+    return true;
+}
+
+///
+/// @brief Deletes an output, and forgets what was written to it (and what it's
+///        records rendered to).
+///
+/// @param app The application.
+/// @param path The path of the output.
+///
+void hive_output_remove(app_t* app, bstring path)
+{
+    unlink((const char*)path->data);
+    hive_records_remove(app, path);
+    struct hive_output_entry* entry = list_seek(&app->outputs.entries, path);
+    if (entry == NULL)
+        return;
+    list_delete(&app->outputs.entries, entry);
+    bdestroy(entry->path);
+    free(entry);
+}
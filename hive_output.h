@@ -0,0 +1,24 @@
+#ifndef __HIVE_OUTPUT_H
+#define __HIVE_OUTPUT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <bstrlib.h>
+#include "hive_app.h"
+
+///
+/// @brief What was last written to an output.
+///
+struct hive_output_entry
+{
+    bstring path; ///< The path of the output.
+    uint64_t hash; ///< The hash of the content.
+    int length; ///< The length of the content.
+};
+
+void hive_output_init(app_t* app);
+bstring hive_output_buffer();
+bool hive_output_write(app_t* app, bstring path, bstring data);
+void hive_output_remove(app_t* app, bstring path);
+
+#endif
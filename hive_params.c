@@ -0,0 +1,368 @@
+///
+/// @file
+/// @brief Declares outputs that share one stylesheet with different parameters.
+///
+/// Outputs that only differ by something like a hostname or role do not
+/// need a stylesheet each.  Next to the stylesheet, an .outputs file with
+/// the same name lists the outputs it produces, one per line, with the
+/// stylesheet parameters for each:
+///
+///   # output      parameters
+///   motd.web1     host=web1 role="web server"
+///   motd.db1      host=db1 role=database source=db.yml
+///
+/// Every output is rendered with the same compiled stylesheet, with the
+/// parameters passed as strings (read them with <xsl:param name="host" />).
+/// "source" is not a parameter; it names the data file for the output, if
+/// it is not the one with the same name as the manifest.  Output names and
+/// data files are relative to the directory of the manifest.  While a
+/// manifest exists, the output that the stylesheet would otherwise produce
+/// on it's own is not generated.
+///
+/// Templates and .emit files can be shared in the same way (with different
+/// data files), but they ignore parameters.
+///
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "hive_params.h"
+#include "hive_output.h"
+#include "hive_snapshot.h"
+#include "hive_template.h"
+
+///
+/// @brief Initializes the list of manifests.
+///
+/// @param app The application.
+///
+void hive_params_init(app_t* app)
+{
+    list_init(&app->manifests.entries);
+}
+
+///
+/// @internal
+/// @brief Frees a manifest.
+///
+void hive_params_free(struct hive_params_manifest* manifest)
+{
+    for (size_t i = 0; i < manifest->count; i++)
+    {
+        struct hive_params_output* output = &manifest->outputs[i];
+        bdestroy(output->name);
+        bdestroy(output->output);
+        bdestroy(output->yaml);
+        for (size_t j = 0; output->params != NULL && output->params[j] != NULL; j++)
+            free((char*)output->params[j]);
+        free(output->params);
+    }
+    free(manifest->outputs);
+    bdestroy(manifest->path);
+    bdestroy(manifest->xslt);
+    free(manifest);
+}
+
+///
+/// @internal
+/// @brief Finds a loaded manifest by path.
+///
+struct hive_params_manifest* hive_params_find(app_t* app, bstring path)
+{
+    struct hive_params_manifest* found = NULL;
+    list_iterator_start(&app->manifests.entries);
+    while (found == NULL && list_iterator_hasnext(&app->manifests.entries))
+    {
+        struct hive_params_manifest* manifest = list_iterator_next(&app->manifests.entries);
+        if (biseq(manifest->path, path))
+            found = manifest;
+    }
+    list_iterator_stop(&app->manifests.entries);
+    return found;
+}
+
+///
+/// @internal
+/// @brief Returns the next whitespace separated token of a line (where quoted
+///        text may contain whitespace), or NULL at the end of the line or a comment.
+///
+bstring hive_params_token(bstring line, int* position)
+{
+    int i = *position;
+    while (i < blength(line) && isspace(line->data[i]))
+        i++;
+    if (i >= blength(line) || line->data[i] == '#')
+    {
+        *position = blength(line);
+        return NULL;
+    }
+    int start = i;
+    bool quoted = false;
+    while (i < blength(line) && (quoted || !isspace(line->data[i])))
+    {
+        if (quoted && line->data[i] == '\\' && i + 1 < blength(line))
+            i++;
+        else if (line->data[i] == '"')
+            quoted = !quoted;
+        i++;
+    }
+    *position = i;
+    return bmidstr(line, start, i - start);
+}
+
+///
+/// @internal
+/// @brief Whether a relative path stays within the directory it is relative to.
+///
+bool hive_params_relative(bstring path)
+{
+    if (blength(path) == 0 || path->data[0] == '/')
+        return false;
+    int start = 0;
+    while (start <= blength(path))
+    {
+        int end = bstrchrp(path, '/', start);
+        if (end == BSTR_ERR)
+            end = blength(path);
+        if (end - start == 2 && path->data[start] == '.' && path->data[start + 1] == '.')
+            return false;
+        start = end + 1;
+    }
+    return true;
+}
+
+///
+/// @internal
+/// @brief Copies a bstring into a plain C string, for libxslt.
+///
+char* hive_params_copy(bstring string)
+{
+    char* result = malloc(blength(string) + 1);
+    memcpy(result, string->data, blength(string) + 1);
+    return result;
+}
+
+///
+/// @internal
+/// @brief Parses a line of a manifest into an output.
+///
+/// @return NULL, or the reason the line is invalid.
+///
+const char* hive_params_parse_line(bstring line, bstring directory, bstring prefix, app_t* app,
+                                   const struct hive_path_info* info, struct hive_params_output* output)
+{
+    int position = 0;
+    bstring name = hive_params_token(line, &position);
+    if (name == NULL)
+        return NULL;
+    if (!hive_params_relative(name))
+    {
+        bdestroy(name);
+        return "output names must be relative and stay in the directory";
+    }
+    output->name = bstrcpy(prefix);
+    bconcat(output->name, name);
+    bdestroy(name);
+    output->output = bformat("%s/%s", (const char*)app->active.path->data, (const char*)output->name->data);
+    output->yaml = bstrcpy(info->yaml);
+
+    size_t count = 0;
+    output->params = calloc(1, sizeof(const char*));
+    bstring token;
+    while ((token = hive_params_token(line, &position)) != NULL)
+    {
+        int equals = bstrchr(token, '=');
+        bstring key = equals > 0 ? bmidstr(token, 0, equals) : NULL;
+        bstring raw = equals > 0 ? bmidstr(token, equals + 1, blength(token)) : NULL;
+        bstring value = raw != NULL ? hive_template_parse_text(raw) : NULL;
+        bdestroy(token);
+        bdestroy(raw);
+        if (value == NULL)
+        {
+            bdestroy(key);
+            return "expected name=value";
+        }
+        if (biseqcstr(key, "source"))
+        {
+            bool valid = hive_params_relative(value);
+            if (valid)
+            {
+                bdestroy(output->yaml);
+                output->yaml = bformat("%s/%s", (const char*)directory->data, (const char*)value->data);
+            }
+            bdestroy(key);
+            bdestroy(value);
+            if (!valid)
+                return "sources must be relative and stay in the directory";
+            continue;
+        }
+        output->params = realloc(output->params, (count + 3) * sizeof(const char*));
+        output->params[count++] = hive_params_copy(key);
+        output->params[count++] = hive_params_copy(value);
+        output->params[count] = NULL;
+        bdestroy(key);
+        bdestroy(value);
+    }
+    return NULL;
+}
+
+///
+/// @brief Reads (or reads again) a manifest.
+///
+/// Outputs that were declared by the previous version of the manifest but
+/// not by this one are removed.  If the manifest is invalid, the reason is
+/// printed and the previous version is kept.
+///
+/// @param app The application.
+/// @param path The path of the manifest.
+/// @param info The derived paths of a file with the same name, which give
+///             the stylesheet and the default data file.
+/// @return The manifest, or NULL if it is missing or invalid.
+///
+struct hive_params_manifest* hive_params_load(app_t* app, bstring path, const struct hive_path_info* info)
+{
+    FILE* file = fopen((const char*)path->data, "rb");
+    if (file == NULL)
+    {
+        fprintf(stderr, "missing manifest: %s\n", path->data);
+        return NULL;
+    }
+    bstring source = bread((bNread)fread, file);
+    fclose(file);
+
+    struct hive_params_manifest* manifest = calloc(1, sizeof(struct hive_params_manifest));
+    manifest->path = bstrcpy(path);
+    manifest->xslt = bstrcpy(info->xslt);
+    manifest->renderer = info->renderer;
+
+    // Output names and data files are relative to the manifest.
+    bstring directory = bmidstr(path, 0, bstrrchr(path, '/'));
+    int slash = bstrrchr(info->name, '/');
+    bstring prefix = slash == BSTR_ERR ? bfromcstr("") : bmidstr(info->name, 0, slash + 1);
+
+    struct bstrList* lines = bsplit(source, '\n');
+    size_t capacity = 0;
+    const char* error = NULL;
+    int line = 0;
+    for (int i = 0; i < lines->qty && error == NULL; i++)
+    {
+        line = i + 1;
+        if (manifest->count == capacity)
+        {
+            capacity = capacity == 0 ? 8 : capacity * 2;
+            manifest->outputs = realloc(manifest->outputs, capacity * sizeof(struct hive_params_output));
+        }
+        struct hive_params_output* output = &manifest->outputs[manifest->count];
+        memset(output, 0, sizeof(struct hive_params_output));
+        error = hive_params_parse_line(lines->entry[i], directory, prefix, app, info, output);
+        if (output->name == NULL)
+            continue;
+        manifest->count++;
+        for (size_t j = 0; error == NULL && j + 1 < manifest->count; j++)
+            if (biseq(manifest->outputs[j].name, output->name))
+                error = "duplicate output";
+    }
+    bstrListDestroy(lines);
+    bdestroy(directory);
+    bdestroy(prefix);
+    bdestroy(source);
+    if (error != NULL)
+    {
+        fprintf(stderr, "%s:%d: %s\n", path->data, line, error);
+        hive_params_free(manifest);
+        return NULL;
+    }
+
+    struct hive_params_manifest* previous = hive_params_find(app, path);
+    if (previous != NULL)
+    {
+        for (size_t i = 0; i < previous->count; i++)
+        {
+            bool kept = false;
+            for (size_t j = 0; !kept && j < manifest->count; j++)
+                kept = biseq(previous->outputs[i].name, manifest->outputs[j].name);
+            if (!kept)
+                hive_params_unlink(app, previous, &previous->outputs[i]);
+        }
+        list_delete(&app->manifests.entries, previous);
+        hive_params_free(previous);
+    }
+    list_append(&app->manifests.entries, manifest);
+    return manifest;
+}
+
+///
+/// @brief Returns the manifest with the same name as a file, reading it if it
+///        exists but has not been seen yet.
+///
+/// @param app The application.
+/// @param info The derived paths of the file.
+/// @return The manifest, or NULL if there is none.
+///
+struct hive_params_manifest* hive_params_discover(app_t* app, const struct hive_path_info* info)
+{
+    bstring path = bformat("%s/%s.outputs", (const char*)app->source.path->data, (const char*)info->name->data);
+    struct hive_params_manifest* manifest = hive_params_find(app, path);
+    if (manifest == NULL && access((const char*)path->data, F_OK) == 0)
+        manifest = hive_params_load(app, path, info);
+    bdestroy(path);
+    return manifest;
+}
+
+///
+/// @brief Calls a function for each declared output that depends on a file.
+///
+/// Every output of a manifest depends on the manifest and it's stylesheet;
+/// otherwise outputs depend on their own data file.
+///
+/// @param app The application.
+/// @param path The path of the file.
+/// @param callback The function, which must not load or remove manifests.
+///
+void hive_params_foreach(app_t* app, bstring path, hive_params_callback callback)
+{
+    list_iterator_start(&app->manifests.entries);
+    while (list_iterator_hasnext(&app->manifests.entries))
+    {
+        struct hive_params_manifest* manifest = list_iterator_next(&app->manifests.entries);
+        bool all = biseq(manifest->path, path) || biseq(manifest->xslt, path);
+        for (size_t i = 0; i < manifest->count; i++)
+            if (all || biseq(manifest->outputs[i].yaml, path))
+                callback(app, manifest, &manifest->outputs[i]);
+    }
+    list_iterator_stop(&app->manifests.entries);
+}
+
+///
+/// @brief Removes a declared output from the active directory (and the snapshot).
+///
+/// @param app The application.
+/// @param manifest The manifest that declares the output.
+/// @param output The output.
+///
+void hive_params_unlink(app_t* app, struct hive_params_manifest* manifest, struct hive_params_output* output)
+{
+    hive_output_remove(app, output->output);
+    if (app->enable_snapshot)
+        hive_snapshot_remove_document(app, output->name);
+}
+
+///
+/// @brief Forgets a deleted manifest, removing the outputs it declared.
+///
+/// @param app The application.
+/// @param path The path of the manifest.
+///
+void hive_params_remove(app_t* app, bstring path)
+{
+    struct hive_params_manifest* manifest = hive_params_find(app, path);
+    if (manifest == NULL)
+        return;
+    for (size_t i = 0; i < manifest->count; i++)
+        hive_params_unlink(app, manifest, &manifest->outputs[i]);
+    list_delete(&app->manifests.entries, manifest);
+    hive_params_free(manifest);
+}
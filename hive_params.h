@@ -0,0 +1,44 @@
+#ifndef __HIVE_PARAMS_H
+#define __HIVE_PARAMS_H
+
+#include <stddef.h>
+#include <bstrlib.h>
+#include "hive_app.h"
+#include "hive_path.h"
+
+///
+/// @brief An output declared in a manifest.
+///
+struct hive_params_output
+{
+    bstring name; ///< The name of the output, relative to the active directory.
+    bstring output; ///< The path of the output in the active directory.
+    bstring yaml; ///< The path of the data file.
+    const char** params; ///< The stylesheet parameters as name, value pairs followed by NULL.
+};
+
+///
+/// @brief The outputs declared in an .outputs file.
+///
+struct hive_params_manifest
+{
+    bstring path; ///< The path of the manifest.
+    bstring xslt; ///< The path of the stylesheet or template the outputs share.
+    int renderer; ///< The role of the stylesheet or template.
+    struct hive_params_output* outputs; ///< The declared outputs.
+    size_t count; ///< The number of declared outputs.
+};
+
+///
+/// @brief Called for each declared output that depends on a file.
+///
+typedef void (*hive_params_callback)(app_t* app, struct hive_params_manifest* manifest, struct hive_params_output* output);
+
+void hive_params_init(app_t* app);
+struct hive_params_manifest* hive_params_load(app_t* app, bstring path, const struct hive_path_info* info);
+struct hive_params_manifest* hive_params_discover(app_t* app, const struct hive_path_info* info);
+void hive_params_foreach(app_t* app, bstring path, hive_params_callback callback);
+void hive_params_unlink(app_t* app, struct hive_params_manifest* manifest, struct hive_params_output* output);
+void hive_params_remove(app_t* app, bstring path);
+
+#endif
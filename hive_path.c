@@ -0,0 +1,330 @@
+///
+/// @file
+/// @brief Classifies source paths and caches the paths derived from them.
+///
+/// Whether a path is a source at all is decided by comparing the end of
+/// it against a registry of extensions, without allocating; everything
+/// else that is needed to regenerate it's output (the data file, the
+/// stylesheet and the output path) is worked out the first time the path
+/// is seen and kept in a hash table until the file is deleted.
+///
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include "hive_path.h"
+#include "hive_cache.h"
+#include "hive_sched.h"
+
+///
+/// @brief The registered extensions, in order of preference.
+///
+static struct hive_path_handler hive_path_handlers[HIVE_PATH_HANDLERS_MAX] =
+{
+    { ".yml", 4, HIVE_PATH_SOURCE },
+    { ".yaml", 5, HIVE_PATH_SOURCE },
+    { ".json", 5, HIVE_PATH_SOURCE },
+    { ".xslt", 5, HIVE_PATH_STYLESHEET },
+    { ".tmpl", 5, HIVE_PATH_TEMPLATE },
+    { ".emit", 5, HIVE_PATH_EMITTER },
+    { ".outputs", 8, HIVE_PATH_MANIFEST },
+};
+static size_t hive_path_handler_count = 7;
+
+///
+/// @brief Registers another extension.
+///
+/// @param extension The extension, including the '.'; it must outlive the application.
+/// @param role What files with the extension are used for, one of the HIVE_PATH_* constants.
+/// @return Whether there was room for it.
+///
+bool hive_path_register(const char* extension, int role)
+{
+    if (hive_path_handler_count == HIVE_PATH_HANDLERS_MAX)
+        return false;
+    hive_path_handlers[hive_path_handler_count].extension = extension;
+    hive_path_handlers[hive_path_handler_count].length = strlen(extension);
+    hive_path_handlers[hive_path_handler_count].role = role;
+    hive_path_handler_count++;
+    return true;
+}
+
+///
+/// @brief Finds the handler for a path, without allocating.
+///
+/// @param path The path (or just the name) of the file.
+/// @param length The length of the path.
+/// @return The handler, or NULL if the file is not a source (including hidden files).
+///
+const struct hive_path_handler* hive_path_classify(const char* path, size_t length)
+{
+    size_t name = length;
+    while (name > 0 && path[name - 1] != '/')
+        name--;
+    if (name < length && path[name] == '.')
+        return NULL;
+    for (size_t i = 0; i < hive_path_handler_count; i++)
+    {
+        const struct hive_path_handler* handler = &hive_path_handlers[i];
+        if (length - name > handler->length &&
+            strncasecmp(path + length - handler->length, handler->extension, handler->length) == 0)
+            return handler;
+    }
+    return NULL;
+}
+
+///
+/// @internal
+/// @brief Finds the companion of a file with the same name but another extension.
+///
+/// @param base The path of the file without it's extension.
+/// @param sources Whether to look for a data file (rather than a stylesheet or template).
+/// @param path Receives the path of the first companion that exists, or of the
+///             first registered one if none exist.
+/// @return The handler of the companion.
+///
+const struct hive_path_handler* hive_path_companion(bstring base, bool sources, bstring* path)
+{
+    const struct hive_path_handler* first = NULL;
+    for (size_t i = 0; i < hive_path_handler_count; i++)
+    {
+        if ((hive_path_handlers[i].role == HIVE_PATH_SOURCE) != sources ||
+            hive_path_handlers[i].role == HIVE_PATH_MANIFEST)
+            continue;
+        bstring candidate = bstrcpy(base);
+        bcatcstr(candidate, hive_path_handlers[i].extension);
+        if (access((const char*)candidate->data, F_OK) == 0)
+        {
+            *path = candidate;
+            return &hive_path_handlers[i];
+        }
+        bdestroy(candidate);
+        if (first == NULL)
+            first = &hive_path_handlers[i];
+    }
+    *path = bstrcpy(base);
+    bcatcstr(*path, first->extension);
+    return first;
+}
+
+///
+/// @brief Initializes the table of derived paths.
+///
+/// @param app The application.
+///
+void hive_path_init(app_t* app)
+{
+    app->paths.capacity = 64;
+    app->paths.count = 0;
+    app->paths.entries = calloc(app->paths.capacity, sizeof(struct hive_path_info));
+}
+
+///
+/// @internal
+/// @brief Finds the slot that holds a path, or the empty slot where it would go.
+///
+size_t hive_path_slot(app_t* app, const char* path, size_t length, uint64_t hash)
+{
+    size_t mask = app->paths.capacity - 1;
+    size_t slot = hash & mask;
+    while (app->paths.entries[slot].path != NULL)
+    {
+        struct hive_path_info* info = &app->paths.entries[slot];
+        if (info->hash == hash && (size_t)blength(info->path) == length &&
+            memcmp(info->path->data, path, length) == 0)
+            break;
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+///
+/// @internal
+/// @brief Doubles the size of the table.
+///
+void hive_path_grow(app_t* app)
+{
+    struct hive_path_info* entries = app->paths.entries;
+    size_t capacity = app->paths.capacity;
+    app->paths.capacity *= 2;
+    app->paths.entries = calloc(app->paths.capacity, sizeof(struct hive_path_info));
+    for (size_t i = 0; i < capacity; i++)
+    {
+        if (entries[i].path == NULL)
+            continue;
+        size_t slot = entries[i].hash & (app->paths.capacity - 1);
+        while (app->paths.entries[slot].path != NULL)
+            slot = (slot + 1) & (app->paths.capacity - 1);
+        app->paths.entries[slot] = entries[i];
+    }
+    free(entries);
+}
+
+///
+/// @internal
+/// @brief Works out the data file, stylesheet and output for a path.
+///
+void hive_path_derive(app_t* app, struct hive_path_info* info)
+{
+    int root = blength(app->source.path) + 1;
+    int base_length = blength(info->path) - (int)info->handler->length;
+    info->name = bmidstr(info->path, root, base_length - root);
+    info->output = bformat("%s/%s", (const char*)app->active.path->data, (const char*)info->name->data);
+    info->priority = hive_sched_classify(app, info->name);
+    info->queued = NULL;
+
+    // The companion is the first one that exists, in the order they were registered.
+    bstring base = bmidstr(info->path, 0, base_length);
+    info->shadowed = false;
+    if (info->handler->role == HIVE_PATH_SOURCE || info->handler->role == HIVE_PATH_MANIFEST)
+    {
+        // Manifests default to the same data file and stylesheet as a source would.
+        if (info->handler->role == HIVE_PATH_SOURCE)
+            info->yaml = bstrcpy(info->path);
+        else
+            hive_path_companion(base, true, &info->yaml);
+        info->renderer = hive_path_companion(base, false, &info->xslt)->role;
+    }
+    else
+    {
+        // Only the first stylesheet, template or .emit file that exists is used.
+        bstring preferred;
+        info->xslt = bstrcpy(info->path);
+        info->renderer = info->handler->role;
+        hive_path_companion(base, true, &info->yaml);
+        hive_path_companion(base, false, &preferred);
+        info->shadowed = !biseqcaseless(preferred, info->path);
+        bdestroy(preferred);
+    }
+    bdestroy(base);
+}
+
+///
+/// @brief Returns everything derived from the path of a source file.
+///
+/// Paths that are not sources are rejected without allocating, and paths
+/// that have been seen before are found with a single hash lookup.
+///
+/// @param app The application.
+/// @param path The path of the file.
+/// @return The derived paths (valid until the next call to hive_path_lookup
+///         or hive_path_forget), or NULL if the file is not a source.
+///
+struct hive_path_info* hive_path_lookup(app_t* app, bstring path)
+{
+    const struct hive_path_handler* handler = hive_path_classify((const char*)path->data, blength(path));
+    if (handler == NULL || blength(path) <= blength(app->source.path) + 1 + (int)handler->length)
+        return NULL;
+    uint64_t hash = hive_cache_hash(path->data, blength(path));
+    size_t slot = hive_path_slot(app, (const char*)path->data, blength(path), hash);
+    if (app->paths.entries[slot].path != NULL)
+        return &app->paths.entries[slot];
+
+    struct hive_path_info info;
+    info.path = bstrcpy(path);
+    info.hash = hash;
+    info.handler = handler;
+    hive_path_derive(app, &info);
+
+    // Files with the same name that were seen before this one may have chosen another companion.
+    hive_path_forget(app, path);
+
+    if ((app->paths.count + 1) * 4 > app->paths.capacity * 3)
+        hive_path_grow(app);
+    slot = hive_path_slot(app, (const char*)path->data, blength(path), hash);
+    app->paths.entries[slot] = info;
+    app->paths.count++;
+    return &app->paths.entries[slot];
+}
+
+///
+/// @internal
+/// @brief Removes the entry for a single path, if there is one.
+///
+void hive_path_remove(app_t* app, bstring path)
+{
+    uint64_t hash = hive_cache_hash(path->data, blength(path));
+    size_t slot = hive_path_slot(app, (const char*)path->data, blength(path), hash);
+    struct hive_path_info* info = &app->paths.entries[slot];
+    if (info->path == NULL)
+        return;
+    bdestroy(info->path);
+    bdestroy(info->yaml);
+    bdestroy(info->xslt);
+    bdestroy(info->output);
+    bdestroy(info->name);
+
+    // Move later entries of the same run back, so that lookups never stop early.
+    size_t mask = app->paths.capacity - 1;
+    size_t empty = slot;
+    size_t next = slot;
+    while (true)
+    {
+        next = (next + 1) & mask;
+        if (app->paths.entries[next].path == NULL)
+            break;
+        size_t home = app->paths.entries[next].hash & mask;
+        if (((next - home) & mask) >= ((next - empty) & mask))
+        {
+            app->paths.entries[empty] = app->paths.entries[next];
+            empty = next;
+        }
+    }
+    memset(&app->paths.entries[empty], 0, sizeof(struct hive_path_info));
+    app->paths.count--;
+}
+
+///
+/// @internal
+/// @brief Derives the paths for an entry again, if there is one.
+///
+/// The entry keeps it's place in the table and it's queued change, so that
+/// the scheduler does not queue the file a second time.
+///
+void hive_path_refresh(app_t* app, bstring path)
+{
+    uint64_t hash = hive_cache_hash(path->data, blength(path));
+    size_t slot = hive_path_slot(app, (const char*)path->data, blength(path), hash);
+    struct hive_path_info* info = &app->paths.entries[slot];
+    if (info->path == NULL)
+        return;
+    struct hive_sched_item* queued = info->queued;
+    bdestroy(info->yaml);
+    bdestroy(info->xslt);
+    bdestroy(info->output);
+    bdestroy(info->name);
+    hive_path_derive(app, info);
+    info->queued = queued;
+}
+
+///
+/// @brief Forgets the paths derived from a file, such as when it is deleted.
+///
+/// The files with the same name and any other registered extension are
+/// derived again, so that they choose their companions again.
+///
+/// @param app The application.
+/// @param path The path of the file.
+///
+void hive_path_forget(app_t* app, bstring path)
+{
+    const struct hive_path_handler* handler = hive_path_classify((const char*)path->data, blength(path));
+    if (handler == NULL)
+        return;
+    bstring base = bmidstr(path, 0, blength(path) - (int)handler->length);
+    for (size_t i = 0; i < hive_path_handler_count; i++)
+    {
+        bstring variant = bstrcpy(base);
+        bcatcstr(variant, hive_path_handlers[i].extension);
+        if (&hive_path_handlers[i] == handler)
+            hive_path_remove(app, variant);
+        else
+            hive_path_refresh(app, variant);
+        bdestroy(variant);
+    }
+    // The path may differ from the registered extension in case.
+    hive_path_remove(app, path);
+    bdestroy(base);
+}
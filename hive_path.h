@@ -0,0 +1,57 @@
+#ifndef __HIVE_PATH_H
+#define __HIVE_PATH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <bstrlib.h>
+#include "hive_app.h"
+
+struct hive_sched_item;
+
+#define HIVE_PATH_SOURCE 0 ///< The file holds configuration data (parsed as YAML).
+#define HIVE_PATH_STYLESHEET 1 ///< The file is an XSLT stylesheet that turns configuration data into an output.
+#define HIVE_PATH_TEMPLATE 2 ///< The file is a native template (see hive_template.c) that turns configuration data into an output.
+#define HIVE_PATH_EMITTER 3 ///< The file names a built-in output format (see hive_emit.c).
+#define HIVE_PATH_MANIFEST 4 ///< The file declares outputs that share a stylesheet with different parameters (see hive_params.c).
+
+#define HIVE_PATH_HANDLERS_MAX 16 ///< The largest number of extensions that can be registered.
+
+///
+/// @brief What is done with source files that have a particular extension.
+///
+/// The output of a source or stylesheet is named after it's path relative to
+/// the source directory, with the extension removed.
+///
+struct hive_path_handler
+{
+    const char* extension; ///< The extension, including the '.' (compared without case).
+    size_t length; ///< The length of the extension.
+    int role; ///< What the file is used for, one of the HIVE_PATH_* constants.
+};
+
+///
+/// @brief Everything derived from the path of a source file.
+///
+struct hive_path_info
+{
+    bstring path; ///< The path of the source file.
+    uint64_t hash; ///< The hash of the path.
+    const struct hive_path_handler* handler; ///< The handler for the extension.
+    bstring yaml; ///< The path of the data file.
+    bstring xslt; ///< The path of the stylesheet, template or .emit file.
+    int renderer; ///< How the output is rendered, the role of the stylesheet or template (HIVE_PATH_STYLESHEET, HIVE_PATH_TEMPLATE or HIVE_PATH_EMITTER).
+    bstring output; ///< The path of the output in the active directory.
+    bstring name; ///< The name of the output, relative to the active directory.
+    bool shadowed; ///< Whether this is a stylesheet, template or .emit file that is not used, because another one comes first.
+    int priority; ///< The priority class of the output, one of the HIVE_SCHED_* constants.
+    struct hive_sched_item* queued; ///< The queued change to the file, or NULL if there is none.
+};
+
+bool hive_path_register(const char* extension, int role);
+const struct hive_path_handler* hive_path_classify(const char* path, size_t length);
+void hive_path_init(app_t* app);
+struct hive_path_info* hive_path_lookup(app_t* app, bstring path);
+void hive_path_forget(app_t* app, bstring path);
+
+#endif
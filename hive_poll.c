@@ -0,0 +1,119 @@
+///
+/// @file
+/// @brief Finds changes to configuration sources by periodically scanning them.
+///
+/// inotify and fanotify only see changes that are made through the local
+/// kernel, so they miss changes on NFS and some overlay setups.  This
+/// backend instead compares the whole source tree against the sorted index
+/// kept by hive_resync.c (stat on a pool of threads, hashing only files
+/// whose status changed) every app->poll.interval milliseconds.
+///
+/// To bound the CPU that polling uses on large trees, the next scan is never
+/// scheduled sooner than HIVE_POLL_DUTY times the length of the last scan,
+/// so scanning takes at most 1 / HIVE_POLL_DUTY of the time however large the
+/// tree is.
+///
+
+#include <stdio.h>
+#include "hive_poll.h"
+#include "hive_ignore.h"
+#include "hive_resync.h"
+#include "hive_stats.h"
+#include "hive_trace.h"
+
+#define HIVE_POLL_DUTY 10 ///< Scans are spaced at least this many times their own length apart.
+
+///
+/// @brief Initializes polling.
+///
+/// @param app The application; app->poll.interval is the time between
+///            scans in milliseconds, or 0 for HIVE_POLL_INTERVAL.
+/// @return Always true.
+///
+bool hive_poll_init(app_t* app)
+{
+    if (app->poll.interval == 0)
+        app->poll.interval = HIVE_POLL_INTERVAL;
+    app->poll.next = hive_stats_now() + app->poll.interval * 1000000;
+    return true;
+}
+
+///
+/// @brief Starts polling a directory tree.
+///
+/// The tree that is scanned is always app->source.path, which the index
+/// is built from.
+///
+/// @param app The application.
+/// @param path The path of the directory.
+/// @return Whether the directory is the source directory.
+///
+bool hive_poll_add_root(app_t* app, bstring path)
+{
+    printf("--> %s (polling every %llu ms)\n", (const char*)path->data, (unsigned long long)app->poll.interval);
+    return biseq(path, app->source.path);
+}
+
+///
+/// @brief Scans the source tree if a scan is due, adding any changes to a batch.
+///
+/// @param app The application.
+/// @param batch The batch to add changes to.
+///
+void hive_poll_next_batch(app_t* app, struct hive_watch_batch* batch)
+{
+    uint64_t start = hive_stats_now();
+    if (start < app->poll.next)
+        return;
+    hive_trace_begin("hive_poll_next_batch", NULL);
+
+    // .configdignore is itself ignored by the default rules, so the scan
+    // never reports it; the rules are reloaded first if it changed, so that
+    // the scan finds files that are no longer ignored.
+    hive_ignore_load(app);
+    hive_resync_collect(app, batch);
+    uint64_t end = hive_stats_now();
+    uint64_t delay = app->poll.interval * 1000000;
+    if (delay < (end - start) * HIVE_POLL_DUTY)
+        delay = (end - start) * HIVE_POLL_DUTY;
+    app->poll.next = end + delay;
+    hive_trace_end("hive_poll_next_batch");
+}
+
+///
+/// @brief Lowers a deadline to when the next scan is due.
+///
+/// @param app The application.
+/// @param deadline The deadline to lower.
+/// @return -1, as there is nothing to wait on until then.
+///
+int hive_poll_wakeup(app_t* app, uint64_t* deadline)
+{
+    if (app->poll.next < *deadline)
+        *deadline = app->poll.next;
+    return -1;
+}
+
+///
+/// @brief Stops polling.
+///
+/// @param app The application.
+///
+void hive_poll_close(app_t* app)
+{
+    app->poll.next = UINT64_MAX;
+}
+
+///
+/// @brief Finds changes by scanning the source tree every app->poll.interval milliseconds.
+///
+const struct hive_watch_backend hive_poll_backend =
+{
+    "poll",
+    hive_poll_init,
+    hive_poll_add_root,
+    hive_poll_next_batch,
+    NULL,
+    hive_poll_wakeup,
+    hive_poll_close,
+};
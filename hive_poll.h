@@ -0,0 +1,18 @@
+#ifndef __HIVE_POLL_H
+#define __HIVE_POLL_H
+
+#include <stdbool.h>
+#include <bstrlib.h>
+#include "hive_app.h"
+#include "hive_watch.h"
+
+#define HIVE_POLL_INTERVAL 2000 ///< The default time between scans, in milliseconds.
+
+extern const struct hive_watch_backend hive_poll_backend;
+
+bool hive_poll_init(app_t* app);
+bool hive_poll_add_root(app_t* app, bstring path);
+void hive_poll_next_batch(app_t* app, struct hive_watch_batch* batch);
+void hive_poll_close(app_t* app);
+
+#endif
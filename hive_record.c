@@ -0,0 +1,201 @@
+///
+/// @file
+/// @brief Records the inotify event stream so that it can be replayed later.
+///
+/// A recording starts with the content of every file in the source tree,
+/// followed by every watch that is added or removed and every buffer of
+/// raw events exactly as it was read from the inotify descriptor.  Before
+/// each buffer, the current content of every file it mentions is recorded,
+/// so that replaying the recording (see hive_replay.c) reproduces what the
+/// daemon saw without depending on the original filesystem or it's timing.
+///
+/// All paths are stored relative to the source directory.
+///
+
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/inotify.h>
+#include "hive_record.h"
+#include "hive_inotify.h"
+
+///
+/// @internal
+/// @brief Appends an entry to the recording.
+///
+void hive_record_write(app_t* app, uint32_t type, int wd, const void* payload, size_t length, const void* extra, size_t extra_length)
+{
+    struct hive_record_entry entry;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    entry.timestamp = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+    entry.type = type;
+    entry.wd = wd;
+    entry.length = length + extra_length;
+    entry.reserved = 0;
+    fwrite(&entry, sizeof(entry), 1, app->record.file);
+    fwrite(payload, 1, length, app->record.file);
+    if (extra_length > 0)
+        fwrite(extra, 1, extra_length, app->record.file);
+}
+
+///
+/// @internal
+/// @brief Returns the path relative to the source directory.
+///
+/// @return A new string, which is empty for the source directory itself.
+///
+bstring hive_record_relative(app_t* app, bstring path)
+{
+    int skip = blength(app->source.path);
+    if (blength(path) > skip && path->data[skip] == '/')
+        skip++;
+    return bmidstr(path, skip, blength(path) - skip);
+}
+
+///
+/// @internal
+/// @brief Records the current state of a file or directory.
+///
+/// @param app The application.
+/// @param path The absolute path.
+/// @param is_dir Whether the path is a directory.
+///
+void hive_record_path(app_t* app, bstring path, bool is_dir)
+{
+    bstring relative = hive_record_relative(app, path);
+    if (is_dir)
+        hive_record_write(app, HIVE_RECORD_DIRECTORY, -1, relative->data, blength(relative), NULL, 0);
+    else
+    {
+        FILE* file = fopen((const char*)path->data, "rb");
+        if (file != NULL)
+        {
+            bstring content = bread((bNread)fread, file);
+            fclose(file);
+            hive_record_write(app, HIVE_RECORD_CONTENT, -1, relative->data, blength(relative) + 1, content->data, blength(content));
+            bdestroy(content);
+        }
+    }
+    bdestroy(relative);
+}
+
+///
+/// @internal
+/// @brief Records the content of a directory and everything beneath it.
+///
+void hive_record_tree(app_t* app, bstring path)
+{
+    DIR* dir = opendir((const char*)path->data);
+    if (dir == NULL)
+        return;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+        bstring child = bformat("%s/%s", (const char*)path->data, entry->d_name);
+        if (entry->d_type == DT_DIR)
+        {
+            hive_record_path(app, child, true);
+            hive_record_tree(app, child);
+        }
+        else if (entry->d_type == DT_REG)
+            hive_record_path(app, child, false);
+        bdestroy(child);
+    }
+    closedir(dir);
+}
+
+///
+/// @brief Starts recording to app->record.path, if it is set.
+///
+/// This must be called before the source directory is registered, so
+/// that the recording includes the initial watches.
+///
+/// @param app The application.
+/// @return Whether recording started (or was not requested).
+///
+bool hive_record_open(app_t* app)
+{
+    struct hive_record_header header;
+    app->record.file = NULL;
+    if (app->record.path == NULL)
+        return true;
+    app->record.file = fopen((const char*)app->record.path->data, "wb");
+    if (app->record.file == NULL)
+        return false;
+    header.magic = HIVE_RECORD_MAGIC;
+    header.version = HIVE_RECORD_VERSION;
+    fwrite(&header, sizeof(header), 1, app->record.file);
+    hive_record_tree(app, app->source.path);
+    fflush(app->record.file);
+    return true;
+}
+
+///
+/// @brief Records that a watch was added.
+///
+/// @param app The application.
+/// @param wd The watch descriptor.
+/// @param path The path of the watched directory.
+///
+void hive_record_watch_added(app_t* app, int wd, bstring path)
+{
+    if (app->record.file == NULL)
+        return;
+    bstring relative = hive_record_relative(app, path);
+    hive_record_write(app, HIVE_RECORD_WATCH, wd, relative->data, blength(relative), NULL, 0);
+    bdestroy(relative);
+    fflush(app->record.file);
+}
+
+///
+/// @brief Records that a watch was removed.
+///
+/// @param app The application.
+/// @param wd The watch descriptor.
+///
+void hive_record_watch_removed(app_t* app, int wd)
+{
+    if (app->record.file == NULL)
+        return;
+    hive_record_write(app, HIVE_RECORD_UNWATCH, wd, NULL, 0, NULL, 0);
+    fflush(app->record.file);
+}
+
+///
+/// @brief Records a buffer of raw events, preceded by the content of every file it mentions.
+///
+/// @param app The application.
+/// @param buffer The events, exactly as they were read from the inotify descriptor.
+/// @param length The length of the buffer.
+///
+void hive_record_events(app_t* app, const char* buffer, size_t length)
+{
+    if (app->record.file == NULL)
+        return;
+    size_t offset = 0;
+    while (offset + sizeof(struct inotify_event) <= length)
+    {
+        struct inotify_event* event = (struct inotify_event*)&buffer[offset];
+        bstring directory = hive_inotify_watch_path(app, event->wd);
+        if (directory != NULL && event->len > 0)
+        {
+            bstring joined = bformat("%s/%s", (const char*)directory->data, event->name);
+            if (event->mask & (IN_CLOSE_WRITE | IN_CREATE | IN_MOVED_TO))
+                hive_record_path(app, joined, (event->mask & IN_ISDIR) != 0);
+            else if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+            {
+                bstring relative = hive_record_relative(app, joined);
+                hive_record_write(app, HIVE_RECORD_DELETE, -1, relative->data, blength(relative), NULL, 0);
+                bdestroy(relative);
+            }
+            bdestroy(joined);
+        }
+        offset += sizeof(struct inotify_event) + event->len;
+    }
+    hive_record_write(app, HIVE_RECORD_EVENTS, -1, buffer, length, NULL, 0);
+    fflush(app->record.file);
+}
@@ -0,0 +1,45 @@
+#ifndef __HIVE_RECORD_H
+#define __HIVE_RECORD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <bstrlib.h>
+#include "hive_app.h"
+
+#define HIVE_RECORD_MAGIC 0x52474643 ///< The magic number at the start of a recording ("CFGR").
+#define HIVE_RECORD_VERSION 1 ///< The current version of the recording format.
+
+#define HIVE_RECORD_WATCH 1 ///< A watch was added; wd is set and the payload is the relative path.
+#define HIVE_RECORD_UNWATCH 2 ///< A watch was removed; wd is set and there is no payload.
+#define HIVE_RECORD_DIRECTORY 3 ///< A directory exists; the payload is the relative path.
+#define HIVE_RECORD_CONTENT 4 ///< A file has content; the payload is the relative path, a NUL and the content.
+#define HIVE_RECORD_DELETE 5 ///< A file or directory was removed; the payload is the relative path.
+#define HIVE_RECORD_EVENTS 6 ///< A read from the inotify descriptor; the payload is the raw events.
+
+///
+/// @brief The header at the start of a recording.
+///
+struct hive_record_header
+{
+    uint32_t magic; ///< Always HIVE_RECORD_MAGIC.
+    uint32_t version; ///< Always HIVE_RECORD_VERSION.
+};
+
+///
+/// @brief The header of each entry in a recording, which is followed by length bytes of payload.
+///
+struct hive_record_entry
+{
+    uint64_t timestamp; ///< The monotonic time of the entry in nanoseconds.
+    uint32_t type; ///< The type of entry, one of the HIVE_RECORD_* constants.
+    int32_t wd; ///< The watch descriptor, for watch entries.
+    uint32_t length; ///< The length of the payload.
+    uint32_t reserved; ///< Padding; always zero.
+};
+
+bool hive_record_open(app_t* app);
+void hive_record_watch_added(app_t* app, int wd, bstring path);
+void hive_record_watch_removed(app_t* app, int wd);
+void hive_record_events(app_t* app, const char* buffer, size_t length);
+
+#endif
@@ -0,0 +1,330 @@
+///
+/// @file
+/// @brief Renders only the records that changed in record-oriented outputs.
+///
+/// A stylesheet that declares cfg:records="yes" renders each entry of the
+/// top-level map on it's own, so an output is what each entry renders to,
+/// in order.  For each such output, configd remembers a hash of every entry
+/// (it's key and value) and what each block of up to
+/// HIVE_RECORDS_BLOCK_SIZE consecutive entries rendered to.  When the
+/// source changes, the new entries are matched against the old blocks in
+/// order: a block whose entries are all unchanged is copied from the
+/// previous output, and only the entries in between are rendered again, as
+/// new blocks.  Changing one line of a huge hosts file then renders one
+/// block rather than the whole file.
+///
+/// Everything is rendered again if the stylesheet or it's parameters
+/// change.  Blocks whose records looked up values with the cfg: functions
+/// (which can reach any part of the source) are rendered again whenever
+/// anything in the source changed.
+///
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hive_records.h"
+#include "hive_xslt.h"
+#include "hive_trace.h"
+
+#define HIVE_RECORDS_NONE ((size_t)-1) ///< Marks a block that is rendered rather than copied.
+
+///
+/// @internal
+/// @brief Finds the records of an output based on path.
+///
+/// @param el The current element that is being found.
+/// @param key The path of the output.
+///
+int hive_records_output_seeker(const void* el, const void* key)
+{
+    return biseq(((struct hive_records_output*)el)->path, (const_bstring)key);
+}
+
+///
+/// @brief Initializes the record of what the records of each output rendered to.
+///
+/// @param app The application.
+///
+void hive_records_init(app_t* app)
+{
+    list_init(&app->records.entries);
+    list_attributes_seeker(&app->records.entries, hive_records_output_seeker);
+}
+
+///
+/// @internal
+/// @brief Hashes the stylesheet parameters.
+///
+uint64_t hive_records_params(const char** params)
+{
+    uint64_t hash = HIVE_OBJECT_HASH_SEED;
+    for (size_t i = 0; params != NULL && params[i] != NULL; i++)
+        hash = hive_object_mix(hash, params[i], strlen(params[i]) + 1);
+    return hash;
+}
+
+///
+/// @internal
+/// @brief Forgets what the records of an output rendered to, so that they are
+///        all rendered again.
+///
+void hive_records_clear(struct hive_records_output* output)
+{
+    free(output->fingerprints);
+    free(output->blocks);
+    output->fingerprints = NULL;
+    output->count = 0;
+    output->blocks = NULL;
+    output->block_count = 0;
+    output->style = NULL;
+    btrunc(output->rendered, 0);
+}
+
+///
+/// @internal
+/// @brief Indexes the blocks of an output by the hash of their first record.
+///
+/// Blocks that looked up values elsewhere in the source are left out if
+/// the source changed.
+///
+/// @return The table of block positions plus one (zero is empty), which has
+///         a power of two capacity.
+///
+size_t* hive_records_table(struct hive_records_output* output, bool changed, size_t* capacity)
+{
+    *capacity = 16;
+    while (*capacity < output->block_count * 2)
+        *capacity *= 2;
+    size_t* table = calloc(*capacity, sizeof(size_t));
+    for (size_t i = 0; i < output->block_count; i++)
+    {
+        if (changed && output->blocks[i].lookups)
+            continue;
+        uint64_t fingerprint = output->fingerprints[output->blocks[i].start];
+        size_t slot = fingerprint & (*capacity - 1);
+        while (table[slot] != 0 && output->fingerprints[output->blocks[table[slot] - 1].start] != fingerprint)
+            slot = (slot + 1) & (*capacity - 1);
+        if (table[slot] == 0)
+            table[slot] = i + 1;
+    }
+    return table;
+}
+
+///
+/// @internal
+/// @brief Finds the old block that starts with a record, if all of it's
+///        records are the same as the new records from that position.
+///
+/// @return The position of the block, or HIVE_RECORDS_NONE.
+///
+size_t hive_records_match(struct hive_records_output* output, size_t* table, size_t capacity,
+                          uint64_t* fingerprints, size_t position, size_t count)
+{
+    size_t slot = fingerprints[position] & (capacity - 1);
+    while (table[slot] != 0)
+    {
+        struct hive_records_block* block = &output->blocks[table[slot] - 1];
+        if (output->fingerprints[block->start] == fingerprints[position])
+        {
+            if (position + block->count <= count &&
+                memcmp(&fingerprints[position], &output->fingerprints[block->start], block->count * sizeof(uint64_t)) == 0)
+                return table[slot] - 1;
+            return HIVE_RECORDS_NONE;
+        }
+        slot = (slot + 1) & (capacity - 1);
+    }
+    return HIVE_RECORDS_NONE;
+}
+
+///
+/// @internal
+/// @brief Splits a run of records that must be rendered into new blocks.
+///
+void hive_records_split(struct hive_records_block* blocks, size_t* sources, size_t* block_count, size_t start, size_t end)
+{
+    while (start < end)
+    {
+        size_t count = end - start < HIVE_RECORDS_BLOCK_SIZE ? end - start : HIVE_RECORDS_BLOCK_SIZE;
+        blocks[*block_count].start = start;
+        blocks[*block_count].count = count;
+        sources[*block_count] = HIVE_RECORDS_NONE;
+        (*block_count)++;
+        start += count;
+    }
+}
+
+///
+/// @brief Renders the records of an output, copying the blocks of records that
+///        have not changed since the last render from the previous output.
+///
+/// @param app The application.
+/// @param path The path of the output.
+/// @param style The stylesheet, which must declare cfg:records="yes".
+/// @param params The stylesheet parameters as name, value pairs followed by NULL, or NULL.
+/// @param object The parsed source, which must be a map.
+/// @param threads The number of threads to render on, from hive_xslt_record_threads.
+/// @param result The buffer to append the output to.
+/// @return NULL, or the reason the stylesheet could not be applied.
+///
+const char* hive_records_render(app_t* app, bstring path, xsltStylesheetPtr style, const char** params,
+                                struct object* object, size_t threads, bstring result)
+{
+    struct hive_records_output* output = list_seek(&app->records.entries, path);
+    if (output == NULL)
+    {
+        output = calloc(1, sizeof(struct hive_records_output));
+        output->path = bstrcpy(path);
+        output->rendered = bfromcstr("");
+        list_append(&app->records.entries, output);
+    }
+
+    // If nothing changed at all, the whole output is the same.
+    uint64_t tree = hive_object_hash(object);
+    uint64_t hash = hive_records_params(params);
+    if (output->style == style && output->params == hash && output->tree == tree && output->block_count > 0)
+    {
+        bconcat(result, output->rendered);
+        return NULL;
+    }
+    if (output->style != style || output->params != hash)
+        hive_records_clear(output);
+
+    // Hash every record.
+    hive_trace_begin("hive_records_match", NULL);
+    size_t count = list_size(&object->map);
+    struct map_entry** entries = malloc((count + 1) * sizeof(struct map_entry*));
+    uint64_t* fingerprints = malloc((count + 1) * sizeof(uint64_t));
+    size_t position = 0;
+    list_iterator_start(&object->map);
+    while (list_iterator_hasnext(&object->map))
+    {
+        struct map_entry* entry = list_iterator_next(&object->map);
+        entries[position] = entry;
+        uint64_t children[2] = { hive_object_hash(entry->key), hive_object_hash(entry->value) };
+        fingerprints[position++] = hive_object_mix(HIVE_OBJECT_HASH_SEED, children, sizeof(children));
+    }
+    list_iterator_stop(&object->map);
+
+    // Copy the old blocks whose records are all unchanged, and split the
+    // records in between into new blocks.
+    size_t capacity;
+    size_t* table = hive_records_table(output, output->tree != tree, &capacity);
+    // Every block has at least one record, but old blocks can match more
+    // than once (records with the same key and value), so only the number
+    // of records bounds the number of blocks.
+    size_t most = count + 1;
+    struct hive_records_block* blocks = malloc(most * sizeof(struct hive_records_block));
+    size_t* sources = malloc(most * sizeof(size_t));
+    size_t block_count = 0;
+    size_t pending = 0;
+    position = 0;
+    while (position < count)
+    {
+        size_t match = hive_records_match(output, table, capacity, fingerprints, position, count);
+        if (match == HIVE_RECORDS_NONE)
+        {
+            position++;
+            continue;
+        }
+        hive_records_split(blocks, sources, &block_count, pending, position);
+        blocks[block_count].start = position;
+        blocks[block_count].count = output->blocks[match].count;
+        sources[block_count++] = match;
+        position += output->blocks[match].count;
+        pending = position;
+    }
+    hive_records_split(blocks, sources, &block_count, pending, count);
+    free(table);
+    hive_trace_end("hive_records_match");
+
+    // Render the new blocks.
+    struct hive_xslt_range* ranges = malloc((block_count + 1) * sizeof(struct hive_xslt_range));
+    size_t range_count = 0;
+    for (size_t i = 0; i < block_count; i++)
+    {
+        if (sources[i] != HIVE_RECORDS_NONE)
+            continue;
+        ranges[range_count].entries = entries + blocks[i].start;
+        ranges[range_count].count = blocks[i].count;
+        ranges[range_count++].result = bfromcstralloc(256, "");
+    }
+    const char* error = range_count == 0 ? NULL : hive_xslt_apply_ranges(style, params, object, ranges, range_count, threads);
+
+    // Join the copied and rendered blocks in order.
+    int base = blength(result);
+    size_t range = 0;
+    for (size_t i = 0; i < block_count && error == NULL; i++)
+    {
+        blocks[i].offset = blength(result) - base;
+        if (sources[i] == HIVE_RECORDS_NONE)
+        {
+            blocks[i].lookups = ranges[range].lookups;
+            bconcat(result, ranges[range++].result);
+        }
+        else
+        {
+            struct hive_records_block* old = &output->blocks[sources[i]];
+            blocks[i].lookups = old->lookups;
+            bcatblk(result, output->rendered->data + old->offset, old->length);
+        }
+        blocks[i].length = blength(result) - base - blocks[i].offset;
+    }
+    for (size_t i = 0; i < range_count; i++)
+        bdestroy(ranges[i].result);
+    free(ranges);
+    free(sources);
+    free(entries);
+
+    hive_records_clear(output);
+    if (error != NULL)
+    {
+        free(fingerprints);
+        free(blocks);
+        return error;
+    }
+    output->style = style;
+    output->params = hash;
+    output->tree = tree;
+    output->fingerprints = fingerprints;
+    output->count = count;
+    output->blocks = blocks;
+    output->block_count = block_count;
+    bassignblk(output->rendered, result->data + base, blength(result) - base);
+    return NULL;
+}
+
+///
+/// @brief Forgets what was rendered with a stylesheet, before it is freed.
+///
+/// @param app The application.
+/// @param style The stylesheet.
+///
+void hive_records_forget_stylesheet(app_t* app, xsltStylesheetPtr style)
+{
+    list_iterator_start(&app->records.entries);
+    while (list_iterator_hasnext(&app->records.entries))
+    {
+        struct hive_records_output* output = list_iterator_next(&app->records.entries);
+        if (output->style == style)
+            hive_records_clear(output);
+    }
+    list_iterator_stop(&app->records.entries);
+}
+
+///
+/// @brief Forgets what the records of an output rendered to.
+///
+/// @param app The application.
+/// @param path The path of the output.
+///
+void hive_records_remove(app_t* app, bstring path)
+{
+    struct hive_records_output* output = list_seek(&app->records.entries, path);
+    if (output == NULL)
+        return;
+    list_delete(&app->records.entries, output);
+    hive_records_clear(output);
+    bdestroy(output->rendered);
+    bdestroy(output->path);
+    free(output);
+}
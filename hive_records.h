@@ -0,0 +1,48 @@
+#ifndef __HIVE_RECORDS_H
+#define __HIVE_RECORDS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <bstrlib.h>
+#include <libxslt/xsltInternals.h>
+#include "hive_app.h"
+#include "hive_object.h"
+
+#define HIVE_RECORDS_BLOCK_SIZE 256 ///< The most records that are rendered together as one block.
+
+///
+/// @brief A run of records that was rendered together.
+///
+struct hive_records_block
+{
+    size_t start; ///< The position of the first record of the block.
+    size_t count; ///< The number of records in the block.
+    size_t offset; ///< Where the rendered block starts in the output.
+    size_t length; ///< The length of the rendered block.
+    bool lookups; ///< Whether the block looked up values elsewhere in the source.
+};
+
+///
+/// @brief What the records of an output were last rendered to.
+///
+struct hive_records_output
+{
+    bstring path; ///< The path of the output.
+    xsltStylesheetPtr style; ///< The stylesheet the output was rendered with.
+    uint64_t params; ///< The hash of the stylesheet parameters.
+    uint64_t tree; ///< The hash of the source (see hive_object_hash).
+    uint64_t* fingerprints; ///< The hash of each record (it's key and value).
+    size_t count; ///< The number of records.
+    struct hive_records_block* blocks; ///< The blocks, in order.
+    size_t block_count; ///< The number of blocks.
+    bstring rendered; ///< The rendered output.
+};
+
+void hive_records_init(app_t* app);
+const char* hive_records_render(app_t* app, bstring path, xsltStylesheetPtr style, const char** params,
+                                struct object* object, size_t threads, bstring result);
+void hive_records_forget_stylesheet(app_t* app, xsltStylesheetPtr style);
+void hive_records_remove(app_t* app, bstring path);
+
+#endif
@@ -0,0 +1,169 @@
+///
+/// @file
+/// @brief Replays a recording made by hive_record.c through the dispatch path.
+///
+/// The application must have been initialized with an empty source
+/// directory, which the replay fills in with the recorded file contents as
+/// it goes.  The application is detached from inotify first, so the only
+/// events it sees are the recorded ones; the recorded watch descriptors
+/// are mapped onto the replay source directory.
+///
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "hive_replay.h"
+#include "hive_record.h"
+#include "hive_inotify.h"
+#include "hive_sched.h"
+
+///
+/// @internal
+/// @brief Returns the replay path of a recorded relative path.
+///
+bstring hive_replay_path(app_t* app, const unsigned char* relative, size_t length)
+{
+    bstring path = bstrcpy(app->source.path);
+    if (length > 0)
+    {
+        bconchar(path, '/');
+        bcatblk(path, relative, length);
+    }
+    return path;
+}
+
+///
+/// @internal
+/// @brief Waits until a recorded timestamp is due, at the given speed.
+///
+void hive_replay_wait(uint64_t start, uint64_t first, uint64_t timestamp, double speed)
+{
+    if (speed <= 0 || timestamp <= first)
+        return;
+    uint64_t due = start + (uint64_t)((timestamp - first) / speed);
+    uint64_t now = hive_stats_now();
+    if (due <= now)
+        return;
+    struct timespec delay;
+    delay.tv_sec = (due - now) / 1000000000;
+    delay.tv_nsec = (due - now) % 1000000000;
+    while (nanosleep(&delay, &delay) != 0 && errno == EINTR);
+}
+
+///
+/// @brief Replays a recording.
+///
+/// @param app The application, initialized with an empty source directory.
+/// @param path The path of the recording.
+/// @param speed How much faster than the original to replay, or 0 to replay
+///              as fast as possible.
+/// @param result Receives counts and timings of the replay.
+/// @return Whether the recording could be read in it's entirety.
+///
+bool hive_replay(app_t* app, bstring path, double speed, struct hive_replay_result* result)
+{
+    memset(result, 0, sizeof(struct hive_replay_result));
+    FILE* file = fopen((const char*)path->data, "rb");
+    if (file == NULL)
+        return false;
+    bstring recording = bread((bNread)fread, file);
+    fclose(file);
+    
+    struct hive_record_header header;
+    size_t length = blength(recording);
+    if (length < sizeof(header))
+    {
+        bdestroy(recording);
+        return false;
+    }
+    memcpy(&header, recording->data, sizeof(header));
+    if (header.magic != HIVE_RECORD_MAGIC || header.version != HIVE_RECORD_VERSION)
+    {
+        bdestroy(recording);
+        return false;
+    }
+    
+    hive_inotify_detach(app);
+    uint64_t start = hive_stats_now();
+    uint64_t first = 0;
+    size_t offset = sizeof(header);
+    while (offset + sizeof(struct hive_record_entry) <= length)
+    {
+        struct hive_record_entry entry;
+        memcpy(&entry, recording->data + offset, sizeof(entry));
+        offset += sizeof(entry);
+        if (entry.length > length - offset)
+            break;
+        const unsigned char* payload = recording->data + offset;
+        offset += entry.length;
+        if (first == 0)
+            first = entry.timestamp;
+        
+        switch (entry.type)
+        {
+            case HIVE_RECORD_WATCH:
+            {
+                bstring directory = hive_replay_path(app, payload, entry.length);
+                hive_inotify_watch_set(app, entry.wd, directory);
+                bdestroy(directory);
+                break;
+            }
+            case HIVE_RECORD_UNWATCH:
+                hive_inotify_watch_unset(app, entry.wd);
+                break;
+            case HIVE_RECORD_DIRECTORY:
+            {
+                bstring directory = hive_replay_path(app, payload, entry.length);
+                mkdir((const char*)directory->data, 0755);
+                bdestroy(directory);
+                break;
+            }
+            case HIVE_RECORD_CONTENT:
+            {
+                size_t name_length = strnlen((const char*)payload, entry.length);
+                if (name_length == entry.length)
+                    break;
+                bstring target = hive_replay_path(app, payload, name_length);
+                FILE* output = fopen((const char*)target->data, "wb");
+                if (output != NULL)
+                {
+                    fwrite(payload + name_length + 1, 1, entry.length - name_length - 1, output);
+                    fclose(output);
+                }
+                bdestroy(target);
+                break;
+            }
+            case HIVE_RECORD_DELETE:
+            {
+                bstring target = hive_replay_path(app, payload, entry.length);
+                if (unlink((const char*)target->data) != 0)
+                    rmdir((const char*)target->data);
+                bdestroy(target);
+                break;
+            }
+            case HIVE_RECORD_EVENTS:
+            {
+                // Copy the events out so that they are aligned as they were when read.
+                char* events = malloc(entry.length);
+                memcpy(events, payload, entry.length);
+                result->events += hive_inotify_count(events, entry.length);
+                hive_replay_wait(start, first, entry.timestamp, speed);
+                uint64_t dispatch = hive_stats_now();
+                hive_inotify_dispatch(app, events, entry.length);
+                hive_sched_drain(app);
+                hive_histogram_record(&result->dispatch, hive_stats_now() - dispatch);
+                result->batches++;
+                free(events);
+                break;
+            }
+        }
+    }
+    result->elapsed = hive_stats_now() - start;
+    bool complete = offset == length;
+    bdestroy(recording);
+    return complete;
+}
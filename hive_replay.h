@@ -0,0 +1,23 @@
+#ifndef __HIVE_REPLAY_H
+#define __HIVE_REPLAY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <bstrlib.h>
+#include "hive_app.h"
+#include "hive_stats.h"
+
+///
+/// @brief The outcome of replaying a recording.
+///
+struct hive_replay_result
+{
+    uint64_t batches; ///< The number of event buffers that were dispatched.
+    uint64_t events; ///< The number of events that were dispatched.
+    uint64_t elapsed; ///< The wall time of the whole replay in nanoseconds.
+    struct hive_histogram dispatch; ///< The time taken to dispatch each buffer.
+};
+
+bool hive_replay(app_t* app, bstring path, double speed, struct hive_replay_result* result);
+
+#endif
@@ -0,0 +1,687 @@
+///
+/// @file
+/// @brief Resynchronises with the source directory after inotify loses events.
+///
+/// When the kernel event queue overflows, every change that happened during
+/// the overflow is lost.  Rather than rebuilding every output, configd keeps
+/// an index of the last known state (device, inode, size, modification time
+/// and, once known, content hash) of every source file.  A resync walks the
+/// source tree, compares every file against the index on a pool of threads,
+/// and then hands only the files that were created, changed or deleted to
+/// the usual callbacks.  The watch backend is also told about every
+/// directory, so that inotify can watch directories that were created
+/// during the overflow.  The stat polling backend is built on the same
+/// comparison.
+///
+/// The index is kept sorted by path, so that lookups are a binary search and
+/// comparing a scan against it is a single merge.
+///
+
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "hive_resync.h"
+#include "hive_cache.h"
+#include "hive_ignore.h"
+#include "hive_watch.h"
+#include "hive_stats.h"
+#include "hive_trace.h"
+
+#define HIVE_RESYNC_UNCHANGED 0 ///< The file matches the index.
+#define HIVE_RESYNC_CHANGED 1 ///< The file is new or differs from the index.
+#define HIVE_RESYNC_GONE 2 ///< The file disappeared (or is not a regular file).
+
+#define HIVE_RESYNC_SETTLE 20000000 ///< How long after it's modification time a status is trusted (in nanoseconds).
+#define HIVE_RESYNC_THREADS_MAX 8 ///< The largest number of threads that files are checked on.
+#define HIVE_RESYNC_FILES_PER_THREAD 256 ///< Fewer files than this are not worth another thread.
+
+///
+/// @brief The files and directories found by walking the source tree.
+///
+struct hive_resync_scan
+{
+    struct hive_resync_entry* files; ///< The files (anything that is not a directory).
+    size_t count; ///< The number of files.
+    size_t capacity; ///< The allocated number of files.
+    bstring* directories; ///< The directories, including the source directory itself.
+    size_t directory_count; ///< The number of directories.
+    size_t directory_capacity; ///< The allocated number of directories.
+};
+
+///
+/// @brief A range of scanned files that is checked on a single thread.
+///
+struct hive_resync_worker
+{
+    app_t* app; ///< The application, whose index is only read.
+    struct hive_resync_entry* files; ///< The first file to check.
+    size_t count; ///< The number of files to check.
+    bool hash; ///< Whether to hash files whose status changed.
+    pthread_t thread; ///< The thread that is checking the files.
+};
+
+///
+/// @internal
+/// @brief Orders index entries by path.
+///
+int hive_resync_compare(const void* a, const void* b)
+{
+    return bstrcmp(((const struct hive_resync_entry*)a)->path, ((const struct hive_resync_entry*)b)->path);
+}
+
+///
+/// @internal
+/// @brief Orders directory paths.
+///
+int hive_resync_compare_directory(const void* a, const void* b)
+{
+    return bstrcmp(*(const bstring*)a, *(const bstring*)b);
+}
+
+///
+/// @internal
+/// @brief Finds the position of a path in the index.
+///
+/// @param app The application.
+/// @param path The path to find.
+/// @param found Set to whether the path is in the index.
+/// @return The position of the entry, or where it would be inserted.
+///
+size_t hive_resync_position(app_t* app, bstring path, bool* found)
+{
+    size_t low = 0;
+    size_t high = app->resync.count;
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        int result = bstrcmp(path, app->resync.entries[middle].path);
+        if (result == 0)
+        {
+            *found = true;
+            return middle;
+        }
+        else if (result < 0)
+            high = middle;
+        else
+            low = middle + 1;
+    }
+    *found = false;
+    return low;
+}
+
+///
+/// @internal
+/// @brief Copies the file status into an index entry.
+///
+void hive_resync_status(struct hive_resync_entry* entry, struct stat* st)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    entry->device = st->st_dev;
+    entry->inode = st->st_ino;
+    entry->size = st->st_size;
+    entry->mtime_sec = st->st_mtim.tv_sec;
+    entry->mtime_nsec = st->st_mtim.tv_nsec;
+    entry->seen_sec = now.tv_sec;
+    entry->seen_nsec = now.tv_nsec;
+}
+
+///
+/// @internal
+/// @brief Returns whether a file's status can be trusted to mean that it is unchanged.
+///
+/// As with the cache, a file that was modified in the same instant that it's
+/// status was taken may have been modified again without changing it.
+/// Modification times come from a clock that only ticks every few
+/// milliseconds, so the status must have been taken at least
+/// HIVE_RESYNC_SETTLE after the modification time.
+///
+bool hive_resync_status_matches(struct hive_resync_entry* known, struct hive_resync_entry* current)
+{
+    if (known->device != current->device || known->inode != current->inode ||
+        known->size != current->size || known->mtime_sec != current->mtime_sec ||
+        known->mtime_nsec != current->mtime_nsec)
+        return false;
+    int64_t settled = (known->seen_sec - known->mtime_sec) * 1000000000 + (known->seen_nsec - known->mtime_nsec);
+    return settled > HIVE_RESYNC_SETTLE;
+}
+
+///
+/// @internal
+/// @brief Hashes the content of a file.
+///
+bool hive_resync_hash(bstring path, uint64_t* hash)
+{
+    FILE* file = fopen((const char*)path->data, "rb");
+    if (file == NULL)
+        return false;
+    bstring content = bread((bNread)fread, file);
+    fclose(file);
+    if (content == NULL)
+        return false;
+    *hash = hive_cache_hash(content->data, blength(content));
+    bdestroy(content);
+    return true;
+}
+
+///
+/// @internal
+/// @brief Compares a single scanned file against the index.
+///
+/// This only reads the index, so it is safe to call from several threads at
+/// once.
+///
+void hive_resync_check(app_t* app, struct hive_resync_entry* file, bool hash)
+{
+    struct stat st;
+    if (stat((const char*)file->path->data, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        file->state = HIVE_RESYNC_GONE;
+        return;
+    }
+    hive_resync_status(file, &st);
+    bool found;
+    size_t position = hive_resync_position(app, file->path, &found);
+    struct hive_resync_entry* known = found ? &app->resync.entries[position] : NULL;
+    if (known != NULL && hive_resync_status_matches(known, file))
+    {
+        file->hash = known->hash;
+        file->hashed = known->hashed;
+        file->state = HIVE_RESYNC_UNCHANGED;
+        return;
+    }
+    file->state = HIVE_RESYNC_CHANGED;
+    if (!hash || !hive_resync_hash(file->path, &file->hash))
+        return;
+    file->hashed = true;
+    if (known != NULL && known->hashed && known->hash == file->hash)
+        file->state = HIVE_RESYNC_UNCHANGED;
+}
+
+///
+/// @internal
+/// @brief Checks a range of scanned files on a worker thread.
+///
+void* hive_resync_worker_run(void* argument)
+{
+    struct hive_resync_worker* worker = argument;
+    for (size_t i = 0; i < worker->count; i++)
+        hive_resync_check(worker->app, &worker->files[i], worker->hash);
+    return NULL;
+}
+
+///
+/// @internal
+/// @brief Compares every scanned file against the index, in parallel.
+///
+void hive_resync_check_all(app_t* app, struct hive_resync_entry* files, size_t count, bool hash)
+{
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t threads = processors < 1 ? 1 : (size_t)processors;
+    if (threads > HIVE_RESYNC_THREADS_MAX)
+        threads = HIVE_RESYNC_THREADS_MAX;
+    if (threads > count / HIVE_RESYNC_FILES_PER_THREAD)
+        threads = count / HIVE_RESYNC_FILES_PER_THREAD;
+    if (threads <= 1)
+    {
+        for (size_t i = 0; i < count; i++)
+            hive_resync_check(app, &files[i], hash);
+        return;
+    }
+
+    // Split the files evenly; if a thread cannot be started, it's range is
+    // checked on this thread instead.
+    struct hive_resync_worker workers[HIVE_RESYNC_THREADS_MAX];
+    bool started[HIVE_RESYNC_THREADS_MAX];
+    size_t offset = 0;
+    for (size_t i = 0; i < threads; i++)
+    {
+        size_t share = count / threads + (i < count % threads ? 1 : 0);
+        workers[i].app = app;
+        workers[i].files = files + offset;
+        workers[i].count = share;
+        workers[i].hash = hash;
+        started[i] = pthread_create(&workers[i].thread, NULL, hive_resync_worker_run, &workers[i]) == 0;
+        if (!started[i])
+            hive_resync_worker_run(&workers[i]);
+        offset += share;
+    }
+    for (size_t i = 0; i < threads; i++)
+        if (started[i])
+            pthread_join(workers[i].thread, NULL);
+}
+
+///
+/// @internal
+/// @brief Recursively collects the files and directories under a directory.
+///
+/// Ignored files and directories are left out.
+///
+void hive_resync_walk(app_t* app, struct hive_resync_scan* scan, bstring path)
+{
+    if (scan->directory_count == scan->directory_capacity)
+    {
+        scan->directory_capacity = scan->directory_capacity == 0 ? 64 : scan->directory_capacity * 2;
+        scan->directories = realloc(scan->directories, scan->directory_capacity * sizeof(bstring));
+    }
+    scan->directories[scan->directory_count++] = bstrcpy(path);
+    DIR* dir = opendir((const char*)path->data);
+    if (!dir) return;
+    while (true)
+    {
+        struct dirent* entry = readdir(dir);
+        if (!entry) break;
+        if (strcmp(entry->d_name, "..") == 0 ||
+            strcmp(entry->d_name, ".") == 0)
+            continue;
+        bstring child = bstrcpy(path);
+        bconchar(child, '/');
+        bcatcstr(child, entry->d_name);
+        bool directory = entry->d_type == DT_DIR;
+        if (entry->d_type == DT_UNKNOWN)
+        {
+            struct stat st;
+            directory = lstat((const char*)child->data, &st) == 0 && S_ISDIR(st.st_mode);
+        }
+        if (directory)
+        {
+            if (!hive_ignore_path(app, child, true))
+                hive_resync_walk(app, scan, child);
+            bdestroy(child);
+            continue;
+        }
+        if (hive_ignore_path(app, child, false))
+        {
+            bdestroy(child);
+            continue;
+        }
+        if (scan->count == scan->capacity)
+        {
+            scan->capacity = scan->capacity == 0 ? 256 : scan->capacity * 2;
+            scan->files = realloc(scan->files, scan->capacity * sizeof(struct hive_resync_entry));
+        }
+        memset(&scan->files[scan->count], 0, sizeof(struct hive_resync_entry));
+        scan->files[scan->count++].path = child;
+    }
+    closedir(dir);
+}
+
+///
+/// @internal
+/// @brief Walks the source tree and compares every file against the index.
+///
+/// The scanned files are sorted by path on return.
+///
+void hive_resync_scan(app_t* app, struct hive_resync_scan* scan, bool hash)
+{
+    memset(scan, 0, sizeof(struct hive_resync_scan));
+    hive_resync_walk(app, scan, app->source.path);
+    qsort(scan->files, scan->count, sizeof(struct hive_resync_entry), hive_resync_compare);
+    qsort(scan->directories, scan->directory_count, sizeof(bstring), hive_resync_compare_directory);
+    hive_resync_check_all(app, scan->files, scan->count, hash);
+}
+
+///
+/// @internal
+/// @brief Replaces the index with the files of a scan that still exist.
+///
+/// Ownership of the paths in the scan passes to the index.
+///
+void hive_resync_replace(app_t* app, struct hive_resync_scan* scan)
+{
+    for (size_t i = 0; i < app->resync.count; i++)
+        bdestroy(app->resync.entries[i].path);
+    free(app->resync.entries);
+    size_t count = 0;
+    for (size_t i = 0; i < scan->count; i++)
+    {
+        if (scan->files[i].state == HIVE_RESYNC_GONE)
+            bdestroy(scan->files[i].path);
+        else
+            scan->files[count++] = scan->files[i];
+    }
+    app->resync.entries = scan->files;
+    app->resync.count = count;
+    app->resync.capacity = scan->capacity;
+    for (size_t i = 0; i < scan->directory_count; i++)
+        bdestroy(scan->directories[i]);
+    free(scan->directories);
+}
+
+///
+/// @brief Builds the index from the current state of the source tree.
+///
+/// This must be called once the source directory is being watched, so that
+/// any change after the index is built is seen as an event.
+///
+/// @param app The application.
+///
+void hive_resync_init(app_t* app)
+{
+    struct hive_resync_scan scan;
+    app->resync.entries = NULL;
+    app->resync.count = 0;
+    app->resync.capacity = 0;
+    hive_resync_scan(app, &scan, false);
+    hive_resync_replace(app, &scan);
+}
+
+///
+/// @internal
+/// @brief Inserts an empty entry for a path into the index.
+///
+/// @return The new entry.
+///
+struct hive_resync_entry* hive_resync_insert(app_t* app, size_t position, bstring path)
+{
+    if (app->resync.count == app->resync.capacity)
+    {
+        app->resync.capacity = app->resync.capacity == 0 ? 256 : app->resync.capacity * 2;
+        app->resync.entries = realloc(app->resync.entries, app->resync.capacity * sizeof(struct hive_resync_entry));
+    }
+    memmove(&app->resync.entries[position + 1], &app->resync.entries[position],
+            (app->resync.count - position) * sizeof(struct hive_resync_entry));
+    memset(&app->resync.entries[position], 0, sizeof(struct hive_resync_entry));
+    app->resync.entries[position].path = bstrcpy(path);
+    app->resync.count++;
+    return &app->resync.entries[position];
+}
+
+///
+/// @brief Adds an entry to the index for every new file in a batch at once.
+///
+/// Inserting the files of a big batch (such as the files of an extracted
+/// archive, or of a new directory) into the sorted index one at a time
+/// moves the rest of the index each time.  Instead the new paths are
+/// collected, sorted and merged into the index in a single pass, as empty
+/// entries that are filled in when each change is handled.
+///
+/// @param app The application.
+/// @param batch The changes that are about to be handled.
+///
+void hive_resync_reserve(app_t* app, struct hive_watch_batch* batch)
+{
+    bstring* paths = malloc((batch->count + 1) * sizeof(bstring));
+    size_t count = 0;
+    for (size_t i = 0; i < batch->count; i++)
+    {
+        struct hive_watch_event* event = &batch->events[i];
+        bool found;
+        if (event->type != HIVE_WATCH_UPDATED && event->type != HIVE_WATCH_DISCOVERED)
+            continue;
+        hive_resync_position(app, event->path, &found);
+        if (!found)
+            paths[count++] = event->path;
+    }
+    if (count < 2)
+    {
+        // A single insert is no slower than a merge.
+        free(paths);
+        return;
+    }
+    qsort(paths, count, sizeof(bstring), hive_resync_compare_directory);
+    size_t unique = 1;
+    for (size_t i = 1; i < count; i++)
+        if (bstrcmp(paths[i], paths[unique - 1]) != 0)
+            paths[unique++] = paths[i];
+
+    // Merge from the back, so that every entry moves at most once.
+    if (app->resync.count + unique > app->resync.capacity)
+    {
+        while (app->resync.count + unique > app->resync.capacity)
+            app->resync.capacity = app->resync.capacity == 0 ? 256 : app->resync.capacity * 2;
+        app->resync.entries = realloc(app->resync.entries, app->resync.capacity * sizeof(struct hive_resync_entry));
+    }
+    size_t i = app->resync.count;
+    size_t j = unique;
+    size_t k = app->resync.count + unique;
+    while (j > 0)
+    {
+        if (i > 0 && bstrcmp(app->resync.entries[i - 1].path, paths[j - 1]) > 0)
+            app->resync.entries[--k] = app->resync.entries[--i];
+        else
+        {
+            memset(&app->resync.entries[--k], 0, sizeof(struct hive_resync_entry));
+            app->resync.entries[k].path = bstrcpy(paths[--j]);
+        }
+    }
+    app->resync.count += unique;
+    free(paths);
+}
+
+///
+/// @internal
+/// @brief Removes an entry from the index.
+///
+void hive_resync_erase(app_t* app, size_t position)
+{
+    bdestroy(app->resync.entries[position].path);
+    memmove(&app->resync.entries[position], &app->resync.entries[position + 1],
+            (app->resync.count - position - 1) * sizeof(struct hive_resync_entry));
+    app->resync.count--;
+}
+
+///
+/// @brief Updates the index after an event for a single file.
+///
+/// @param app The application.
+/// @param path The path of the file.
+/// @param exists Whether the event means that the file exists (as opposed to being deleted).
+///
+void hive_resync_note(app_t* app, bstring path, bool exists)
+{
+    struct stat st;
+    bool found;
+    size_t position = hive_resync_position(app, path, &found);
+    if (exists && stat((const char*)path->data, &st) == 0 && S_ISREG(st.st_mode))
+    {
+        struct hive_resync_entry* entry = found ? &app->resync.entries[position] : hive_resync_insert(app, position, path);
+        hive_resync_status(entry, &st);
+        entry->hashed = false;
+        entry->discovered = false;
+    }
+    else if (found)
+        hive_resync_erase(app, position);
+}
+
+///
+/// @brief Updates the index for a file that was created or modified, unless it is a repeat.
+///
+/// A file that is found by scanning a new directory will often also be
+/// reported by events that were queued while the directory was scanned.
+/// Such a file is marked as discovered, and a later change for it is only
+/// a repeat if the file still has exactly the status it had when it was
+/// discovered (so the content that was handled is the current content).
+///
+/// @param app The application.
+/// @param path The path of the file.
+/// @param discovered Whether the change comes from scanning a new directory.
+/// @return Whether the change should be handled.
+///
+bool hive_resync_changed(app_t* app, bstring path, bool discovered)
+{
+    struct stat st;
+    bool found;
+    size_t position = hive_resync_position(app, path, &found);
+    if (stat((const char*)path->data, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        // It has already gone again; let the callbacks deal with it as before.
+        if (found)
+            hive_resync_erase(app, position);
+        return true;
+    }
+    struct hive_resync_entry current;
+    hive_resync_status(&current, &st);
+    if (found)
+    {
+        struct hive_resync_entry* entry = &app->resync.entries[position];
+        if ((discovered || entry->discovered) && hive_resync_status_matches(entry, &current))
+            return false;
+    }
+    struct hive_resync_entry* entry = found ? &app->resync.entries[position] : hive_resync_insert(app, position, path);
+    hive_resync_status(entry, &st);
+    entry->hashed = false;
+    entry->discovered = discovered;
+    return true;
+}
+
+///
+/// @brief Filters the files found in a new directory down to those that are not already known.
+///
+/// The files are checked against the index in parallel; files that are in
+/// the index with a trusted, identical status have already been handled
+/// through their own events.
+///
+/// @param app The application.
+/// @param files The HIVE_WATCH_DISCOVERED changes for every file that was found.
+/// @param batch The batch to add the changes that should be handled to.
+///
+void hive_resync_discover(app_t* app, struct hive_watch_batch* files, struct hive_watch_batch* batch)
+{
+    struct hive_resync_entry* entries = calloc(files->count, sizeof(struct hive_resync_entry));
+    for (size_t i = 0; i < files->count; i++)
+        entries[i].path = files->events[i].path;
+    hive_resync_check_all(app, entries, files->count, false);
+    for (size_t i = 0; i < files->count; i++)
+        if (entries[i].state == HIVE_RESYNC_CHANGED)
+            hive_watch_batch_add(batch, HIVE_WATCH_DISCOVERED, entries[i].path);
+    free(entries);
+}
+
+///
+/// @brief Finds the files in a directory that was created or moved into the
+///        source tree, for backends that can not watch it before it is filled.
+///
+/// As with hive_resync_discover, files that are already known with the same
+/// status are left out.
+///
+/// @param app The application.
+/// @param path The path of the directory.
+/// @param batch The batch to add a HIVE_WATCH_DISCOVERED change to for every new file.
+///
+void hive_resync_discover_tree(app_t* app, bstring path, struct hive_watch_batch* batch)
+{
+    struct hive_resync_scan scan;
+    memset(&scan, 0, sizeof(struct hive_resync_scan));
+    hive_resync_walk(app, &scan, path);
+    hive_resync_check_all(app, scan.files, scan.count, false);
+    for (size_t i = 0; i < scan.count; i++)
+    {
+        if (scan.files[i].state == HIVE_RESYNC_CHANGED)
+            hive_watch_batch_add(batch, HIVE_WATCH_DISCOVERED, scan.files[i].path);
+        bdestroy(scan.files[i].path);
+    }
+    free(scan.files);
+    for (size_t i = 0; i < scan.directory_count; i++)
+        bdestroy(scan.directories[i]);
+    free(scan.directories);
+}
+
+///
+/// @brief Removes every file beneath a directory that was moved out of the
+///        source tree (or away within it) from the index.
+///
+/// No event is reported for the files inside a directory that is moved, so
+/// a HIVE_WATCH_DELETED change is added for each of them.  The files are
+/// contiguous in the sorted index, so they are removed all at once.
+///
+/// @param app The application.
+/// @param path The old path of the directory.
+/// @param batch The batch to add the changes to.
+///
+void hive_resync_forget_tree(app_t* app, bstring path, struct hive_watch_batch* batch)
+{
+    bool found;
+    bstring prefix = bstrcpy(path);
+    bconchar(prefix, '/');
+    size_t start = hive_resync_position(app, prefix, &found);
+    size_t end = start;
+    while (end < app->resync.count && bstrncmp(app->resync.entries[end].path, prefix, blength(prefix)) == 0)
+    {
+        hive_watch_batch_add(batch, HIVE_WATCH_DELETED, app->resync.entries[end].path);
+        bdestroy(app->resync.entries[end].path);
+        end++;
+    }
+    memmove(&app->resync.entries[start], &app->resync.entries[end],
+            (app->resync.count - end) * sizeof(struct hive_resync_entry));
+    app->resync.count -= end - start;
+    bdestroy(prefix);
+}
+
+///
+/// @brief Compares the source tree against the index and collects the differences.
+///
+/// The backend is told about every directory that exists (so that it can
+/// watch new ones), the index is updated, and a change is added to the
+/// batch for every file that was deleted, created or changed since the
+/// index was last updated.
+///
+/// @param app The application.
+/// @param batch The batch to add changes to.
+/// @return The number of files in the source tree.
+///
+size_t hive_resync_collect(app_t* app, struct hive_watch_batch* batch)
+{
+    struct hive_resync_scan scan;
+    hive_resync_scan(app, &scan, true);
+    if (app->source.backend != NULL && app->source.backend->rescan != NULL)
+        app->source.backend->rescan(app, scan.directories, scan.directory_count);
+
+    // Merge the scan with the index; both are sorted by path.
+    size_t i = 0;
+    size_t j = 0;
+    while (i < app->resync.count || j < scan.count)
+    {
+        if (j < scan.count && scan.files[j].state == HIVE_RESYNC_GONE)
+        {
+            j++;
+            continue;
+        }
+        int result;
+        if (i >= app->resync.count)
+            result = 1;
+        else if (j >= scan.count)
+            result = -1;
+        else
+            result = bstrcmp(app->resync.entries[i].path, scan.files[j].path);
+        if (result < 0)
+        {
+            hive_watch_batch_add(batch, HIVE_WATCH_DELETED, app->resync.entries[i].path);
+            i++;
+            continue;
+        }
+        if (scan.files[j].state == HIVE_RESYNC_CHANGED)
+            hive_watch_batch_add(batch, HIVE_WATCH_UPDATED, scan.files[j].path);
+        if (result == 0)
+            i++;
+        j++;
+    }
+
+    size_t total = scan.count;
+    hive_resync_replace(app, &scan);
+    return total;
+}
+
+///
+/// @brief Resynchronises with the source tree after events have been lost.
+///
+/// @param app The application.
+///
+void hive_resync(app_t* app)
+{
+    hive_trace_begin("hive_resync", NULL);
+    uint64_t start = hive_stats_now();
+    struct hive_watch_batch batch;
+    memset(&batch, 0, sizeof(batch));
+    size_t total = hive_resync_collect(app, &batch);
+    printf("resynchronised %zu files (%zu changed or deleted) in %.1f ms\n",
+           total, batch.count, (hive_stats_now() - start) / 1000000.0);
+    hive_watch_dispatch(app, &batch);
+    hive_watch_batch_clear(&batch);
+    hive_trace_end("hive_resync");
+}
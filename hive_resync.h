@@ -0,0 +1,39 @@
+#ifndef __HIVE_RESYNC_H
+#define __HIVE_RESYNC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <bstrlib.h>
+#include "hive_app.h"
+#include "hive_watch.h"
+
+///
+/// @brief The last known state of a single source file.
+///
+struct hive_resync_entry
+{
+    bstring path; ///< The path of the file.
+    uint64_t device; ///< The device the file lives on.
+    uint64_t inode; ///< The inode of the file.
+    uint64_t size; ///< The size of the file in bytes.
+    int64_t mtime_sec; ///< The modification time of the file (seconds).
+    int64_t mtime_nsec; ///< The modification time of the file (nanoseconds).
+    int64_t seen_sec; ///< When the status was taken (seconds).
+    int64_t seen_nsec; ///< When the status was taken (nanoseconds).
+    uint64_t hash; ///< The FNV-1a hash of the content, if hashed is set.
+    bool hashed; ///< Whether the content has been hashed.
+    bool discovered; ///< Whether the file was found by scanning a new directory, and no event for it has been handled since.
+    int state; ///< Scratch state used while resynchronising.
+};
+
+void hive_resync_init(app_t* app);
+void hive_resync_note(app_t* app, bstring path, bool exists);
+bool hive_resync_changed(app_t* app, bstring path, bool discovered);
+void hive_resync_reserve(app_t* app, struct hive_watch_batch* batch);
+void hive_resync_discover(app_t* app, struct hive_watch_batch* files, struct hive_watch_batch* batch);
+void hive_resync_discover_tree(app_t* app, bstring path, struct hive_watch_batch* batch);
+void hive_resync_forget_tree(app_t* app, bstring path, struct hive_watch_batch* batch);
+size_t hive_resync_collect(app_t* app, struct hive_watch_batch* batch);
+void hive_resync(app_t* app);
+
+#endif
@@ -0,0 +1,329 @@
+///
+/// @file
+/// @brief Orders regenerations by the priority of their outputs.
+///
+/// Changes are queued by priority class rather than handled in the order
+/// they arrived, so that during a large burst (such as a checkout) outputs
+/// like hosts and resolv.conf are not stuck behind hundreds of others.  The
+/// classes share regeneration time with deficit round robin: each round, a
+/// class may spend up to it's weight in quanta before the next class runs,
+/// so lower classes are slowed down but never starved.  A file that is
+/// changed again while it is queued keeps it's place.
+///
+/// The priority file has one rule per line, "<class> <pattern>", where the
+/// class is critical, normal or bulk and the pattern is matched against the
+/// output name with fnmatch.  The last matching rule wins; outputs that no
+/// rule matches are normal.
+///
+
+#include <fnmatch.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hive_sched.h"
+#include "hive_path.h"
+#include "hive_trace.h"
+
+///
+/// @brief The name, weight and deadline (in milliseconds) of each class.
+///
+static const struct
+{
+    const char* name;
+    int weight;
+    int deadline;
+} hive_sched_classes[HIVE_SCHED_CLASSES] =
+{
+    { "critical", 16, 10 },
+    { "normal", 4, 100 },
+    { "bulk", 1, 1000 },
+};
+
+///
+/// @brief The rules that are in effect before the priority file is read.
+///
+static const char* hive_sched_defaults[] =
+{
+    "critical hosts",
+    "critical resolv.conf",
+};
+
+///
+/// @internal
+/// @brief Parses a "<class> <pattern>" rule and appends it.
+///
+/// @return Whether the rule could be parsed.
+///
+bool hive_sched_add_rule(app_t* app, const char* line)
+{
+    const char* space = strchr(line, ' ');
+    if (space == NULL)
+        return false;
+    int priority = -1;
+    for (int i = 0; i < HIVE_SCHED_CLASSES; i++)
+        if ((size_t)(space - line) == strlen(hive_sched_classes[i].name) &&
+            strncmp(line, hive_sched_classes[i].name, space - line) == 0)
+            priority = i;
+    while (*space == ' ')
+        space++;
+    if (priority < 0 || *space == '\0')
+        return false;
+    if (app->sched.rule_count == app->sched.rule_capacity)
+    {
+        app->sched.rule_capacity = app->sched.rule_capacity == 0 ? 16 : app->sched.rule_capacity * 2;
+        app->sched.rules = realloc(app->sched.rules, app->sched.rule_capacity * sizeof(struct hive_sched_rule));
+    }
+    app->sched.rules[app->sched.rule_count].pattern = bfromcstr(space);
+    app->sched.rules[app->sched.rule_count].priority = priority;
+    app->sched.rule_count++;
+    return true;
+}
+
+///
+/// @brief Initializes the scheduler and reads the priority file.
+///
+/// app->sched.path is the priority file, or NULL if there is none.
+///
+/// @param app The application.
+///
+void hive_sched_init(app_t* app)
+{
+    app->sched.classes = calloc(HIVE_SCHED_CLASSES, sizeof(struct hive_sched_class));
+    for (int i = 0; i < HIVE_SCHED_CLASSES; i++)
+    {
+        app->sched.classes[i].name = hive_sched_classes[i].name;
+        app->sched.classes[i].quantum = (int64_t)hive_sched_classes[i].weight * HIVE_SCHED_QUANTUM;
+        app->sched.classes[i].deadline = (uint64_t)hive_sched_classes[i].deadline * 1000000;
+    }
+    app->sched.classes[0].deficit = app->sched.classes[0].quantum;
+    app->sched.current = 0;
+    app->sched.pending = 0;
+    app->sched.rules = NULL;
+    app->sched.rule_count = 0;
+    app->sched.rule_capacity = 0;
+    app->sched.updated = NULL;
+    app->sched.deleted = NULL;
+    for (size_t i = 0; i < sizeof(hive_sched_defaults) / sizeof(hive_sched_defaults[0]); i++)
+        hive_sched_add_rule(app, hive_sched_defaults[i]);
+    if (app->sched.path == NULL)
+        return;
+
+    FILE* file = fopen((const char*)app->sched.path->data, "r");
+    if (file == NULL)
+    {
+        fprintf(stderr, "unable to read priorities: %s\n", app->sched.path->data);
+        return;
+    }
+    char line[PATH_MAX];
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        size_t length = strlen(line);
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r' || line[length - 1] == ' '))
+            line[--length] = '\0';
+        if (length == 0 || line[0] == '#')
+            continue;
+        if (!hive_sched_add_rule(app, line))
+            fprintf(stderr, "invalid priority rule: %s\n", line);
+    }
+    fclose(file);
+}
+
+///
+/// @brief Returns the priority class of an output.
+///
+/// @param app The application.
+/// @param name The name of the output, relative to the active directory.
+/// @return The class, one of the HIVE_SCHED_* constants.
+///
+int hive_sched_classify(app_t* app, bstring name)
+{
+    for (size_t i = app->sched.rule_count; i > 0; i--)
+        if (fnmatch((const char*)app->sched.rules[i - 1].pattern->data, (const char*)name->data, FNM_PATHNAME) == 0)
+            return app->sched.rules[i - 1].priority;
+    return HIVE_SCHED_NORMAL;
+}
+
+///
+/// @internal
+/// @brief Queues a source file, or updates it if it is already queued.
+///
+void hive_sched_enqueue(app_t* app, bstring path, bool deleted)
+{
+    struct hive_path_info* info = hive_path_lookup(app, path);
+    if (info == NULL)
+        return;
+    if (info->queued != NULL)
+    {
+        info->queued->deleted = deleted;
+        return;
+    }
+    struct hive_sched_item* item = malloc(sizeof(struct hive_sched_item));
+    item->path = bstrcpy(path);
+    item->deleted = deleted;
+    item->queued = hive_stats_now();
+    item->next = NULL;
+    struct hive_sched_class* class = &app->sched.classes[info->priority];
+    if (class->tail == NULL)
+        class->head = item;
+    else
+        class->tail->next = item;
+    class->tail = item;
+    info->queued = item;
+    app->sched.pending++;
+}
+
+///
+/// @brief Queues a source file that was created or updated.
+///
+/// This is the callback that the watch backends call; the file is handled
+/// by hive_sched_poll.
+///
+/// @param app The application.
+/// @param path The path of the file.
+///
+void hive_sched_updated(app_t* app, bstring path)
+{
+    hive_sched_enqueue(app, path, false);
+}
+
+///
+/// @brief Queues a source file that was deleted.
+///
+/// @param app The application.
+/// @param path The path of the file.
+///
+void hive_sched_deleted(app_t* app, bstring path)
+{
+    hive_sched_enqueue(app, path, true);
+}
+
+///
+/// @internal
+/// @brief Handles queued files, fairly between classes, until the budget runs out.
+///
+/// @param app The application.
+/// @param budget How long to run for, in nanoseconds, or 0 to run until the queues are empty.
+///
+void hive_sched_run(app_t* app, uint64_t budget)
+{
+    if (app->sched.pending == 0)
+        return;
+    hive_trace_begin("hive_sched_run", NULL);
+    uint64_t start = hive_stats_now();
+    while (app->sched.pending > 0)
+    {
+        struct hive_sched_class* class = &app->sched.classes[app->sched.current];
+        if (class->head == NULL || class->deficit <= 0)
+        {
+            // An empty class can not save up time for later.
+            if (class->head == NULL)
+                class->deficit = 0;
+            app->sched.current = (app->sched.current + 1) % HIVE_SCHED_CLASSES;
+            class = &app->sched.classes[app->sched.current];
+            if (class->head != NULL)
+                class->deficit += class->quantum;
+            continue;
+        }
+
+        // Take the file off the queue before handling it, so that changes made
+        // while it is being handled queue it again.
+        struct hive_sched_item* item = class->head;
+        class->head = item->next;
+        if (class->head == NULL)
+            class->tail = NULL;
+        app->sched.pending--;
+        struct hive_path_info* info = hive_path_lookup(app, item->path);
+        if (info != NULL && info->queued == item)
+            info->queued = NULL;
+
+        uint64_t now = hive_stats_now();
+        if (app->enable_stats)
+            hive_histogram_record(&class->delay, now - item->queued);
+        if (now - item->queued > class->deadline)
+            class->missed++;
+        if (item->deleted && app->sched.deleted != NULL)
+            app->sched.deleted(app, item->path);
+        else if (!item->deleted && app->sched.updated != NULL)
+            app->sched.updated(app, item->path);
+        class->deficit -= (int64_t)(hive_stats_now() - now);
+        bdestroy(item->path);
+        free(item);
+
+        if (budget > 0 && hive_stats_now() - start >= budget)
+            break;
+    }
+    hive_trace_end("hive_sched_run");
+}
+
+///
+/// @brief Handles queued files for up to HIVE_SCHED_BUDGET, so that new changes are not delayed for long.
+///
+/// @param app The application.
+///
+void hive_sched_poll(app_t* app)
+{
+    hive_sched_run(app, HIVE_SCHED_BUDGET);
+}
+
+///
+/// @brief Handles every queued file.
+///
+/// @param app The application.
+///
+void hive_sched_drain(app_t* app)
+{
+    hive_sched_run(app, 0);
+}
+
+///
+/// @brief Writes how long files waited in each class, and how many were late.
+///
+/// @param app The application.
+/// @param file The file to write to.
+///
+void hive_sched_dump(app_t* app, FILE* file)
+{
+    if (app->sched.classes == NULL)
+        return;
+    bool header = false;
+    for (int i = 0; i < HIVE_SCHED_CLASSES; i++)
+    {
+        struct hive_sched_class* class = &app->sched.classes[i];
+        if (class->delay.count == 0)
+            continue;
+        if (!header)
+            fprintf(file, "(queueing delay)\n");
+        header = true;
+        hive_stats_dump_row(file, class->name, &class->delay, 1000.0);
+    }
+    for (int i = 0; i < HIVE_SCHED_CLASSES; i++)
+    {
+        struct hive_sched_class* class = &app->sched.classes[i];
+        if (class->missed > 0)
+            fprintf(file, "%-8s %10llu later than %llu ms\n", class->name,
+                    (unsigned long long)class->missed, (unsigned long long)(class->deadline / 1000000));
+    }
+}
+
+///
+/// @brief Sets the callback function for when a queued file was created or updated.
+///
+/// @param app The main application.
+/// @param updated The callback function.
+///
+void hive_sched_set_callback_updated(app_t* app, void (*updated)(app_t* app, bstring path))
+{
+    app->sched.updated = updated;
+}
+
+///
+/// @brief Sets the callback function for when a queued file was deleted.
+///
+/// @param app The main application.
+/// @param deleted The callback function.
+///
+void hive_sched_set_callback_deleted(app_t* app, void (*deleted)(app_t* app, bstring path))
+{
+    app->sched.deleted = deleted;
+}
@@ -0,0 +1,64 @@
+#ifndef __HIVE_SCHED_H
+#define __HIVE_SCHED_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <bstrlib.h>
+#include "hive_app.h"
+#include "hive_stats.h"
+
+#define HIVE_SCHED_CRITICAL 0 ///< Outputs that everything else depends on, such as hosts.
+#define HIVE_SCHED_NORMAL 1 ///< Outputs that no rule mentions.
+#define HIVE_SCHED_BULK 2 ///< Outputs that can wait.
+#define HIVE_SCHED_CLASSES 3 ///< The number of priority classes.
+
+#define HIVE_SCHED_QUANTUM 1000000 ///< The regeneration time (in nanoseconds) a class of weight 1 gets per round.
+#define HIVE_SCHED_BUDGET 20000000 ///< How long (in nanoseconds) a poll regenerates for before checking for changes again.
+
+///
+/// @brief A source file that is waiting to be handled.
+///
+struct hive_sched_item
+{
+    bstring path; ///< The path of the source file.
+    bool deleted; ///< Whether the file was deleted (rather than updated) most recently.
+    uint64_t queued; ///< When the file was first queued.
+    struct hive_sched_item* next; ///< The next file in the same class.
+};
+
+///
+/// @brief A priority class, with it's queue and statistics.
+///
+struct hive_sched_class
+{
+    const char* name; ///< The name used in the priority file and the stats dump.
+    int64_t quantum; ///< The regeneration time the class gets per round.
+    uint64_t deadline; ///< How long a file may wait before it counts as late.
+    int64_t deficit; ///< The regeneration time the class has left in this round.
+    struct hive_sched_item* head; ///< The file that has waited the longest.
+    struct hive_sched_item* tail; ///< The file that was queued last.
+    struct hive_histogram delay; ///< How long files waited to be handled.
+    uint64_t missed; ///< How many files waited longer than the deadline.
+};
+
+///
+/// @brief A rule that puts the outputs matching a pattern into a class.
+///
+struct hive_sched_rule
+{
+    bstring pattern; ///< The pattern (for fnmatch), matched against the output name.
+    int priority; ///< The class, one of the HIVE_SCHED_* constants.
+};
+
+void hive_sched_init(app_t* app);
+int hive_sched_classify(app_t* app, bstring name);
+void hive_sched_updated(app_t* app, bstring path);
+void hive_sched_deleted(app_t* app, bstring path);
+void hive_sched_poll(app_t* app);
+void hive_sched_drain(app_t* app);
+void hive_sched_dump(app_t* app, FILE* file);
+void hive_sched_set_callback_updated(app_t* app, void (*updated)(app_t* app, bstring path));
+void hive_sched_set_callback_deleted(app_t* app, void (*deleted)(app_t* app, bstring path));
+
+#endif
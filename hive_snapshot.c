@@ -0,0 +1,327 @@
+///
+/// @file
+/// @brief Publishes configuration snapshots to shared memory.
+///
+/// Every time a document is committed or removed, the full set of documents
+/// is encoded into a binary object tree and published into a POSIX shared
+/// memory segment, so that clients can resolve configuration values without
+/// making any system calls.  The layout of the segment is described in
+/// hive_snapshot_format.h.
+///
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "hive_snapshot.h"
+#include "hive_binary.h"
+
+#define HIVE_SNAPSHOT_HEADER_SIZE ((sizeof(struct hive_snapshot_header) + HIVE_SNAPSHOT_ALIGN - 1) / HIVE_SNAPSHOT_ALIGN * HIVE_SNAPSHOT_ALIGN)
+#define HIVE_SNAPSHOT_INITIAL_SIZE (64 * 1024)
+
+///
+/// @brief A committed document that is included in every snapshot.
+///
+struct hive_snapshot_document
+{
+    ///
+    /// @brief The name of the document (the output path relative to the active directory).
+    ///
+    bstring name;
+    
+    ///
+    /// @brief The parsed content of the document (owned by the parsed source cache).
+    ///
+    struct object* root;
+};
+
+///
+/// @brief Finds an element in the document list based on name.
+///
+/// @param el The current element that is being found.
+/// @param key The name of the document.
+///
+int hive_snapshot_document_seeker(const void* el, const void* key)
+{
+    return biseq(((struct hive_snapshot_document*)el)->name, (const_bstring)key);
+}
+
+///
+/// @internal
+/// @brief Resizes the shared memory segment and remaps it.
+///
+/// @param app The application.
+/// @param size The new size of the segment.
+/// @return Whether the segment could be resized.
+///
+bool hive_snapshot_resize(app_t* app, size_t size)
+{
+    if (ftruncate(app->snapshot.fd, size) != 0)
+    {
+        perror("snapshot: ftruncate");
+        return false;
+    }
+    void* base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, app->snapshot.fd, 0);
+    if (base == MAP_FAILED)
+    {
+        perror("snapshot: mmap");
+        return false;
+    }
+    if (app->snapshot.base != NULL)
+        munmap(app->snapshot.base, app->snapshot.size);
+    app->snapshot.base = base;
+    app->snapshot.size = size;
+    atomic_store_explicit(&((struct hive_snapshot_header*)base)->size, size, memory_order_release);
+    return true;
+}
+
+///
+/// @internal
+/// @brief Marks the segment of a previous run as retired, so that it's clients
+///        open the new one.
+///
+/// @param fd The descriptor of the previous segment.
+///
+void hive_snapshot_retire(int fd)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct hive_snapshot_header))
+        return;
+    struct hive_snapshot_header* header = mmap(NULL, sizeof(struct hive_snapshot_header), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (header == MAP_FAILED)
+        return;
+    if (header->magic == HIVE_SNAPSHOT_MAGIC)
+        atomic_store_explicit(&header->retired, 1, memory_order_release);
+    munmap(header, sizeof(struct hive_snapshot_header));
+}
+
+///
+/// @brief Creates the shared memory segment that snapshots are published in.
+///
+/// The segment is named by app->snapshot.name and is recreated from
+/// scratch, so that clients never observe the state of a previous run.
+/// Once it exists, the segment of the previous run (if any) is retired, so
+/// that clients which still map it open the new one rather than keep
+/// reading stale snapshots.
+///
+/// @param app The application.
+/// @return Whether the segment was created.
+///
+bool hive_snapshot_init(app_t* app)
+{
+    list_init(&app->snapshot.documents);
+    list_attributes_seeker(&app->snapshot.documents, hive_snapshot_document_seeker);
+    app->snapshot.base = NULL;
+    app->snapshot.size = 0;
+    
+    int previous = shm_open((const char*)app->snapshot.name->data, O_RDWR, 0);
+    shm_unlink((const char*)app->snapshot.name->data);
+    app->snapshot.fd = shm_open((const char*)app->snapshot.name->data, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (app->snapshot.fd < 0)
+    {
+        perror("snapshot: shm_open");
+        if (previous >= 0)
+            close(previous);
+        return false;
+    }
+    if (!hive_snapshot_resize(app, HIVE_SNAPSHOT_INITIAL_SIZE))
+    {
+        close(app->snapshot.fd);
+        shm_unlink((const char*)app->snapshot.name->data);
+        if (previous >= 0)
+            close(previous);
+        return false;
+    }
+    
+    // The segment is zero filled, so both slots start out empty.
+    struct hive_snapshot_header* header = app->snapshot.base;
+    header->magic = HIVE_SNAPSHOT_MAGIC;
+    header->version = HIVE_SNAPSHOT_VERSION;
+    if (previous >= 0)
+    {
+        hive_snapshot_retire(previous);
+        close(previous);
+    }
+    return true;
+}
+
+///
+/// @brief Commits the content of a document, replacing any previous content.
+///
+/// @param app The application.
+/// @param name The name of the document.  This is copied.
+/// @param root The content of the document.  This is borrowed and must remain valid
+///             until the document is replaced or removed.
+///
+void hive_snapshot_set_document(app_t* app, bstring name, struct object* root)
+{
+    struct hive_snapshot_document* document = list_seek(&app->snapshot.documents, name);
+    if (document == NULL)
+    {
+        document = malloc(sizeof(struct hive_snapshot_document));
+        document->name = bstrcpy(name);
+        document->root = NULL;
+        list_append(&app->snapshot.documents, document);
+    }
+    document->root = root;
+    hive_snapshot_publish(app);
+}
+
+///
+/// @brief Removes a document from the snapshot.
+///
+/// @param app The application.
+/// @param name The name of the document.
+///
+void hive_snapshot_remove_document(app_t* app, bstring name)
+{
+    struct hive_snapshot_document* document = list_seek(&app->snapshot.documents, name);
+    if (document == NULL)
+        return;
+    list_delete(&app->snapshot.documents, document);
+    bdestroy(document->name);
+    free(document);
+    hive_snapshot_publish(app);
+}
+
+///
+/// @brief Stops the documents that borrow a tree from using it, before it is freed.
+///
+/// Several outputs (such as those declared by a manifest) can share one
+/// source, and so one tree.  When the source is parsed again while
+/// rendering one of them, the others still borrow the old tree until they
+/// are rendered in turn, so they are moved to the new tree.  Documents are
+/// removed if there is no new tree.
+///
+/// @param app The application.
+/// @param old The tree that is about to be freed.
+/// @param root The tree that replaces it, or NULL.
+///
+void hive_snapshot_release(app_t* app, struct object* old, struct object* root)
+{
+    list_t stale;
+    list_init(&stale);
+    list_iterator_start(&app->snapshot.documents);
+    while (list_iterator_hasnext(&app->snapshot.documents))
+    {
+        struct hive_snapshot_document* document = list_iterator_next(&app->snapshot.documents);
+        if (document->root != old)
+            continue;
+        if (root != NULL)
+            document->root = root;
+        else
+            list_append(&stale, document);
+    }
+    list_iterator_stop(&app->snapshot.documents);
+    if (list_size(&stale) > 0)
+    {
+        list_iterator_start(&stale);
+        while (list_iterator_hasnext(&stale))
+        {
+            struct hive_snapshot_document* document = list_iterator_next(&stale);
+            list_delete(&app->snapshot.documents, document);
+            bdestroy(document->name);
+            free(document);
+        }
+        list_iterator_stop(&stale);
+        hive_snapshot_publish(app);
+    }
+    list_destroy(&stale);
+}
+
+///
+/// @internal
+/// @brief Encodes all of the committed documents into a single binary object tree.
+///
+/// The documents are wrapped in a temporary map that borrows their content.
+///
+bstring hive_snapshot_encode(app_t* app)
+{
+    struct object wrapper;
+    wrapper.type = OBJECT_TYPE_MAP;
+    wrapper.hash = 0;
+    list_init(&wrapper.map);
+    list_iterator_start(&app->snapshot.documents);
+    while (list_iterator_hasnext(&app->snapshot.documents))
+    {
+        struct hive_snapshot_document* document = list_iterator_next(&app->snapshot.documents);
+        struct map_entry* entry = malloc(sizeof(struct map_entry));
+        entry->key = malloc(sizeof(struct object));
+        entry->key->type = OBJECT_TYPE_STRING;
+        entry->key->hash = 0;
+        entry->key->string = document->name;
+        entry->value = document->root;
+        list_append(&wrapper.map, entry);
+    }
+    list_iterator_stop(&app->snapshot.documents);
+    
+    bstring result = hive_binary_encode(&wrapper);
+    
+    list_iterator_start(&wrapper.map);
+    while (list_iterator_hasnext(&wrapper.map))
+    {
+        struct map_entry* entry = list_iterator_next(&wrapper.map);
+        free(entry->key);
+        free(entry);
+    }
+    list_iterator_stop(&wrapper.map);
+    list_destroy(&wrapper.map);
+    return result;
+}
+
+///
+/// @brief Publishes the committed documents as a new snapshot.
+///
+/// The snapshot is written into the inactive slot, in a region that does
+/// not overlap the active snapshot, and then made active.  Readers of the
+/// active snapshot are never disturbed; readers that are still looking at
+/// the inactive slot observe the sequence change and retry.
+///
+/// @param app The application.
+///
+void hive_snapshot_publish(app_t* app)
+{
+    if (app->snapshot.base == NULL)
+        return;
+    bstring data = hive_snapshot_encode(app);
+    size_t length = blength(data);
+    
+    struct hive_snapshot_header* header = app->snapshot.base;
+    uint32_t active = atomic_load_explicit(&header->active, memory_order_relaxed);
+    uint64_t active_offset = atomic_load_explicit(&header->slots[active].offset, memory_order_relaxed);
+    uint64_t active_length = atomic_load_explicit(&header->slots[active].length, memory_order_relaxed);
+    
+    // Place the new snapshot before the active one if it fits, otherwise after it.
+    size_t offset = HIVE_SNAPSHOT_HEADER_SIZE;
+    if (active_length != 0 && offset + length > active_offset)
+        offset = (active_offset + active_length + HIVE_SNAPSHOT_ALIGN - 1) / HIVE_SNAPSHOT_ALIGN * HIVE_SNAPSHOT_ALIGN;
+    if (offset + length > app->snapshot.size)
+    {
+        size_t size = app->snapshot.size * 2;
+        while (size < offset + length)
+            size *= 2;
+        if (!hive_snapshot_resize(app, size))
+        {
+            fprintf(stderr, "snapshot: unable to publish %zu bytes\n", length);
+            bdestroy(data);
+            return;
+        }
+        header = app->snapshot.base;
+    }
+    
+    // Rewrite the inactive slot under its sequence counter, then flip.
+    struct hive_snapshot_slot* slot = &header->slots[active ^ 1];
+    uint64_t sequence = atomic_load_explicit(&slot->sequence, memory_order_relaxed);
+    atomic_store_explicit(&slot->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy((char*)app->snapshot.base + offset, data->data, length);
+    atomic_store_explicit(&slot->offset, offset, memory_order_relaxed);
+    atomic_store_explicit(&slot->length, length, memory_order_relaxed);
+    atomic_store_explicit(&slot->sequence, sequence + 2, memory_order_release);
+    atomic_store_explicit(&header->active, active ^ 1, memory_order_release);
+    
+    bdestroy(data);
+}
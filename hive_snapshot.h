@@ -0,0 +1,15 @@
+#ifndef __HIVE_SNAPSHOT_H
+#define __HIVE_SNAPSHOT_H
+
+#include <bstrlib.h>
+#include "hive_app.h"
+#include "hive_object.h"
+#include "hive_snapshot_format.h"
+
+bool hive_snapshot_init(app_t* app);
+void hive_snapshot_set_document(app_t* app, bstring name, struct object* root);
+void hive_snapshot_remove_document(app_t* app, bstring name);
+void hive_snapshot_release(app_t* app, struct object* old, struct object* root);
+void hive_snapshot_publish(app_t* app);
+
+#endif
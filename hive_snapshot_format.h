@@ -0,0 +1,56 @@
+///
+/// @file
+/// @brief Describes the shared memory segment that configuration snapshots are published in.
+///
+/// The segment starts with a struct hive_snapshot_header, followed by the
+/// data of up to two snapshots.  Each snapshot is a binary object tree (see
+/// hive_binary_format.h) whose root is a map from document name to the
+/// document's content.  Snapshots are immutable once published; the daemon
+/// writes a new snapshot into the inactive slot and then flips the active
+/// slot, so readers never block.  Each slot is guarded by a sequence counter
+/// that is odd while the slot is being written, which lets readers detect
+/// (and retry) a read that overlapped a rewrite of the slot.
+///
+/// When configd restarts, it publishes into a new segment under the same
+/// name and then sets the retired flag of the old one, which clients that
+/// still map the old segment must check so that they open the new one.
+///
+/// This header deliberately depends only on the C standard library so that
+/// it can be shared with the client library.
+///
+
+#ifndef __HIVE_SNAPSHOT_FORMAT_H
+#define __HIVE_SNAPSHOT_FORMAT_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define HIVE_SNAPSHOT_MAGIC 0x50534643 ///< The magic number at the start of the segment ("CFSP").
+#define HIVE_SNAPSHOT_VERSION 1 ///< The current version of the segment layout.
+#define HIVE_SNAPSHOT_ALIGN 64 ///< The alignment of snapshot data within the segment.
+#define HIVE_SNAPSHOT_DEFAULT_NAME "/configd" ///< The default POSIX shared memory name.
+
+///
+/// @brief Describes where a single snapshot lives within the segment.
+///
+struct hive_snapshot_slot
+{
+    _Atomic uint64_t sequence; ///< Odd while the slot is being rewritten.
+    _Atomic uint64_t offset; ///< The offset of the snapshot data from the start of the segment.
+    _Atomic uint64_t length; ///< The length of the snapshot data, or 0 if there is none.
+};
+
+///
+/// @brief The header at the start of the shared memory segment.
+///
+struct hive_snapshot_header
+{
+    uint32_t magic; ///< Always HIVE_SNAPSHOT_MAGIC.
+    uint32_t version; ///< Always HIVE_SNAPSHOT_VERSION.
+    _Atomic uint64_t size; ///< The current size of the segment; readers must remap if this grows.
+    _Atomic uint32_t active; ///< The index of the slot that holds the latest snapshot.
+    _Atomic uint32_t retired; ///< Set once a newer segment has replaced this one; readers must open it again.
+    struct hive_snapshot_slot slots[2]; ///< The two snapshot slots.
+};
+
+#endif
@@ -0,0 +1,266 @@
+///
+/// @file
+/// @brief Records the latency of each stage of regenerating an output.
+///
+/// Every output has a histogram per stage (see the HIVE_STAGE_* constants).
+/// Sending SIGUSR1 to configd dumps all of the histograms to stderr, and to
+/// app->stats.path if it is set.
+///
+
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "hive_ignore.h"
+#include "hive_sched.h"
+#include "hive_stats.h"
+
+static const char* hive_stats_stage_names[HIVE_STAGE_COUNT] =
+{
+    "parse",
+    "convert",
+    "load",
+    "compile",
+    "apply",
+    "write",
+    "total",
+};
+
+///
+/// @internal
+/// @brief Set by the SIGUSR1 handler when a dump has been requested.
+///
+static volatile sig_atomic_t hive_stats_dump_requested = 0;
+
+///
+/// @internal
+/// @brief Handles SIGUSR1 by requesting a dump on the next poll.
+///
+void hive_stats_signal(int signal)
+{
+    hive_stats_dump_requested = 1;
+}
+
+///
+/// @brief Finds an element in the output statistics list based on output path.
+///
+/// @param el The current element that is being found.
+/// @param key The path of the output.
+///
+int hive_stats_output_seeker(const void* el, const void* key)
+{
+    return biseq(((struct hive_stats_output*)el)->output, (const_bstring)key);
+}
+
+///
+/// @brief Initializes statistics and installs the SIGUSR1 handler.
+///
+/// app->stats.path must already be set to the file to dump statistics to,
+/// or NULL to only dump them to stderr.
+///
+/// @param app The application.
+///
+void hive_stats_init(app_t* app)
+{
+    list_init(&app->stats.outputs);
+    list_attributes_seeker(&app->stats.outputs, hive_stats_output_seeker);
+    app->stats.wakeup_events = calloc(1, sizeof(struct hive_histogram));
+    app->stats.wakeup_reads = calloc(1, sizeof(struct hive_histogram));
+    signal(SIGUSR1, hive_stats_signal);
+}
+
+///
+/// @brief Returns the current monotonic time in nanoseconds.
+///
+uint64_t hive_stats_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+///
+/// @brief Gets the statistics of an output, creating them if needed.
+///
+/// @param app The application.
+/// @param output The path of the output.
+/// @return The statistics, or NULL if statistics are disabled.
+///
+struct hive_stats_output* hive_stats_output(app_t* app, bstring output)
+{
+    if (!app->enable_stats)
+        return NULL;
+    struct hive_stats_output* stats = list_seek(&app->stats.outputs, output);
+    if (stats == NULL)
+    {
+        stats = malloc(sizeof(struct hive_stats_output));
+        memset(stats, 0, sizeof(struct hive_stats_output));
+        stats->output = bstrcpy(output);
+        list_append(&app->stats.outputs, stats);
+    }
+    return stats;
+}
+
+///
+/// @internal
+/// @brief Returns the bucket that a value is recorded in.
+///
+int hive_histogram_bucket(uint64_t value)
+{
+    if (value < (2 << HIVE_HISTOGRAM_SUB_BITS))
+        return (int)value;
+    int exponent = 63 - __builtin_clzll(value);
+    if (exponent > HIVE_HISTOGRAM_MAX_EXPONENT)
+        return HIVE_HISTOGRAM_BUCKETS - 1;
+    int sub = (int)(value >> (exponent - HIVE_HISTOGRAM_SUB_BITS)) & ((1 << HIVE_HISTOGRAM_SUB_BITS) - 1);
+    return (2 << HIVE_HISTOGRAM_SUB_BITS) + (exponent - HIVE_HISTOGRAM_SUB_BITS - 1) * (1 << HIVE_HISTOGRAM_SUB_BITS) + sub;
+}
+
+///
+/// @internal
+/// @brief Returns the largest value that is recorded in a bucket.
+///
+uint64_t hive_histogram_bucket_limit(int bucket)
+{
+    if (bucket < (2 << HIVE_HISTOGRAM_SUB_BITS))
+        return (uint64_t)bucket;
+    bucket -= 2 << HIVE_HISTOGRAM_SUB_BITS;
+    int exponent = bucket / (1 << HIVE_HISTOGRAM_SUB_BITS) + HIVE_HISTOGRAM_SUB_BITS + 1;
+    uint64_t sub = bucket % (1 << HIVE_HISTOGRAM_SUB_BITS);
+    uint64_t width = 1ULL << (exponent - HIVE_HISTOGRAM_SUB_BITS);
+    return (1ULL << exponent) + sub * width + width - 1;
+}
+
+///
+/// @brief Records the latency of a stage.
+///
+/// @param stats The statistics of the output, or NULL if statistics are disabled.
+/// @param stage The stage, one of the HIVE_STAGE_* constants.
+/// @param elapsed The latency in nanoseconds.
+///
+void hive_stats_record(struct hive_stats_output* stats, int stage, uint64_t elapsed)
+{
+    if (stats != NULL)
+        hive_histogram_record(&stats->stages[stage], elapsed);
+}
+
+///
+/// @brief Records a value in a histogram.
+///
+/// @param histogram The histogram.
+/// @param elapsed The value (a latency in nanoseconds).
+///
+void hive_histogram_record(struct hive_histogram* histogram, uint64_t elapsed)
+{
+    if (histogram->count == 0 || elapsed < histogram->min)
+        histogram->min = elapsed;
+    if (elapsed > histogram->max)
+        histogram->max = elapsed;
+    histogram->count++;
+    histogram->total += elapsed;
+    histogram->buckets[hive_histogram_bucket(elapsed)]++;
+}
+
+///
+/// @brief Estimates a percentile of the recorded values.
+///
+/// @param histogram The histogram.
+/// @param percentile The percentile, between 0 and 100.
+/// @return The estimated value, accurate to the precision of the buckets.
+///
+uint64_t hive_histogram_percentile(struct hive_histogram* histogram, double percentile)
+{
+    if (histogram->count == 0)
+        return 0;
+    uint64_t target = (uint64_t)(percentile / 100.0 * histogram->count + 0.5);
+    if (target < 1)
+        target = 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < HIVE_HISTOGRAM_BUCKETS; i++)
+    {
+        seen += histogram->buckets[i];
+        if (seen >= target)
+        {
+            uint64_t limit = hive_histogram_bucket_limit(i);
+            return limit < histogram->max ? limit : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+///
+/// @brief Writes a single histogram as a row of the statistics table.
+///
+void hive_stats_dump_row(FILE* file, const char* name, struct hive_histogram* histogram, double scale)
+{
+    if (histogram == NULL || histogram->count == 0)
+        return;
+    fprintf(file, "%-8s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+            name,
+            (unsigned long long)histogram->count,
+            histogram->min / scale,
+            (double)histogram->total / histogram->count / scale,
+            hive_histogram_percentile(histogram, 50) / scale,
+            hive_histogram_percentile(histogram, 90) / scale,
+            hive_histogram_percentile(histogram, 99) / scale,
+            histogram->max / scale);
+}
+
+///
+/// @brief Writes all of the recorded statistics in a human readable table.
+///
+/// All latencies are in microseconds.  The wake-up rows count the inotify (or
+/// fanotify) events and read() calls that were handled for each wake-up.
+///
+/// @param app The application.
+/// @param file The file to write to.
+///
+void hive_stats_dump(app_t* app, FILE* file)
+{
+    fprintf(file, "%-8s %10s %10s %10s %10s %10s %10s %10s\n",
+            "stage", "count", "min", "mean", "p50", "p90", "p99", "max");
+    if (app->stats.wakeup_events != NULL && app->stats.wakeup_events->count > 0)
+    {
+        fprintf(file, "(event wake-ups)\n");
+        hive_stats_dump_row(file, "events", app->stats.wakeup_events, 1.0);
+        hive_stats_dump_row(file, "reads", app->stats.wakeup_reads, 1.0);
+    }
+    hive_ignore_dump(app, file);
+    hive_sched_dump(app, file);
+    list_iterator_start(&app->stats.outputs);
+    while (list_iterator_hasnext(&app->stats.outputs))
+    {
+        struct hive_stats_output* stats = list_iterator_next(&app->stats.outputs);
+        fprintf(file, "%s\n", (const char*)stats->output->data);
+        for (int i = 0; i < HIVE_STAGE_COUNT; i++)
+            hive_stats_dump_row(file, hive_stats_stage_names[i], &stats->stages[i], 1000.0);
+    }
+    list_iterator_stop(&app->stats.outputs);
+    fflush(file);
+}
+
+///
+/// @brief Dumps statistics if SIGUSR1 has been received since the last poll.
+///
+/// @param app The application.
+///
+void hive_stats_poll(app_t* app)
+{
+    if (!hive_stats_dump_requested)
+        return;
+    hive_stats_dump_requested = 0;
+    hive_stats_dump(app, stderr);
+    if (app->stats.path == NULL)
+        return;
+    bstring temporary = bformat("%s.tmp", (const char*)app->stats.path->data);
+    FILE* file = fopen((const char*)temporary->data, "w");
+    if (file == NULL)
+        fprintf(stderr, "unable to write stats: %s\n", temporary->data);
+    else
+    {
+        hive_stats_dump(app, file);
+        fclose(file);
+        rename((const char*)temporary->data, (const char*)app->stats.path->data);
+    }
+    bdestroy(temporary);
+}
@@ -0,0 +1,57 @@
+#ifndef __HIVE_STATS_H
+#define __HIVE_STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <bstrlib.h>
+#include "hive_app.h"
+
+#define HIVE_STAGE_PARSE 0 ///< Parsing (or fetching the cached parse of) the YAML source.
+#define HIVE_STAGE_CONVERT 1 ///< Building the source document from the object tree (only when it is not pooled).
+#define HIVE_STAGE_LOAD 2 ///< Getting the source document, from the pool or by building it.
+#define HIVE_STAGE_COMPILE 3 ///< Parsing and compiling the stylesheet.
+#define HIVE_STAGE_APPLY 4 ///< Applying the stylesheet (or template or emitter) and serializing the result into memory.
+#define HIVE_STAGE_WRITE 5 ///< Writing the result to the output file (or finding that it is unchanged).
+#define HIVE_STAGE_TOTAL 6 ///< The whole regeneration of the output.
+#define HIVE_STAGE_COUNT 7 ///< The number of stages.
+
+#define HIVE_HISTOGRAM_SUB_BITS 4 ///< Each power of two is split into 2^HIVE_HISTOGRAM_SUB_BITS buckets.
+#define HIVE_HISTOGRAM_MAX_EXPONENT 47 ///< Values of 2^48 ns (about 3 days) or more share the last bucket.
+#define HIVE_HISTOGRAM_BUCKETS ((2 << HIVE_HISTOGRAM_SUB_BITS) + (HIVE_HISTOGRAM_MAX_EXPONENT - HIVE_HISTOGRAM_SUB_BITS) * (1 << HIVE_HISTOGRAM_SUB_BITS))
+
+///
+/// @brief A log-linear histogram of latencies in nanoseconds.
+///
+/// Values are bucketed with a relative precision of 2^-HIVE_HISTOGRAM_SUB_BITS,
+/// in the same way as an HDR histogram, so that recording is a couple of
+/// shifts and an increment.
+///
+struct hive_histogram
+{
+    uint64_t count; ///< The number of recorded values.
+    uint64_t total; ///< The sum of recorded values.
+    uint64_t min; ///< The smallest recorded value.
+    uint64_t max; ///< The largest recorded value.
+    uint32_t buckets[HIVE_HISTOGRAM_BUCKETS]; ///< The number of values recorded in each bucket.
+};
+
+///
+/// @brief The latency histograms of each stage for a single output.
+///
+struct hive_stats_output
+{
+    bstring output; ///< The path of the output.
+    struct hive_histogram stages[HIVE_STAGE_COUNT]; ///< The histogram of each stage.
+};
+
+void hive_stats_init(app_t* app);
+uint64_t hive_stats_now(void);
+struct hive_stats_output* hive_stats_output(app_t* app, bstring output);
+void hive_stats_record(struct hive_stats_output* stats, int stage, uint64_t elapsed);
+void hive_histogram_record(struct hive_histogram* histogram, uint64_t elapsed);
+uint64_t hive_histogram_percentile(struct hive_histogram* histogram, double percentile);
+void hive_stats_dump_row(FILE* file, const char* name, struct hive_histogram* histogram, double scale);
+void hive_stats_dump(app_t* app, FILE* file);
+void hive_stats_poll(app_t* app);
+
+#endif
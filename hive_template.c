@@ -0,0 +1,507 @@
+///
+/// @file
+/// @brief A template language that renders parsed sources directly, without XML.
+///
+/// Templates are plain text with tags between {{ and }}.  The current value
+/// starts as the whole document, and the tags are:
+///
+///   {{each}} ... {{end}}         the block for each item of the current list,
+///                                or each entry of the current map
+///   {{with name}} ... {{end}}    the block for the entry called name in the current map
+///   {{if string|list}} ... {{elif map}} ... {{else}} ... {{end}}
+///                                blocks chosen by the type of the current value
+///                                (nil, number, string, list, map or scalar)
+///   {{key}}                      the key of the current map entry
+///   {{.}}                        the current value, if it is a string or number
+///   {{join ", "}}                the items of the current list (or keys of the
+///                                current map), separated by the given text
+///   {{# comment}}                nothing
+///
+/// A '-' just inside the braces ({{- or -}}) removes the whitespace (including
+/// newlines) before or after the tag.  Templates are compiled once into a flat
+/// list of instructions whose blocks record where they end, and compiled
+/// templates are kept until the file changes.
+///
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hive_template.h"
+#include "hive_cache.h"
+#include "hive_stats.h"
+#include "hive_output.h"
+#include "hive_trace.h"
+
+#define HIVE_TEMPLATE_DEPTH 32 ///< The deepest blocks can be nested.
+
+///
+/// @internal
+/// @brief Appends an instruction.
+///
+/// @return The index of the instruction.
+///
+size_t hive_template_emit(struct hive_template* template, int code, bstring text)
+{
+    if (template->count == template->capacity)
+    {
+        template->capacity = template->capacity == 0 ? 16 : template->capacity * 2;
+        template->ops = realloc(template->ops, template->capacity * sizeof(struct hive_template_op));
+    }
+    struct hive_template_op* op = &template->ops[template->count];
+    op->code = code;
+    op->jump = 0;
+    op->types = 0;
+    op->text = text;
+    return template->count++;
+}
+
+///
+/// @internal
+/// @brief Parses a list of types such as "string|list".
+///
+/// @return The types as a mask of 1 << OBJECT_TYPE_*, or 0 if a type is unknown.
+///
+int hive_template_parse_types(bstring types)
+{
+    static const struct
+    {
+        const char* name;
+        int types;
+    } names[] =
+    {
+        { "nil", 1 << OBJECT_TYPE_NIL },
+        { "number", 1 << OBJECT_TYPE_NUMBER },
+        { "string", 1 << OBJECT_TYPE_STRING },
+        { "list", 1 << OBJECT_TYPE_LIST },
+        { "map", 1 << OBJECT_TYPE_MAP },
+        { "scalar", (1 << OBJECT_TYPE_NUMBER) | (1 << OBJECT_TYPE_STRING) },
+    };
+    int result = 0;
+    struct bstrList* parts = bsplit(types, '|');
+    for (int i = 0; i < parts->qty; i++)
+    {
+        int found = 0;
+        btrimws(parts->entry[i]);
+        for (size_t j = 0; j < sizeof(names) / sizeof(names[0]); j++)
+            if (biseqcstr(parts->entry[i], names[j].name))
+                found = names[j].types;
+        if (found == 0)
+        {
+            result = 0;
+            break;
+        }
+        result |= found;
+    }
+    bstrListDestroy(parts);
+    return result;
+}
+
+///
+/// @brief Parses an argument that is either a bare word or a quoted string with \n, \t, \" and \\ escapes.
+///
+/// @return The argument, or NULL if the quotes are unbalanced.
+///
+bstring hive_template_parse_text(bstring argument)
+{
+    if (blength(argument) == 0 || argument->data[0] != '"')
+        return bstrcpy(argument);
+    if (blength(argument) < 2 || argument->data[blength(argument) - 1] != '"')
+        return NULL;
+    bstring result = bfromcstr("");
+    for (int i = 1; i < blength(argument) - 1; i++)
+    {
+        char c = argument->data[i];
+        if (c == '\\' && i + 1 < blength(argument) - 1)
+        {
+            c = argument->data[++i];
+            if (c == 'n')
+                c = '\n';
+            else if (c == 't')
+                c = '\t';
+        }
+        bconchar(result, c);
+    }
+    return result;
+}
+
+///
+/// @internal
+/// @brief Returns the line number of a position in the template, for errors.
+///
+int hive_template_line(bstring source, size_t position)
+{
+    int line = 1;
+    for (size_t i = 0; i < position; i++)
+        if (source->data[i] == '\n')
+            line++;
+    return line;
+}
+
+///
+/// @brief Compiles a template.
+///
+/// @param source The text of the template.
+/// @param name The name of the template, used in error messages.
+/// @return The compiled template, or NULL if it is invalid (the reason is printed).
+///
+struct hive_template* hive_template_compile(bstring source, const char* name)
+{
+    struct hive_template* template = calloc(1, sizeof(struct hive_template));
+    const char* data = (const char*)source->data;
+    size_t length = blength(source);
+    size_t position = 0;
+    size_t blocks[HIVE_TEMPLATE_DEPTH];
+    size_t depth = 0;
+    bool trim = false;
+    const char* error = NULL;
+    size_t tag = 0;
+    while (error == NULL && position < length)
+    {
+        // Find the next tag; everything before it is text.
+        tag = position;
+        while (tag < length && !(data[tag] == '{' && tag + 1 < length && data[tag + 1] == '{'))
+            tag++;
+        bool trim_before = tag + 2 < length && data[tag + 2] == '-';
+        size_t start = position;
+        size_t end = tag;
+        if (trim)
+            while (start < end && isspace((unsigned char)data[start]))
+                start++;
+        if (trim_before)
+            while (end > start && isspace((unsigned char)data[end - 1]))
+                end--;
+        if (end > start)
+            hive_template_emit(template, HIVE_TEMPLATE_TEXT, blk2bstr(data + start, end - start));
+        if (tag >= length)
+            break;
+
+        // Find the end of the tag.
+        size_t close = tag + 2;
+        while (close + 1 < length && !(data[close] == '}' && data[close + 1] == '}'))
+            close++;
+        if (close + 1 >= length)
+        {
+            error = "unterminated tag";
+            break;
+        }
+        size_t inner = tag + 2 + (trim_before ? 1 : 0);
+        size_t inner_end = close;
+        trim = inner_end > inner && data[inner_end - 1] == '-';
+        if (trim)
+            inner_end--;
+        position = close + 2;
+
+        // Split the tag into it's command and argument.
+        bstring command = blk2bstr(data + inner, inner_end > inner ? inner_end - inner : 0);
+        btrimws(command);
+        bstring argument = NULL;
+        int space = bstrchr(command, ' ');
+        if (space != BSTR_ERR)
+        {
+            argument = bmidstr(command, space + 1, blength(command));
+            btrimws(argument);
+            btrunc(command, space);
+        }
+
+        if (blength(command) == 0 || command->data[0] == '#')
+            ;
+        else if (biseqcstr(command, "key"))
+            hive_template_emit(template, HIVE_TEMPLATE_KEY, NULL);
+        else if (biseqcstr(command, "."))
+            hive_template_emit(template, HIVE_TEMPLATE_VALUE, NULL);
+        else if (biseqcstr(command, "join") || biseqcstr(command, "with"))
+        {
+            bstring text = argument == NULL ? NULL : hive_template_parse_text(argument);
+            if (text == NULL)
+                error = "missing or unbalanced argument";
+            else if (command->data[0] == 'j')
+                hive_template_emit(template, HIVE_TEMPLATE_JOIN, text);
+            else if (depth == HIVE_TEMPLATE_DEPTH)
+            {
+                bdestroy(text);
+                error = "blocks are nested too deeply";
+            }
+            else
+                blocks[depth++] = hive_template_emit(template, HIVE_TEMPLATE_WITH, text);
+        }
+        else if (biseqcstr(command, "each"))
+        {
+            if (depth == HIVE_TEMPLATE_DEPTH)
+                error = "blocks are nested too deeply";
+            else
+                blocks[depth++] = hive_template_emit(template, HIVE_TEMPLATE_EACH, NULL);
+        }
+        else if (biseqcstr(command, "if") || biseqcstr(command, "elif"))
+        {
+            bool chained = command->data[0] == 'e';
+            int types = argument == NULL ? 0 : hive_template_parse_types(argument);
+            if (types == 0)
+                error = "unknown type";
+            else if (chained && (depth == 0 || (template->ops[blocks[depth - 1]].code != HIVE_TEMPLATE_IF &&
+                                                template->ops[blocks[depth - 1]].code != HIVE_TEMPLATE_ELIF)))
+                error = "elif without if";
+            else if (!chained && depth == HIVE_TEMPLATE_DEPTH)
+                error = "blocks are nested too deeply";
+            else
+            {
+                size_t index = hive_template_emit(template, chained ? HIVE_TEMPLATE_ELIF : HIVE_TEMPLATE_IF, NULL);
+                template->ops[index].types = types;
+                if (chained)
+                    template->ops[blocks[depth - 1]].jump = index;
+                else
+                    depth++;
+                blocks[depth - 1] = index;
+            }
+        }
+        else if (biseqcstr(command, "else"))
+        {
+            if (depth == 0 || (template->ops[blocks[depth - 1]].code != HIVE_TEMPLATE_IF &&
+                               template->ops[blocks[depth - 1]].code != HIVE_TEMPLATE_ELIF))
+                error = "else without if";
+            else
+            {
+                size_t index = hive_template_emit(template, HIVE_TEMPLATE_ELSE, NULL);
+                template->ops[blocks[depth - 1]].jump = index;
+                blocks[depth - 1] = index;
+            }
+        }
+        else if (biseqcstr(command, "end"))
+        {
+            if (depth == 0)
+                error = "end without a block";
+            else
+                template->ops[blocks[--depth]].jump = hive_template_emit(template, HIVE_TEMPLATE_END, NULL);
+        }
+        else
+            error = "unknown tag";
+        bdestroy(command);
+        bdestroy(argument);
+    }
+    if (error == NULL && depth > 0)
+    {
+        error = "missing end";
+        tag = length;
+    }
+    if (error != NULL)
+    {
+        fprintf(stderr, "%s:%d: %s\n", name, hive_template_line(source, tag), error);
+        hive_template_free(template);
+        return NULL;
+    }
+    return template;
+}
+
+///
+/// @internal
+/// @brief Returns whether an object is one of a set of types.
+///
+bool hive_template_is(struct object* object, int types)
+{
+    return (types & (1 << (object == NULL ? OBJECT_TYPE_NIL : object->type))) != 0;
+}
+
+///
+/// @internal
+/// @brief Runs a range of instructions.
+///
+/// @param template The template.
+/// @param from The first instruction.
+/// @param to The instruction after the last.
+/// @param key The key of the current map entry, or NULL.
+/// @param node The current value.
+/// @param output The text to append to.
+///
+void hive_template_run(struct hive_template* template, size_t from, size_t to, struct object* key, struct object* node, bstring output)
+{
+    size_t pc = from;
+    while (pc < to)
+    {
+        struct hive_template_op* op = &template->ops[pc];
+        switch (op->code)
+        {
+            case HIVE_TEMPLATE_TEXT:
+                bconcat(output, op->text);
+                break;
+            case HIVE_TEMPLATE_KEY:
+                hive_object_write(key, output);
+                break;
+            case HIVE_TEMPLATE_VALUE:
+                hive_object_write(node, output);
+                break;
+            case HIVE_TEMPLATE_JOIN:
+            {
+                if (node == NULL || (node->type != OBJECT_TYPE_LIST && node->type != OBJECT_TYPE_MAP))
+                    break;
+                bool first = true;
+                list_t* list = node->type == OBJECT_TYPE_LIST ? &node->list : &node->map;
+                list_iterator_start(list);
+                while (list_iterator_hasnext(list))
+                {
+                    void* item = list_iterator_next(list);
+                    if (!first)
+                        bconcat(output, op->text);
+                    first = false;
+                    hive_object_write(node->type == OBJECT_TYPE_LIST ? item : ((struct map_entry*)item)->key, output);
+                }
+                list_iterator_stop(list);
+                break;
+            }
+            case HIVE_TEMPLATE_EACH:
+            {
+                if (node != NULL && node->type == OBJECT_TYPE_LIST)
+                {
+                    list_iterator_start(&node->list);
+                    while (list_iterator_hasnext(&node->list))
+                        hive_template_run(template, pc + 1, op->jump, NULL, list_iterator_next(&node->list), output);
+                    list_iterator_stop(&node->list);
+                }
+                else if (node != NULL && node->type == OBJECT_TYPE_MAP)
+                {
+                    list_iterator_start(&node->map);
+                    while (list_iterator_hasnext(&node->map))
+                    {
+                        struct map_entry* entry = list_iterator_next(&node->map);
+                        hive_template_run(template, pc + 1, op->jump, entry->key, entry->value, output);
+                    }
+                    list_iterator_stop(&node->map);
+                }
+                pc = op->jump;
+                break;
+            }
+            case HIVE_TEMPLATE_WITH:
+            {
+                if (node != NULL && node->type == OBJECT_TYPE_MAP)
+                {
+                    struct map_entry* found = NULL;
+                    list_iterator_start(&node->map);
+                    while (found == NULL && list_iterator_hasnext(&node->map))
+                    {
+                        struct map_entry* entry = list_iterator_next(&node->map);
+                        if (entry->key != NULL && entry->key->type == OBJECT_TYPE_STRING && biseq(entry->key->string, op->text))
+                            found = entry;
+                    }
+                    list_iterator_stop(&node->map);
+                    if (found != NULL)
+                        hive_template_run(template, pc + 1, op->jump, found->key, found->value, output);
+                }
+                pc = op->jump;
+                break;
+            }
+            case HIVE_TEMPLATE_IF:
+            {
+                // Find the first branch that matches, run it, then skip to the end.
+                size_t branch = pc;
+                while (template->ops[branch].code != HIVE_TEMPLATE_END && template->ops[branch].code != HIVE_TEMPLATE_ELSE &&
+                       !hive_template_is(node, template->ops[branch].types))
+                    branch = template->ops[branch].jump;
+                if (template->ops[branch].code != HIVE_TEMPLATE_END)
+                    hive_template_run(template, branch + 1, template->ops[branch].jump, key, node, output);
+                while (template->ops[branch].code != HIVE_TEMPLATE_END)
+                    branch = template->ops[branch].jump;
+                pc = branch;
+                break;
+            }
+        }
+        pc++;
+    }
+}
+
+///
+/// @brief Renders a template.
+///
+/// @param template The compiled template.
+/// @param object The parsed source.
+/// @param output The text to append the result to.
+///
+void hive_template_render(struct hive_template* template, struct object* object, bstring output)
+{
+    hive_template_run(template, 0, template->count, NULL, object, output);
+}
+
+///
+/// @brief Frees a compiled template.
+///
+/// @param template The compiled template.
+///
+void hive_template_free(struct hive_template* template)
+{
+    if (template == NULL)
+        return;
+    for (size_t i = 0; i < template->count; i++)
+        bdestroy(template->ops[i].text);
+    free(template->ops);
+    free(template);
+}
+
+///
+/// @brief Initializes the cache of compiled templates.
+///
+/// @param app The application.
+///
+void hive_template_init(app_t* app)
+{
+    list_init(&app->templates.entries);
+}
+
+///
+/// @internal
+/// @brief Compiles the content of a template file, for the cache.
+///
+void* hive_template_parse_file(bstring source, const char* name)
+{
+    return hive_template_compile(source, name);
+}
+
+///
+/// @internal
+/// @brief Frees a compiled template, for the cache.
+///
+void hive_template_release(void* template)
+{
+    hive_template_free(template);
+}
+
+///
+/// @brief Returns the compiled template for a file, compiling it if it is new or has changed.
+///
+/// @param app The application.
+/// @param path The path of the template file.
+/// @return The compiled template (owned by the cache), or NULL if it is missing or invalid.
+///
+struct hive_template* hive_template_load(app_t* app, bstring path)
+{
+    return hive_cache_load_file(&app->templates.entries, path, "template", hive_template_parse_file, hive_template_release);
+}
+
+///
+/// @brief Renders a template and saves the result.
+///
+/// @param app The application.
+/// @param template_path The path of the template.
+/// @param object The parsed source.
+/// @param output_path The path to save the result to.
+/// @param stats The statistics to record the latency of each stage in, or NULL.
+///
+void hive_template_transform_with_path_to_file(app_t* app, bstring template_path, struct object* object, bstring output_path, struct hive_stats_output* stats)
+{
+    uint64_t start = hive_stats_now();
+    hive_trace_begin("hive_template_load", (const char*)template_path->data);
+    struct hive_template* template = hive_template_load(app, template_path);
+    hive_trace_end("hive_template_load");
+    hive_stats_record(stats, HIVE_STAGE_COMPILE, hive_stats_now() - start);
+    if (template == NULL)
+        return;
+    start = hive_stats_now();
+    hive_trace_begin("hive_template_render", NULL);
+    bstring result = hive_output_buffer();
+    hive_template_render(template, object, result);
+    hive_trace_end("hive_template_render");
+    hive_stats_record(stats, HIVE_STAGE_APPLY, hive_stats_now() - start);
+    start = hive_stats_now();
+    hive_trace_begin("hive_output_write", (const char*)output_path->data);
+    hive_output_write(app, output_path, result);
+    hive_trace_end("hive_output_write");
+    hive_stats_record(stats, HIVE_STAGE_WRITE, hive_stats_now() - start);
+}
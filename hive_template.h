@@ -0,0 +1,51 @@
+#ifndef __HIVE_TEMPLATE_H
+#define __HIVE_TEMPLATE_H
+
+#include <stddef.h>
+#include <bstrlib.h>
+#include "hive_app.h"
+#include "hive_object.h"
+
+struct hive_stats_output;
+
+#define HIVE_TEMPLATE_TEXT 0 ///< Writes the text.
+#define HIVE_TEMPLATE_KEY 1 ///< Writes the key of the current map entry.
+#define HIVE_TEMPLATE_VALUE 2 ///< Writes the current value, if it is a string or number.
+#define HIVE_TEMPLATE_JOIN 3 ///< Writes the items of the current list (or keys of the current map), separated by the text.
+#define HIVE_TEMPLATE_EACH 4 ///< Runs the block for each item of the current list or map.
+#define HIVE_TEMPLATE_WITH 5 ///< Runs the block for the entry of the current map whose key is the text.
+#define HIVE_TEMPLATE_IF 6 ///< Runs the block if the current value is one of the types; otherwise jumps to the next branch.
+#define HIVE_TEMPLATE_ELIF 7 ///< Like HIVE_TEMPLATE_IF, for a later branch.
+#define HIVE_TEMPLATE_ELSE 8 ///< Runs the block (only reached if no earlier branch ran).
+#define HIVE_TEMPLATE_END 9 ///< Ends the innermost block.
+
+///
+/// @brief A single instruction of a compiled template.
+///
+struct hive_template_op
+{
+    int code; ///< The instruction, one of the HIVE_TEMPLATE_* constants.
+    size_t jump; ///< For blocks, the index of the matching HIVE_TEMPLATE_END or the next branch.
+    int types; ///< For conditions, the object types (as 1 << OBJECT_TYPE_*) that match.
+    bstring text; ///< The text, separator or key, if the instruction has one.
+};
+
+///
+/// @brief A compiled template.
+///
+struct hive_template
+{
+    struct hive_template_op* ops; ///< The instructions.
+    size_t count; ///< The number of instructions.
+    size_t capacity; ///< The allocated number of instructions.
+};
+
+bstring hive_template_parse_text(bstring argument);
+struct hive_template* hive_template_compile(bstring source, const char* name);
+void hive_template_render(struct hive_template* template, struct object* object, bstring output);
+void hive_template_free(struct hive_template* template);
+void hive_template_init(app_t* app);
+struct hive_template* hive_template_load(app_t* app, bstring path);
+void hive_template_transform_with_path_to_file(app_t* app, bstring template_path, struct object* object, bstring output_path, struct hive_stats_output* stats);
+
+#endif
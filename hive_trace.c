@@ -0,0 +1,256 @@
+///
+/// @file
+/// @brief Records a timeline of events that can be viewed as a Chrome trace.
+///
+/// Each thread records into it's own fixed size ring buffer, so recording
+/// an event never takes a lock or allocates memory; when a buffer is full
+/// the oldest events are overwritten.  Buffers are registered on a
+/// lock-free list the first time a thread records an event.  Sending
+/// SIGUSR2 to configd writes all buffers to app->trace.path in the Chrome
+/// Trace Event JSON format (load it in chrome://tracing or Perfetto).
+///
+/// Event names must be string literals; details are copied (and truncated
+/// to HIVE_TRACE_DETAIL_SIZE) so that they may come from temporaries.
+///
+
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "hive_trace.h"
+
+#define HIVE_TRACE_BUFFER_EVENTS 16384 ///< The number of events kept per thread.
+#define HIVE_TRACE_DETAIL_SIZE 80 ///< The maximum length of an event detail, including the NUL.
+
+///
+/// @brief A single recorded event.
+///
+struct hive_trace_event
+{
+    uint64_t timestamp; ///< The monotonic time of the event in nanoseconds.
+    const char* name; ///< The name of the event (a string literal).
+    char phase; ///< The Chrome trace phase: 'B'egin, 'E'nd or 'i'nstant.
+    char detail[HIVE_TRACE_DETAIL_SIZE]; ///< Additional information about the event.
+};
+
+///
+/// @brief The ring buffer of a single thread.
+///
+struct hive_trace_buffer
+{
+    long tid; ///< The kernel thread ID of the owning thread.
+    _Atomic uint64_t head; ///< The total number of events ever recorded.
+    struct hive_trace_buffer* next; ///< The next registered buffer.
+    struct hive_trace_event events[HIVE_TRACE_BUFFER_EVENTS]; ///< The recorded events.
+};
+
+///
+/// @internal
+/// @brief Whether events are recorded at all.
+///
+static bool hive_trace_enabled = false;
+
+///
+/// @internal
+/// @brief The list of every thread's buffer.
+///
+static _Atomic(struct hive_trace_buffer*) hive_trace_buffers = NULL;
+
+///
+/// @internal
+/// @brief The buffer of the current thread, once it has recorded an event.
+///
+static _Thread_local struct hive_trace_buffer* hive_trace_buffer = NULL;
+
+///
+/// @internal
+/// @brief Set by the SIGUSR2 handler when a flush has been requested.
+///
+static volatile sig_atomic_t hive_trace_flush_requested = 0;
+
+///
+/// @internal
+/// @brief Handles SIGUSR2 by requesting a flush on the next poll.
+///
+void hive_trace_signal(int signal)
+{
+    hive_trace_flush_requested = 1;
+}
+
+///
+/// @brief Initializes tracing and installs the SIGUSR2 handler.
+///
+/// Tracing is only enabled if app->trace.path has been set.
+///
+/// @param app The application.
+///
+void hive_trace_init(app_t* app)
+{
+    hive_trace_enabled = app->trace.path != NULL;
+    if (hive_trace_enabled)
+        signal(SIGUSR2, hive_trace_signal);
+}
+
+///
+/// @brief Returns whether events are recorded, so that callers can skip
+///        building details that would be thrown away.
+///
+/// @return Whether tracing is enabled.
+///
+bool hive_trace_active(void)
+{
+    return hive_trace_enabled;
+}
+
+///
+/// @internal
+/// @brief Records an event into the current thread's buffer.
+///
+void hive_trace_record(char phase, const char* name, const char* detail)
+{
+    if (!hive_trace_enabled)
+        return;
+    struct hive_trace_buffer* buffer = hive_trace_buffer;
+    if (buffer == NULL)
+    {
+        // First event on this thread; register a new buffer.
+        buffer = calloc(1, sizeof(struct hive_trace_buffer));
+        if (buffer == NULL)
+            return;
+        buffer->tid = syscall(SYS_gettid);
+        buffer->next = atomic_load_explicit(&hive_trace_buffers, memory_order_relaxed);
+        while (!atomic_compare_exchange_weak_explicit(&hive_trace_buffers, &buffer->next, buffer,
+                                                      memory_order_release, memory_order_relaxed));
+        hive_trace_buffer = buffer;
+    }
+    
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t head = atomic_load_explicit(&buffer->head, memory_order_relaxed);
+    struct hive_trace_event* event = &buffer->events[head % HIVE_TRACE_BUFFER_EVENTS];
+    event->timestamp = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+    event->name = name;
+    event->phase = phase;
+    if (detail == NULL)
+        event->detail[0] = '\0';
+    else
+    {
+        size_t length = strnlen(detail, HIVE_TRACE_DETAIL_SIZE - 1);
+        memcpy(event->detail, detail, length);
+        event->detail[length] = '\0';
+    }
+    atomic_store_explicit(&buffer->head, head + 1, memory_order_release);
+}
+
+///
+/// @brief Records the start of a span on the current thread.
+///
+/// @param name The name of the span (a string literal).
+/// @param detail Additional information, such as a path, or NULL.
+///
+void hive_trace_begin(const char* name, const char* detail)
+{
+    hive_trace_record('B', name, detail);
+}
+
+///
+/// @brief Records the end of the innermost span on the current thread.
+///
+/// @param name The name of the span (a string literal).
+///
+void hive_trace_end(const char* name)
+{
+    hive_trace_record('E', name, NULL);
+}
+
+///
+/// @brief Records a single point in time on the current thread.
+///
+/// @param name The name of the event (a string literal).
+/// @param detail Additional information, such as a path, or NULL.
+///
+void hive_trace_instant(const char* name, const char* detail)
+{
+    hive_trace_record('i', name, detail);
+}
+
+///
+/// @internal
+/// @brief Writes a string as a JSON string literal.
+///
+void hive_trace_write_string(FILE* file, const char* value)
+{
+    fputc('"', file);
+    for (; *value != '\0'; value++)
+    {
+        if (*value == '"' || *value == '\\')
+            fprintf(file, "\\%c", *value);
+        else if ((unsigned char)*value < 0x20)
+            fprintf(file, "\\u%04x", (unsigned char)*value);
+        else
+            fputc(*value, file);
+    }
+    fputc('"', file);
+}
+
+///
+/// @brief Writes every thread's recorded events as a Chrome trace.
+///
+/// @param path The path of the JSON file to write.
+/// @return Whether the trace was written.
+///
+bool hive_trace_flush(const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if (file == NULL)
+        return false;
+    bool first = true;
+    long pid = getpid();
+    fprintf(file, "{\"traceEvents\":[\n");
+    struct hive_trace_buffer* buffer = atomic_load_explicit(&hive_trace_buffers, memory_order_acquire);
+    for (; buffer != NULL; buffer = buffer->next)
+    {
+        uint64_t head = atomic_load_explicit(&buffer->head, memory_order_acquire);
+        uint64_t tail = head > HIVE_TRACE_BUFFER_EVENTS ? head - HIVE_TRACE_BUFFER_EVENTS : 0;
+        for (uint64_t i = tail; i < head; i++)
+        {
+            struct hive_trace_event* event = &buffer->events[i % HIVE_TRACE_BUFFER_EVENTS];
+            fprintf(file, "%s{\"name\":", first ? "" : ",\n");
+            hive_trace_write_string(file, event->name);
+            fprintf(file, ",\"cat\":\"configd\",\"ph\":\"%c\",\"ts\":%llu.%03llu,\"pid\":%ld,\"tid\":%ld",
+                    event->phase, (unsigned long long)(event->timestamp / 1000),
+                    (unsigned long long)(event->timestamp % 1000), pid, buffer->tid);
+            if (event->phase == 'i')
+                fprintf(file, ",\"s\":\"t\"");
+            if (event->detail[0] != '\0')
+            {
+                fprintf(file, ",\"args\":{\"detail\":");
+                hive_trace_write_string(file, event->detail);
+                fputc('}', file);
+            }
+            fputc('}', file);
+            first = false;
+        }
+    }
+    fprintf(file, "\n]}\n");
+    return fclose(file) == 0;
+}
+
+///
+/// @brief Flushes the trace if SIGUSR2 has been received since the last poll.
+///
+/// @param app The application.
+///
+void hive_trace_poll(app_t* app)
+{
+    if (!hive_trace_flush_requested)
+        return;
+    hive_trace_flush_requested = 0;
+    if (!hive_trace_flush((const char*)app->trace.path->data))
+        fprintf(stderr, "unable to write trace: %s\n", app->trace.path->data);
+}
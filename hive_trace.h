@@ -0,0 +1,15 @@
+#ifndef __HIVE_TRACE_H
+#define __HIVE_TRACE_H
+
+#include <stdbool.h>
+#include "hive_app.h"
+
+void hive_trace_init(app_t* app);
+bool hive_trace_active(void);
+void hive_trace_begin(const char* name, const char* detail);
+void hive_trace_end(const char* name);
+void hive_trace_instant(const char* name, const char* detail);
+bool hive_trace_flush(const char* path);
+void hive_trace_poll(app_t* app);
+
+#endif
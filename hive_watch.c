@@ -0,0 +1,211 @@
+///
+/// @file
+/// @brief Selects the backend that watches the source directory, and dispatches it's changes.
+///
+/// Every backend (inotify, fanotify or stat polling) reports changes as a
+/// batch of updated, deleted, discovered, overflow and rescan events, so that the index used for
+/// resynchronising and the application callbacks are driven the same way
+/// no matter how the changes were found.
+///
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hive_watch.h"
+#include "hive_fanotify.h"
+#include "hive_inotify.h"
+#include "hive_poll.h"
+#include "hive_resync.h"
+#include "hive_stats.h"
+#include "hive_trace.h"
+
+static const struct hive_watch_backend* hive_watch_backends[] =
+{
+    &hive_inotify_backend,
+    &hive_fanotify_backend,
+    &hive_poll_backend,
+};
+
+///
+/// @brief Finds a backend by name.
+///
+/// @param name The name of the backend.
+/// @return The backend, or NULL if there is no such backend.
+///
+const struct hive_watch_backend* hive_watch_find(const char* name)
+{
+    for (size_t i = 0; i < sizeof(hive_watch_backends) / sizeof(hive_watch_backends[0]); i++)
+        if (strcmp(hive_watch_backends[i]->name, name) == 0)
+            return hive_watch_backends[i];
+    return NULL;
+}
+
+///
+/// @brief Starts watching the source directory.
+///
+/// app->source.backend selects the backend (inotify if it is NULL).  If the
+/// backend can not be used, inotify is used instead and app->source.backend
+/// is updated to match.
+///
+/// @param app The application.
+/// @return Whether any backend could be started.
+///
+bool hive_watch_init(app_t* app)
+{
+    if (app->source.backend == NULL)
+        app->source.backend = &hive_inotify_backend;
+    if (app->source.backend->init(app) && app->source.backend->add_root(app, app->source.path))
+        return true;
+    if (app->source.backend == &hive_inotify_backend)
+        return false;
+    fprintf(stderr, "unable to use %s; falling back to inotify\n", app->source.backend->name);
+    app->source.backend->close(app);
+    app->source.backend = &hive_inotify_backend;
+    return app->source.backend->init(app) && app->source.backend->add_root(app, app->source.path);
+}
+
+///
+/// @brief Handles every change that the backend has pending, without blocking.
+///
+/// @param app The application.
+///
+void hive_watch_poll(app_t* app)
+{
+    struct hive_watch_batch batch;
+    memset(&batch, 0, sizeof(batch));
+    app->source.backend->next_batch(app, &batch);
+    if (batch.count == 0)
+        return;
+    hive_watch_dispatch(app, &batch);
+    hive_watch_batch_clear(&batch);
+}
+
+///
+/// @brief Waits until the backend may have changes, or a deadline passes.
+///
+/// Signals (such as the SIGUSR1 and SIGUSR2 dump requests) end the wait
+/// early; one that arrives just before the wait is handled at most
+/// HIVE_WATCH_WAIT_MAX later.  Backends that can not tell when they will
+/// have changes are not waited for.
+///
+/// @param app The application.
+/// @param deadline The latest time to wait until (see hive_stats_now), or 0
+///                 to not wait at all.
+///
+void hive_watch_wait(app_t* app, uint64_t deadline)
+{
+    if (app->source.backend->wakeup == NULL)
+        return;
+    uint64_t now = hive_stats_now();
+    if (deadline > now + HIVE_WATCH_WAIT_MAX * 1000000ULL)
+        deadline = now + HIVE_WATCH_WAIT_MAX * 1000000ULL;
+    struct pollfd descriptor;
+    descriptor.fd = app->source.backend->wakeup(app, &deadline);
+    descriptor.events = POLLIN;
+    descriptor.revents = 0;
+    if (deadline <= now)
+        return;
+    int timeout = (int)((deadline - now + 999999) / 1000000);
+    if (poll(&descriptor, descriptor.fd >= 0 ? 1 : 0, timeout) == -1 && errno != EINTR)
+        fprintf(stderr, "error while using poll()\n");
+}
+
+///
+/// @brief Handles a batch of changes, in order.
+///
+/// @param app The application.
+/// @param batch The changes.
+///
+void hive_watch_dispatch(app_t* app, struct hive_watch_batch* batch)
+{
+    hive_trace_begin("hive_watch_dispatch", NULL);
+    hive_resync_reserve(app, batch);
+    for (size_t i = 0; i < batch->count; i++)
+    {
+        struct hive_watch_event* event = &batch->events[i];
+        switch (event->type)
+        {
+            case HIVE_WATCH_UPDATED:
+            case HIVE_WATCH_DISCOVERED:
+                // Files found in a new directory usually also produce events
+                // of their own; only the first of them is handled.
+                if (!hive_resync_changed(app, event->path, event->type == HIVE_WATCH_DISCOVERED))
+                    break;
+                if (app->source.updated != NULL)
+                    app->source.updated(app, event->path);
+                break;
+            case HIVE_WATCH_DELETED:
+                hive_resync_note(app, event->path, false);
+                if (app->source.deleted != NULL)
+                    app->source.deleted(app, event->path);
+                break;
+            case HIVE_WATCH_OVERFLOW:
+                fprintf(stderr, "%s lost events; resynchronising\n", app->source.backend->name);
+                hive_resync(app);
+                break;
+            case HIVE_WATCH_RESCAN:
+                // Files that are no longer ignored have never been seen, and
+                // files that are now ignored are no longer sources.
+                printf("ignore rules changed; resynchronising\n");
+                hive_resync(app);
+                break;
+        }
+    }
+    hive_trace_end("hive_watch_dispatch");
+}
+
+///
+/// @brief Appends a change to a batch.
+///
+/// @param batch The batch.
+/// @param type The type of change, one of the HIVE_WATCH_* constants.
+/// @param path The path of the file (copied), or NULL for HIVE_WATCH_OVERFLOW and HIVE_WATCH_RESCAN.
+///
+void hive_watch_batch_add(struct hive_watch_batch* batch, int type, bstring path)
+{
+    if (batch->count == batch->capacity)
+    {
+        batch->capacity = batch->capacity == 0 ? 64 : batch->capacity * 2;
+        batch->events = realloc(batch->events, batch->capacity * sizeof(struct hive_watch_event));
+    }
+    batch->events[batch->count].type = type;
+    batch->events[batch->count].path = path == NULL ? NULL : bstrcpy(path);
+    batch->count++;
+}
+
+///
+/// @brief Frees every change in a batch.
+///
+/// @param batch The batch.
+///
+void hive_watch_batch_clear(struct hive_watch_batch* batch)
+{
+    for (size_t i = 0; i < batch->count; i++)
+        bdestroy(batch->events[i].path);
+    free(batch->events);
+    memset(batch, 0, sizeof(struct hive_watch_batch));
+}
+
+///
+/// @brief Sets the callback function for when a YAML file is created or updated.
+///
+/// @param app The main application.
+/// @param updated The callback function.
+///
+void hive_watch_set_callback_updated(app_t* app, void (*updated)(app_t* app, bstring path))
+{
+    app->source.updated = updated;
+}
+
+///
+/// @brief Sets the callback function for when a YAML file is deleted.
+///
+/// @param app The main application.
+/// @param updated The callback function.
+///
+void hive_watch_set_callback_deleted(app_t* app, void (*deleted)(app_t* app, bstring path))
+{
+    app->source.deleted = deleted;
+}
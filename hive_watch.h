@@ -0,0 +1,60 @@
+#ifndef __HIVE_WATCH_H
+#define __HIVE_WATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <bstrlib.h>
+#include "hive_app.h"
+
+#define HIVE_WATCH_UPDATED 0 ///< A file was created or modified.
+#define HIVE_WATCH_DELETED 1 ///< A file was deleted.
+#define HIVE_WATCH_OVERFLOW 2 ///< Events were lost, so the whole tree must be compared.
+#define HIVE_WATCH_DISCOVERED 3 ///< A file was found by scanning a newly created directory.
+#define HIVE_WATCH_RESCAN 4 ///< The ignore rules changed, so the whole tree must be compared.
+#define HIVE_WATCH_WAIT_MAX 1000 ///< The longest time to wait for changes, in milliseconds.
+
+///
+/// @brief A single change reported by a watch backend.
+///
+struct hive_watch_event
+{
+    int type; ///< The type of change, one of the HIVE_WATCH_* constants.
+    bstring path; ///< The path of the file, or NULL for HIVE_WATCH_OVERFLOW and HIVE_WATCH_RESCAN.
+};
+
+///
+/// @brief The changes reported by a watch backend for a single poll.
+///
+struct hive_watch_batch
+{
+    struct hive_watch_event* events; ///< The changes, in the order they happened.
+    size_t count; ///< The number of changes.
+    size_t capacity; ///< The allocated number of changes.
+};
+
+///
+/// @brief A way of finding out about changes to the source directory.
+///
+struct hive_watch_backend
+{
+    const char* name; ///< The name used to select the backend on the command line.
+    bool (*init)(app_t* app); ///< Prepares the backend; returns false if it can not be used.
+    bool (*add_root)(app_t* app, bstring path); ///< Starts watching a directory tree.
+    void (*next_batch)(app_t* app, struct hive_watch_batch* batch); ///< Adds any pending changes to the batch without blocking.
+    void (*rescan)(app_t* app, bstring* directories, size_t count); ///< Optional; told every directory that exists after a full rescan.
+    int (*wakeup)(app_t* app, uint64_t* deadline); ///< Optional; returns the descriptor that is readable while changes are pending (or -1), and lowers the deadline to when changes must next be looked for.
+    void (*close)(app_t* app); ///< Stops watching and releases the backend.
+};
+
+const struct hive_watch_backend* hive_watch_find(const char* name);
+bool hive_watch_init(app_t* app);
+void hive_watch_poll(app_t* app);
+void hive_watch_wait(app_t* app, uint64_t deadline);
+void hive_watch_dispatch(app_t* app, struct hive_watch_batch* batch);
+void hive_watch_batch_add(struct hive_watch_batch* batch, int type, bstring path);
+void hive_watch_batch_clear(struct hive_watch_batch* batch);
+void hive_watch_set_callback_updated(app_t* app, void (*updated)(app_t* app, bstring path));
+void hive_watch_set_callback_deleted(app_t* app, void (*deleted)(app_t* app, bstring path));
+
+#endif
@@ -1,12 +1,26 @@
 #include <assert.h>
 #include <stdbool.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include <libxml/parser.h>
 #include <libxml/tree.h>
 #include <libxslt/xslt.h>
 #include <libxslt/xsltutils.h>
 #include <libxslt/transform.h>
+#include <libxslt/extensions.h>
+#include <libxslt/variables.h>
+#include <libxslt/imports.h>
+#include <libxml/xpathInternals.h>
 #include "hive_object.h"
+#include "hive_index.h"
+#include "hive_output.h"
+#include "hive_records.h"
 #include "hive_xslt.h"
+#include "hive_stats.h"
+#include "hive_trace.h"
 
 bstring hive_xslt_object_to_xml_impl(struct object* object)
 {
@@ -64,6 +78,12 @@ bstring hive_xslt_object_to_xml_impl(struct object* object)
     }
 }
 
+///
+/// @brief Converts an object tree to XML text.
+///
+/// The daemon builds documents directly (see hive_xslt_document); the text
+/// form is for tools and benchmarks.
+///
 bstring hive_xslt_object_to_xml(struct object* object)
 {
     bstring result = bfromcstr("<?xml version=\"1.0\" ?><configuration>");
@@ -74,36 +94,811 @@ bstring hive_xslt_object_to_xml(struct object* object)
     return result;
 }
 
+///
+/// @internal
+/// @brief The dictionary and interned element names of the current thread.
+///
+/// Documents and stylesheets created by a thread share one dictionary, so
+/// each element name is interned once and names in the source documents
+/// are the same pointers as the names in the stylesheet's XPath tests.
+///
+struct hive_xslt_names
+{
+    xmlDictPtr dict; ///< The dictionary, created on first use (and only freed by worker threads).
+    const xmlChar* configuration; ///< The root element.
+    const xmlChar* map; ///< A map.
+    const xmlChar* entry; ///< An entry of a map.
+    const xmlChar* key; ///< The key of an entry.
+    const xmlChar* value; ///< The value of an entry.
+    const xmlChar* list; ///< A list.
+    const xmlChar* string; ///< A string.
+};
+static _Thread_local struct hive_xslt_names hive_xslt_names;
+
+///
+/// @brief Returns the dictionary of the current thread.
+///
+/// @return The dictionary (callers that keep it must take a reference).
+///
+xmlDictPtr hive_xslt_dict()
+{
+    struct hive_xslt_names* names = &hive_xslt_names;
+    if (names->dict == NULL)
+    {
+        names->dict = xmlDictCreate();
+        names->configuration = xmlDictLookup(names->dict, (const xmlChar*)"configuration", -1);
+        names->map = xmlDictLookup(names->dict, (const xmlChar*)"map", -1);
+        names->entry = xmlDictLookup(names->dict, (const xmlChar*)"entry", -1);
+        names->key = xmlDictLookup(names->dict, (const xmlChar*)"key", -1);
+        names->value = xmlDictLookup(names->dict, (const xmlChar*)"value", -1);
+        names->list = xmlDictLookup(names->dict, (const xmlChar*)"list", -1);
+        names->string = xmlDictLookup(names->dict, (const xmlChar*)"string", -1);
+    }
+    return names->dict;
+}
+
+///
+/// @brief Frees the dictionary of the current thread, before a worker thread exits.
+///
+/// Documents and stylesheets that use the dictionary keep it alive until
+/// they are freed.
+///
+void hive_xslt_thread_exit()
+{
+    struct hive_xslt_names* names = &hive_xslt_names;
+    if (names->dict == NULL)
+        return;
+    xmlDictFree(names->dict);
+    memset(names, 0, sizeof(struct hive_xslt_names));
+}
+
+///
+/// @internal
+/// @brief Appends an element with an interned name.
+///
+xmlNodePtr hive_xslt_element(xmlDocPtr doc, xmlNodePtr parent, const xmlChar* name)
+{
+    // The document owns the dictionary, so the name is not copied (or freed).
+    xmlNodePtr node = xmlNewDocNodeEatName(doc, NULL, (xmlChar*)name, NULL);
+    xmlAddChild(parent, node);
+    return node;
+}
+
+void hive_xslt_build(xmlDocPtr doc, xmlNodePtr parent, struct object* object);
+
+///
+/// @internal
+/// @brief Appends the element for an entry of a map.
+///
+void hive_xslt_build_entry(xmlDocPtr doc, xmlNodePtr map, struct map_entry* entry)
+{
+    struct hive_xslt_names* names = &hive_xslt_names;
+    xmlNodePtr child = hive_xslt_element(doc, map, names->entry);
+    hive_xslt_build(doc, hive_xslt_element(doc, child, names->key), entry->key);
+    hive_xslt_build(doc, hive_xslt_element(doc, child, names->value), entry->value);
+}
+
+///
+/// @internal
+/// @brief Appends the elements for an object, in the same shape as hive_xslt_object_to_xml.
+///
+void hive_xslt_build(xmlDocPtr doc, xmlNodePtr parent, struct object* object)
+{
+    struct hive_xslt_names* names = &hive_xslt_names;
+    switch (object->type)
+    {
+        case OBJECT_TYPE_NIL:
+        case OBJECT_TYPE_NUMBER:
+            return;
+        case OBJECT_TYPE_STRING:
+        {
+            xmlNodePtr node = hive_xslt_element(doc, parent, names->string);
+            xmlAddChild(node, xmlNewDocTextLen(doc, object->string->data, blength(object->string)));
+            return;
+        }
+        case OBJECT_TYPE_LIST:
+        {
+            xmlNodePtr node = hive_xslt_element(doc, parent, names->list);
+            HIVE_LIST_FOREACH(&object->list, item)
+                hive_xslt_build(doc, node, item->data);
+            return;
+        }
+        case OBJECT_TYPE_MAP:
+        {
+            xmlNodePtr node = hive_xslt_element(doc, parent, names->map);
+            HIVE_LIST_FOREACH(&object->map, entry)
+                hive_xslt_build_entry(doc, node, entry->data);
+            return;
+        }
+        default:
+            assert(false);
+    }
+}
+
+///
+/// @brief Builds the source document for an object tree, without going through XML text.
+///
+/// @param object The object tree.
+/// @return The document, which uses the dictionary of the current thread.
+///
+xmlDocPtr hive_xslt_object_to_document(struct object* object)
+{
+    xmlDictPtr dict = hive_xslt_dict();
+    xmlDocPtr doc = xmlNewDoc((const xmlChar*)"1.0");
+    doc->dict = dict;
+    xmlDictReference(dict);
+    xmlNodePtr root = xmlNewDocNodeEatName(doc, NULL, (xmlChar*)hive_xslt_names.configuration, NULL);
+    xmlDocSetRootElement(doc, root);
+    hive_xslt_build(doc, root, object);
+    return doc;
+}
+
+///
+/// @internal
+/// @brief Builds a source document for some of the entries of a map, as if the
+///        map only had those entries.
+///
+xmlDocPtr hive_xslt_entries_to_document(struct map_entry** entries, size_t count)
+{
+    xmlDictPtr dict = hive_xslt_dict();
+    xmlDocPtr doc = xmlNewDoc((const xmlChar*)"1.0");
+    doc->dict = dict;
+    xmlDictReference(dict);
+    xmlNodePtr root = xmlNewDocNodeEatName(doc, NULL, (xmlChar*)hive_xslt_names.configuration, NULL);
+    xmlDocSetRootElement(doc, root);
+    xmlNodePtr map = hive_xslt_element(doc, root, hive_xslt_names.map);
+    for (size_t i = 0; i < count; i++)
+        hive_xslt_build_entry(doc, map, entries[i]);
+    return doc;
+}
+
+///
+/// @internal
+/// @brief A source document in the pool.
+///
+struct hive_xslt_document
+{
+    struct object* object; ///< The object tree the document was built from.
+    xmlDocPtr doc; ///< The document.
+};
+
+///
+/// @brief Returns the source document for an object tree, from the pool if it was
+///        built for an earlier transform.
+///
+/// Outputs that share a source (or are regenerated without the source
+/// changing) reuse the same document; the oldest documents are freed once
+/// there are more than HIVE_XSLT_POOL_SIZE.
+///
+/// @param app The application.
+/// @param object The object tree.
+/// @param built Set to whether the document had to be built.
+/// @return The document (owned by the pool).
+///
+xmlDocPtr hive_xslt_document(app_t* app, struct object* object, bool* built)
+{
+    xmlDocPtr doc = NULL;
+    list_iterator_start(&app->documents.entries);
+    while (doc == NULL && list_iterator_hasnext(&app->documents.entries))
+    {
+        struct hive_xslt_document* pooled = list_iterator_next(&app->documents.entries);
+        if (pooled->object == object)
+            doc = pooled->doc;
+    }
+    list_iterator_stop(&app->documents.entries);
+    *built = doc == NULL;
+    if (doc != NULL)
+        return doc;
+
+    struct hive_xslt_document* pooled = malloc(sizeof(struct hive_xslt_document));
+    pooled->object = object;
+    pooled->doc = hive_xslt_object_to_document(object);
+    list_append(&app->documents.entries, pooled);
+    if (list_size(&app->documents.entries) > HIVE_XSLT_POOL_SIZE)
+    {
+        struct hive_xslt_document* oldest = list_extract_at(&app->documents.entries, 0);
+        xmlFreeDoc(oldest->doc);
+        free(oldest);
+    }
+    return pooled->doc;
+}
+
+///
+/// @brief Frees the pooled document for an object tree, which must be done before
+///        the tree is freed.
+///
+/// @param app The application.
+/// @param object The object tree.
+///
+void hive_xslt_release(app_t* app, struct object* object)
+{
+    for (unsigned int i = 0; i < list_size(&app->documents.entries); i++)
+    {
+        struct hive_xslt_document* pooled = list_get_at(&app->documents.entries, i);
+        if (pooled->object != object)
+            continue;
+        list_delete_at(&app->documents.entries, i);
+        xmlFreeDoc(pooled->doc);
+        free(pooled);
+        return;
+    }
+}
+
+///
+/// @brief Appends serialized output to a bstring (the write callback of an xmlOutputBuffer).
+///
+/// @param context The bstring.
+/// @param buffer The output, which is not NUL terminated.
+/// @param len The length of the output.
+/// @return The number of bytes written, or -1 on error.
+///
 int hive_xslt_write_xml_to_bstring(void* context, const char* buffer, int len)
 {
-    bcatcstr(context, buffer);
-    return len;
+    return bcatblk(context, buffer, len) == BSTR_OK ? len : -1;
+}
+
+///
+/// @brief What the cfg: extension functions resolve against during a transform.
+///
+struct hive_xslt_context
+{
+    struct object* root; ///< The parsed source the XML was generated from.
+    struct hive_index* index; ///< The index of root, built on first use.
+    bool used; ///< Whether a cfg: function has looked anything up.
+    struct hive_xslt_shared* shared; ///< The index shared with other threads, or NULL.
+};
+
+///
+/// @brief The index of a source shared by the threads rendering it's records.
+///
+struct hive_xslt_shared
+{
+    pthread_mutex_t lock; ///< Guards index.
+    struct hive_index* index; ///< The index of the source, built by the first thread to need it.
+};
+
+///
+/// @internal
+/// @brief Pops the path argument of a cfg: function and resolves it.
+///
+/// @return The object at the path, or NULL if there is none (or the
+///         arguments were invalid, in which case the error is set).
+///
+struct object* hive_xslt_cfg_resolve(xmlXPathParserContextPtr ctxt)
+{
+    xsltTransformContextPtr transform = xsltXPathGetTransformContext(ctxt);
+    struct hive_xslt_context* context = transform == NULL ? NULL : transform->_private;
+    xmlChar* path = xmlXPathPopString(ctxt);
+    if (path == NULL || context == NULL)
+    {
+        xmlFree(path);
+        return NULL;
+    }
+    context->used = true;
+    if (context->index == NULL && context->shared != NULL)
+    {
+        pthread_mutex_lock(&context->shared->lock);
+        if (context->shared->index == NULL)
+            context->shared->index = hive_index_build(context->root);
+        context->index = context->shared->index;
+        pthread_mutex_unlock(&context->shared->lock);
+    }
+    else if (context->index == NULL)
+        context->index = hive_index_build(context->root);
+    struct object* object = hive_index_resolve(context->index, context->root, (const char*)path, xmlStrlen(path));
+    xmlFree(path);
+    return object;
+}
+
+///
+/// @internal
+/// @brief Appends a string or number, or the items of a list separated by a separator.
+///
+void hive_xslt_cfg_append(struct object* object, const xmlChar* separator, bstring result)
+{
+    if (object == NULL)
+        return;
+    if (object->type != OBJECT_TYPE_LIST)
+        hive_object_write(object, result);
+    else
+    {
+        bool first = true;
+        HIVE_LIST_FOREACH(&object->list, node)
+        {
+            struct object* item = node->data;
+            if (item == NULL || (item->type != OBJECT_TYPE_STRING && item->type != OBJECT_TYPE_NUMBER))
+                continue;
+            if (!first)
+                bcatcstr(result, (const char*)separator);
+            first = false;
+            hive_xslt_cfg_append(item, separator, result);
+        }
+    }
+}
+
+///
+/// @brief cfg:get(path): the string or number at the path, or an empty string.
+///
+void hive_xslt_cfg_get(xmlXPathParserContextPtr ctxt, int nargs)
+{
+    CHECK_ARITY(1);
+    struct object* object = hive_xslt_cfg_resolve(ctxt);
+    bstring result = bfromcstr("");
+    if (object != NULL && object->type != OBJECT_TYPE_LIST)
+        hive_xslt_cfg_append(object, NULL, result);
+    valuePush(ctxt, xmlXPathNewString(result->data));
+    bdestroy(result);
+}
+
+///
+/// @brief cfg:join(path, separator): the items of the list at the path separated by
+///        the separator (or the string or number at the path).
+///
+void hive_xslt_cfg_join(xmlXPathParserContextPtr ctxt, int nargs)
+{
+    CHECK_ARITY(2);
+    xmlChar* separator = xmlXPathPopString(ctxt);
+    struct object* object = hive_xslt_cfg_resolve(ctxt);
+    bstring result = bfromcstr("");
+    hive_xslt_cfg_append(object, separator, result);
+    valuePush(ctxt, xmlXPathNewString(result->data));
+    bdestroy(result);
+    xmlFree(separator);
+}
+
+///
+/// @brief cfg:keys(path): a <key> element for each key of the map at the path (or
+///        each position of the list at the path), in order.
+///
+void hive_xslt_cfg_keys(xmlXPathParserContextPtr ctxt, int nargs)
+{
+    CHECK_ARITY(1);
+    struct object* object = hive_xslt_cfg_resolve(ctxt);
+    xsltTransformContextPtr transform = xsltXPathGetTransformContext(ctxt);
+    xmlXPathObjectPtr result = xmlXPathNewNodeSet(NULL);
+    if (object == NULL || transform == NULL ||
+        (object->type != OBJECT_TYPE_MAP && object->type != OBJECT_TYPE_LIST))
+    {
+        valuePush(ctxt, result);
+        return;
+    }
+
+    // The elements live in a result tree fragment owned by the transform.
+    xmlDocPtr container = xsltCreateRVT(transform);
+    xsltRegisterLocalRVT(transform, container);
+    list_t* list = object->type == OBJECT_TYPE_MAP ? &object->map : &object->list;
+    size_t position = 0;
+    bstring key = bfromcstr("");
+    HIVE_LIST_FOREACH(list, node)
+    {
+        void* item = node->data;
+        btrunc(key, 0);
+        if (object->type == OBJECT_TYPE_MAP)
+            hive_xslt_cfg_append(((struct map_entry*)item)->key, NULL, key);
+        else
+            bformata(key, "%zu", position++);
+        xmlNodePtr element = xmlNewDocRawNode(container, NULL, (const xmlChar*)"key", key->data);
+        xmlAddChild((xmlNodePtr)container, element);
+        xmlXPathNodeSetAddUnique(result->nodesetval, element);
+    }
+    bdestroy(key);
+    valuePush(ctxt, result);
+}
+
+///
+/// @brief Registers the cfg: extension functions with libxslt, and initializes
+///        the cache of compiled stylesheets.
+///
+/// Stylesheets that declare xmlns:cfg="urn:configd:cfg" can then look up
+/// values in the parsed source by path (keys separated by '/', with list
+/// items by position) instead of searching the generated XML, as in
+/// <xsl:value-of select="cfg:get('nss_map_attribute/uniqueMember')" />.
+///
+void hive_xslt_init(app_t* app)
+{
+    list_init(&app->stylesheets.entries);
+    list_init(&app->documents.entries);
+    xsltRegisterExtModuleFunction((const xmlChar*)"get", (const xmlChar*)HIVE_XSLT_CFG_NAMESPACE, hive_xslt_cfg_get);
+    xsltRegisterExtModuleFunction((const xmlChar*)"keys", (const xmlChar*)HIVE_XSLT_CFG_NAMESPACE, hive_xslt_cfg_keys);
+    xsltRegisterExtModuleFunction((const xmlChar*)"join", (const xmlChar*)HIVE_XSLT_CFG_NAMESPACE, hive_xslt_cfg_join);
+}
+
+///
+/// @brief Returns a compiled stylesheet, compiling it if it is new or has changed.
+///
+/// @param app The application.
+/// @param path The path of the stylesheet.
+/// @return The stylesheet (owned by the cache), or NULL if it is missing or invalid.
+///
+xsltStylesheetPtr hive_xslt_load(app_t* app, bstring path)
+{
+    struct stat st;
+    if (stat((const char*)path->data, &st) != 0)
+        return NULL;
+    struct hive_xslt_stylesheet* cached = NULL;
+    list_iterator_start(&app->stylesheets.entries);
+    while (cached == NULL && list_iterator_hasnext(&app->stylesheets.entries))
+    {
+        struct hive_xslt_stylesheet* stylesheet = list_iterator_next(&app->stylesheets.entries);
+        if (biseq(stylesheet->path, path))
+            cached = stylesheet;
+    }
+    list_iterator_stop(&app->stylesheets.entries);
+    if (cached != NULL)
+    {
+        if (cached->mtime.tv_sec == st.st_mtim.tv_sec && cached->mtime.tv_nsec == st.st_mtim.tv_nsec &&
+            cached->size == st.st_size)
+            return cached->compiled;
+        list_delete(&app->stylesheets.entries, cached);
+        hive_records_forget_stylesheet(app, cached->compiled);
+        xsltFreeStylesheet(cached->compiled);
+        bdestroy(cached->path);
+        free(cached);
+    }
+
+    // Parse the stylesheet into the dictionary of the current thread, which the
+    // compiled stylesheet and it's transforms then share with the source documents.
+    xmlParserCtxtPtr parser = xmlNewParserCtxt();
+    if (parser == NULL)
+        return NULL;
+    xmlDictFree(parser->dict);
+    parser->dict = hive_xslt_dict();
+    xmlDictReference(parser->dict);
+    xmlDocPtr doc = xmlCtxtReadFile(parser, (const char*)path->data, NULL, XSLT_PARSE_OPTIONS);
+    xmlFreeParserCtxt(parser);
+    if (doc == NULL)
+        return NULL;
+    xsltStylesheetPtr compiled = xsltParseStylesheetDoc(doc);
+    if (compiled == NULL)
+    {
+        xmlFreeDoc(doc);
+        return NULL;
+    }
+    struct hive_xslt_stylesheet* stylesheet = malloc(sizeof(struct hive_xslt_stylesheet));
+    stylesheet->path = bstrcpy(path);
+    stylesheet->mtime = st.st_mtim;
+    stylesheet->size = st.st_size;
+    stylesheet->compiled = compiled;
+    list_append(&app->stylesheets.entries, stylesheet);
+    return compiled;
+}
+
+///
+/// @internal
+/// @brief Applies a compiled stylesheet to a source document and serializes the
+///        result into a buffer, in the encoding the stylesheet asks for.
+///
+/// @return NULL, or the reason the stylesheet could not be applied.
+///
+const char* hive_xslt_apply(xsltStylesheetPtr style, const char** params, xmlDocPtr doc, struct hive_xslt_context* context, bstring result)
+{
+    xsltTransformContextPtr transform = xsltNewTransformContext(style, doc);
+    if (transform == NULL)
+        return "invalid application of xslt";
+    transform->_private = context;
+    if (params != NULL)
+        xsltQuoteUserParams(transform, params);
+    xmlDocPtr xml_result = xsltApplyStylesheetUser(style, doc, NULL, NULL, NULL, transform);
+    xsltFreeTransformContext(transform);
+    if (xml_result == NULL)
+        return "invalid application of xslt";
+
+    const xmlChar* encoding;
+    XSLT_GET_IMPORT_PTR(encoding, style, encoding);
+    xmlCharEncodingHandlerPtr encoder = encoding == NULL ? NULL : xmlFindCharEncodingHandler((const char*)encoding);
+    if (encoder != NULL && xmlStrcasecmp((const xmlChar*)encoder->name, (const xmlChar*)"UTF-8") == 0)
+        encoder = NULL;
+    xmlOutputBufferPtr output = xmlOutputBufferCreateIO(hive_xslt_write_xml_to_bstring, NULL, result, encoder);
+    bool saved = output != NULL && xsltSaveResultTo(output, xml_result, style) >= 0;
+    if (output != NULL)
+        saved = xmlOutputBufferClose(output) >= 0 && saved;
+    xmlFreeDoc(xml_result);
+    return saved ? NULL : "unable to serialize the result of xslt";
+}
+
+///
+/// @internal
+/// @brief The ranges of records rendered on one thread.
+///
+struct hive_xslt_worker
+{
+    pthread_t thread; ///< The thread that is rendering the ranges.
+    xsltStylesheetPtr style; ///< The stylesheet.
+    const char** params; ///< The stylesheet parameters.
+    struct hive_xslt_range* ranges; ///< The first range.
+    size_t count; ///< The number of ranges.
+    struct hive_xslt_context context; ///< What the cfg: functions resolve against.
+    const char* error; ///< NULL, or the reason a range could not be rendered.
+};
+
+///
+/// @internal
+/// @brief Renders the ranges of a worker, on the current thread.
+///
+void hive_xslt_worker_render(struct hive_xslt_worker* worker)
+{
+    worker->error = NULL;
+    for (size_t i = 0; i < worker->count && worker->error == NULL; i++)
+    {
+        struct hive_xslt_range* range = &worker->ranges[i];
+        xmlDocPtr doc = hive_xslt_entries_to_document(range->entries, range->count);
+        worker->context.used = false;
+        worker->error = hive_xslt_apply(worker->style, worker->params, doc, &worker->context, range->result);
+        range->lookups = worker->context.used;
+        xmlFreeDoc(doc);
+    }
+}
+
+///
+/// @internal
+/// @brief Renders the ranges of a worker on a worker thread.
+///
+void* hive_xslt_worker_run(void* arg)
+{
+    hive_xslt_worker_render(arg);
+    hive_xslt_thread_exit();
+    return NULL;
+}
+
+///
+/// @brief Whether a stylesheet declares that it renders the entries of the
+///        top-level map independently, and produces text.
+///
+/// @param style The stylesheet.
+/// @return Whether the stylesheet declares cfg:records="yes" and has text output.
+///
+bool hive_xslt_records(xsltStylesheetPtr style)
+{
+    xmlNodePtr root = xmlDocGetRootElement(style->doc);
+    xmlChar* records = root == NULL ? NULL : xmlGetNsProp(root, (const xmlChar*)"records", (const xmlChar*)HIVE_XSLT_CFG_NAMESPACE);
+    bool declared = records != NULL && xmlStrEqual(records, (const xmlChar*)"yes");
+    xmlFree(records);
+    const xmlChar* method;
+    XSLT_GET_IMPORT_PTR(method, style, method);
+    return declared && method != NULL && xmlStrEqual(method, (const xmlChar*)"text");
 }
 
-void hive_xslt_transform_with_path_to_file(bstring xslt_path, bstring xml_data, bstring output_path)
+///
+/// @brief Returns the number of threads to render the records of an object tree
+///        on, or 1 if they should be rendered on the current thread.
+///
+/// @param app The application.
+/// @param style The stylesheet.
+/// @param object The parsed source.
+/// @return The number of threads, at most HIVE_XSLT_THREADS_MAX.
+///
+size_t hive_xslt_record_threads(app_t* app, xsltStylesheetPtr style, struct object* object)
+{
+    if (object->type != OBJECT_TYPE_MAP || !hive_xslt_records(style))
+        return 1;
+    size_t threads = app->render.threads;
+    if (threads == 0)
+    {
+        long processors = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = processors < 1 ? 1 : (size_t)processors;
+        if (threads > list_size(&object->map) / HIVE_XSLT_RECORDS_PER_THREAD)
+            threads = list_size(&object->map) / HIVE_XSLT_RECORDS_PER_THREAD;
+    }
+    if (threads > HIVE_XSLT_THREADS_MAX)
+        threads = HIVE_XSLT_THREADS_MAX;
+    if (threads > list_size(&object->map))
+        threads = list_size(&object->map);
+    return threads < 1 ? 1 : threads;
+}
+
+///
+/// @brief Renders ranges of the records of an object tree, each on it's own.
+///
+/// Each range is rendered from a document with only it's own entries, so
+/// the result is only what rendering the whole map would produce for those
+/// entries with stylesheets that declare cfg:records="yes".  The cfg:
+/// functions still see the whole tree.  The ranges are split evenly between
+/// the threads; if a thread cannot be started, it's ranges are rendered on
+/// this thread instead.
+///
+/// @param style The stylesheet.
+/// @param params The stylesheet parameters as name, value pairs followed by NULL, or NULL.
+/// @param object The parsed source, which the entries of the ranges belong to.
+/// @param ranges The ranges, whose results are appended to.
+/// @param count The number of ranges.
+/// @param threads The number of threads, from hive_xslt_record_threads.
+/// @return NULL, or the reason the stylesheet could not be applied.
+///
+const char* hive_xslt_apply_ranges(xsltStylesheetPtr style, const char** params, struct object* object,
+                                   struct hive_xslt_range* ranges, size_t count, size_t threads)
+{
+    if (threads > count)
+        threads = count;
+    if (threads < 1)
+        threads = 1;
+
+    // The index is shared by every thread, and only built once a cfg:
+    // function looks something up.
+    struct hive_xslt_shared shared = { .index = NULL };
+    pthread_mutex_init(&shared.lock, NULL);
+    struct hive_xslt_worker workers[HIVE_XSLT_THREADS_MAX];
+    bool started[HIVE_XSLT_THREADS_MAX];
+    size_t offset = 0;
+    for (size_t i = 0; i < threads; i++)
+    {
+        size_t share = count / threads + (i < count % threads ? 1 : 0);
+        workers[i].style = style;
+        workers[i].params = params;
+        workers[i].ranges = ranges + offset;
+        workers[i].count = share;
+        workers[i].context.root = object;
+        workers[i].context.index = NULL;
+        workers[i].context.used = false;
+        workers[i].context.shared = &shared;
+        started[i] = threads > 1 && pthread_create(&workers[i].thread, NULL, hive_xslt_worker_run, &workers[i]) == 0;
+        if (!started[i])
+            hive_xslt_worker_render(&workers[i]);
+        offset += share;
+    }
+    const char* error = NULL;
+    for (size_t i = 0; i < threads; i++)
+    {
+        if (started[i])
+            pthread_join(workers[i].thread, NULL);
+        if (error == NULL)
+            error = workers[i].error;
+    }
+    hive_index_free(shared.index);
+    pthread_mutex_destroy(&shared.lock);
+    return error;
+}
+
+///
+/// @internal
+/// @brief Renders the records of an object tree in one range per thread, and
+///        appends the results in order.
+///
+/// @return NULL, or the reason the stylesheet could not be applied.
+///
+const char* hive_xslt_apply_records(xsltStylesheetPtr style, const char** params, struct object* object, size_t threads, bstring result)
+{
+    size_t count = list_size(&object->map);
+    struct map_entry** entries = malloc(count * sizeof(struct map_entry*));
+    size_t position = 0;
+    list_iterator_start(&object->map);
+    while (list_iterator_hasnext(&object->map))
+        entries[position++] = list_iterator_next(&object->map);
+    list_iterator_stop(&object->map);
+
+    struct hive_xslt_range ranges[HIVE_XSLT_THREADS_MAX];
+    size_t offset = 0;
+    for (size_t i = 0; i < threads; i++)
+    {
+        ranges[i].count = count / threads + (i < count % threads ? 1 : 0);
+        ranges[i].entries = entries + offset;
+        ranges[i].result = bfromcstralloc(4096, "");
+        offset += ranges[i].count;
+    }
+    const char* error = hive_xslt_apply_ranges(style, params, object, ranges, threads, threads);
+    for (size_t i = 0; i < threads; i++)
+    {
+        if (error == NULL)
+            bconcat(result, ranges[i].result);
+        bdestroy(ranges[i].result);
+    }
+    free(entries);
+    return error;
+}
+
+///
+/// @internal
+/// @brief Applies a stylesheet to an object tree and serializes the result into
+///        memory, reusing what was rendered for the output before if it can.
+///
+/// @return Whether the stylesheet was applied (the reason is printed if not).
+///
+bool hive_xslt_render(app_t* app, bstring xslt_path, const char** params, struct object* object, bstring output_path,
+                      bstring result, struct hive_stats_output* stats)
 {
     xmlSubstituteEntitiesDefault(1);
     xmlLoadExtDtdDefaultValue = 1;
-    xsltStylesheetPtr xslt_doc = xsltParseStylesheetFile((const xmlChar*)xslt_path->data);
+    uint64_t start = hive_stats_now();
+    hive_trace_begin("hive_xslt_load", (const char*)xslt_path->data);
+    xsltStylesheetPtr xslt_doc = hive_xslt_load(app, xslt_path);
+    hive_trace_end("hive_xslt_load");
+    hive_stats_record(stats, HIVE_STAGE_COMPILE, hive_stats_now() - start);
     if (xslt_doc == NULL)
     {
         fprintf(stderr, "invalid xslt: %s\n", xslt_path->data);
-        return;
+        return false;
     }
-    xmlDocPtr xml_doc = xmlReadMemory((const char*)xml_data->data, blength(xml_data), "unnamed.xml", NULL, 0);
-    if (xml_doc == NULL)
+
+    // Records are rendered from documents of their own, so they skip the pool;
+    // for outputs, only the records that changed since the last render are.
+    const char* error;
+    size_t threads = hive_xslt_record_threads(app, xslt_doc, object);
+    if (output_path != NULL && object->type == OBJECT_TYPE_MAP && hive_xslt_records(xslt_doc))
     {
-        fprintf(stderr, "invalid internal generation for: %s\n", output_path->data);
-        return;
+        start = hive_stats_now();
+        hive_trace_begin("hive_records_render", NULL);
+        error = hive_records_render(app, output_path, xslt_doc, params, object, threads, result);
+        hive_trace_end("hive_records_render");
+        hive_stats_record(stats, HIVE_STAGE_APPLY, hive_stats_now() - start);
     }
-    xmlDocPtr xml_result = xsltApplyStylesheet(xslt_doc, xml_doc, NULL);
-    if (xml_result == NULL)
+    else if (threads > 1)
     {
-        fprintf(stderr, "invalid application of xslt: %s\n", xslt_path->data);
-        return;
+        start = hive_stats_now();
+        hive_trace_begin("hive_xslt_apply_records", NULL);
+        error = hive_xslt_apply_records(xslt_doc, params, object, threads, result);
+        hive_trace_end("hive_xslt_apply_records");
+        hive_stats_record(stats, HIVE_STAGE_APPLY, hive_stats_now() - start);
     }
-    xsltSaveResultToFilename((const char*)output_path->data, xml_result, xslt_doc, 0);
-    xsltFreeStylesheet(xslt_doc);
-    xmlFreeDoc(xml_doc);
-    xmlFreeDoc(xml_result);
-}
\ No newline at end of file
+    else
+    {
+        start = hive_stats_now();
+        hive_trace_begin("hive_xslt_document", NULL);
+        bool built;
+        xmlDocPtr xml_doc = hive_xslt_document(app, object, &built);
+        hive_trace_end("hive_xslt_document");
+        if (built)
+            hive_stats_record(stats, HIVE_STAGE_CONVERT, hive_stats_now() - start);
+        hive_stats_record(stats, HIVE_STAGE_LOAD, hive_stats_now() - start);
+        start = hive_stats_now();
+        hive_trace_begin("xsltApplyStylesheet", NULL);
+        struct hive_xslt_context context = { object, NULL, false, NULL };
+        error = hive_xslt_apply(xslt_doc, params, xml_doc, &context, result);
+        hive_index_free(context.index);
+        hive_trace_end("xsltApplyStylesheet");
+        hive_stats_record(stats, HIVE_STAGE_APPLY, hive_stats_now() - start);
+    }
+    if (error != NULL)
+        fprintf(stderr, "%s: %s\n", error, xslt_path->data);
+    return error == NULL;
+}
+
+///
+/// @brief Applies a stylesheet to an object tree and serializes the result into memory.
+///
+/// The stylesheet is compiled once and kept until it changes, so outputs
+/// that share it only differ in the parameters they pass.
+///
+/// Stylesheets with text output that render each entry of the top-level
+/// map on it's own (like one line per host) can declare cfg:records="yes"
+/// on <xsl:stylesheet>.  Large maps are then split into ranges of entries
+/// that are rendered in parallel, on up to HIVE_XSLT_THREADS_MAX threads
+/// (or app->render.threads, if it is set), and joined in order.
+///
+/// @param app The application.
+/// @param xslt_path The path of the stylesheet.
+/// @param params The stylesheet parameters as name, value pairs followed by NULL (the
+///               values are literal strings, not XPath expressions), or NULL.
+/// @param object The parsed source.
+/// @param result The buffer to append the result to.
+/// @param stats The statistics to record the latency of each stage in, or NULL.
+/// @return Whether the stylesheet was applied (the reason is printed if not).
+///
+bool hive_xslt_transform_to_bstring(app_t* app, bstring xslt_path, const char** params, struct object* object, bstring result, struct hive_stats_output* stats)
+{
+    return hive_xslt_render(app, xslt_path, params, object, NULL, result, stats);
+}
+
+///
+/// @brief Applies a stylesheet to an object tree and saves the result.
+///
+/// For stylesheets that declare cfg:records="yes", the output remembers
+/// what each block of records rendered to, and only the records that
+/// changed are rendered again (see hive_records.c).
+///
+/// @param app The application.
+/// @param xslt_path The path of the stylesheet.
+/// @param params The stylesheet parameters as name, value pairs followed by NULL, or NULL.
+/// @param object The parsed source.
+/// @param output_path The path to save the result to.
+/// @param stats The statistics to record the latency of each stage in, or NULL.
+///
+void hive_xslt_transform_with_path_to_file(app_t* app, bstring xslt_path, const char** params, struct object* object, bstring output_path, struct hive_stats_output* stats)
+{
+    bstring result = hive_output_buffer();
+    if (!hive_xslt_render(app, xslt_path, params, object, output_path, result, stats))
+        return;
+    uint64_t start = hive_stats_now();
+    hive_trace_begin("hive_output_write", (const char*)output_path->data);
+    hive_output_write(app, output_path, result);
+    hive_trace_end("hive_output_write");
+    hive_stats_record(stats, HIVE_STAGE_WRITE, hive_stats_now() - start);
+}
@@ -1,10 +1,58 @@
 #ifndef __HIVE_XSLT_H
 #define __HIVE_XSLT_H
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+#include <sys/types.h>
 #include <bstrlib.h>
+#include <libxslt/xsltInternals.h>
+#include "hive_app.h"
 #include "hive_object.h"
 
+struct hive_stats_output;
+
+///
+/// @brief A compiled stylesheet, kept until the file changes.
+///
+struct hive_xslt_stylesheet
+{
+    bstring path; ///< The path of the stylesheet.
+    struct timespec mtime; ///< The modification time of the file when it was compiled.
+    off_t size; ///< The size of the file when it was compiled.
+    xsltStylesheetPtr compiled; ///< The compiled stylesheet.
+};
+
+///
+/// @brief A range of the entries of a map, rendered on it's own.
+///
+struct hive_xslt_range
+{
+    struct map_entry** entries; ///< The first entry of the range.
+    size_t count; ///< The number of entries in the range.
+    bstring result; ///< The buffer to append the rendered range to.
+    bool lookups; ///< Set to whether rendering the range called a cfg: function.
+};
+
+#define HIVE_XSLT_CFG_NAMESPACE "urn:configd:cfg" ///< The namespace of the cfg: extension functions.
+#define HIVE_XSLT_POOL_SIZE 16 ///< The number of source documents kept for reuse.
+#define HIVE_XSLT_THREADS_MAX 8 ///< The largest number of threads that records are rendered on.
+#define HIVE_XSLT_RECORDS_PER_THREAD 1024 ///< The fewest records worth starting a thread for.
+
+void hive_xslt_init(app_t* app);
+xsltStylesheetPtr hive_xslt_load(app_t* app, bstring path);
+xmlDictPtr hive_xslt_dict();
+void hive_xslt_thread_exit();
 bstring hive_xslt_object_to_xml(struct object* object);
-void hive_xslt_transform_with_path_to_file(bstring xslt_path, bstring xml_data, bstring output_path);
+xmlDocPtr hive_xslt_object_to_document(struct object* object);
+xmlDocPtr hive_xslt_document(app_t* app, struct object* object, bool* built);
+void hive_xslt_release(app_t* app, struct object* object);
+int hive_xslt_write_xml_to_bstring(void* context, const char* buffer, int len);
+bool hive_xslt_records(xsltStylesheetPtr style);
+size_t hive_xslt_record_threads(app_t* app, xsltStylesheetPtr style, struct object* object);
+const char* hive_xslt_apply_ranges(xsltStylesheetPtr style, const char** params, struct object* object,
+                                   struct hive_xslt_range* ranges, size_t count, size_t threads);
+bool hive_xslt_transform_to_bstring(app_t* app, bstring xslt_path, const char** params, struct object* object, bstring result, struct hive_stats_output* stats);
+void hive_xslt_transform_with_path_to_file(app_t* app, bstring xslt_path, const char** params, struct object* object, bstring output_path, struct hive_stats_output* stats);
 
 #endif
\ No newline at end of file
@@ -50,6 +50,7 @@ struct object* hive_yaml_parse(yaml_parser_t* parser, yaml_event_t* event)
             struct object* result = malloc(sizeof(struct object));
             memset(result, 0, sizeof(struct object));
             result->type = OBJECT_TYPE_NIL;
+            hive_object_hash(result);
             return result;
         }
         case YAML_DOCUMENT_START_EVENT:
@@ -72,6 +73,7 @@ struct object* hive_yaml_parse(yaml_parser_t* parser, yaml_event_t* event)
                 list_append(&result->map, entry);
                 entry = hive_yaml_parse_mapping(parser);
             }
+            hive_object_hash(result);
             return result;
         }
         case YAML_SCALAR_EVENT:
@@ -80,6 +82,7 @@ struct object* hive_yaml_parse(yaml_parser_t* parser, yaml_event_t* event)
             memset(result, 0, sizeof(struct object));
             result->type = OBJECT_TYPE_STRING;
             result->string = bfromcstr((const char*)event->data.scalar.value);
+            hive_object_hash(result);
             return result;
         }
         case YAML_SEQUENCE_START_EVENT:
@@ -94,6 +97,7 @@ struct object* hive_yaml_parse(yaml_parser_t* parser, yaml_event_t* event)
                 list_append(&result->list, entry);
                 entry = hive_yaml_parse_sequence(parser);
             }
+            hive_object_hash(result);
             return result;
         }
         default:
@@ -105,34 +109,48 @@ struct object* hive_yaml_parse(yaml_parser_t* parser, yaml_event_t* event)
 }
 
 ///
-/// @brief Reads in a YAML file and returns an object result.
+/// @brief Parses YAML content that has already been read into memory.
 ///
-/// @param path The path to read from.
-/// @return The resulting object structure.
+/// @param content The YAML content.
+/// @return The resulting object structure, or NULL if the content could not be parsed.
 ///
-struct object* hive_yaml_parse_file(bstring path)
+struct object* hive_yaml_parse_string(bstring content)
 {
     yaml_event_t event;
     yaml_parser_t parser;
-    
-    struct object* result = malloc(sizeof(struct object*));
-
-    int done = 0;
-    FILE* file = fopen((const char*)path->data, "rb");
-    if (file == NULL)
-        return NULL;
-    bstring content = bread(&fread, file);
-    fclose(file);
+    struct object* result;
     
     yaml_parser_initialize(&parser);
     yaml_parser_set_input_string(&parser, content->data, blength(content));
     
     if (!yaml_parser_parse(&parser, &event))
+    {
+        yaml_parser_delete(&parser);
         return NULL;
+    }
     
     result = hive_yaml_parse(&parser, &event);
     
     yaml_parser_delete(&parser);
+    
+    return result;
+}
+
+///
+/// @brief Reads in a YAML file and returns an object result.
+///
+/// @param path The path to read from.
+/// @return The resulting object structure.
+///
+struct object* hive_yaml_parse_file(bstring path)
+{
+    FILE* file = fopen((const char*)path->data, "rb");
+    if (file == NULL)
+        return NULL;
+    bstring content = bread(&fread, file);
+    fclose(file);
+    
+    struct object* result = hive_yaml_parse_string(content);
     bdestroy(content);
     
     return result;
@@ -3,6 +3,7 @@
 
 #include "hive_object.h"
 
+struct object* hive_yaml_parse_string(bstring content);
 struct object* hive_yaml_parse_file(bstring path);
 
 #endif
\ No newline at end of file
@@ -1,35 +1,91 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <sys/types.h>
 #include <dirent.h>
 #include <bstrlib.h>
 #include "hive_yaml.h"
 #include "hive_app.h"
+#include "hive_watch.h"
 
 int main(int argc, char** argv)
 {
     bstring etc_path = bfromcstr("/etc/configd");
     bstring mount_path = bfromcstr("/etc");
+    bstring cache_path = NULL;
+    bstring stats_path = NULL;
+    bstring trace_path = NULL;
+    bstring record_path = NULL;
+    bstring priority_path = NULL;
+    const struct hive_watch_backend* backend = NULL;
+    unsigned long interval = 0;
+    int option;
     
     // TODO: Use argtable2.
-    if (argc != 1 && argc != 3)
+    while ((option = getopt(argc, argv, "c:s:t:r:w:i:p:")) != -1)
+    {
+        switch (option)
+        {
+            case 'c':
+                cache_path = bfromcstr(optarg);
+                break;
+            case 's':
+                stats_path = bfromcstr(optarg);
+                break;
+            case 't':
+                trace_path = bfromcstr(optarg);
+                break;
+            case 'r':
+                record_path = bfromcstr(optarg);
+                break;
+            case 'p':
+                priority_path = bfromcstr(optarg);
+                break;
+            case 'w':
+                backend = hive_watch_find(optarg);
+                if (backend == NULL)
+                {
+                    printf("unknown watch backend: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'i':
+                interval = strtoul(optarg, NULL, 10);
+                break;
+            default:
+                printf("invalid arguments.\n");
+                return 1;
+        }
+    }
+    if (argc - optind != 0 && argc - optind != 2)
     {
         printf("invalid arguments.\n");
         return 1;
     }
-    else if (argc == 3)
+    else if (argc - optind == 2)
     {
-        etc_path = bfromcstr(argv[1]);
-        mount_path = bfromcstr(argv[2]);
+        etc_path = bfromcstr(argv[optind]);
+        mount_path = bfromcstr(argv[optind + 1]);
     }
     
     // Open a reference to the configuration directory, as our mountpoint
     // may hide it.
     app_t app;
+    memset(&app, 0, sizeof(app));
     app.active.path = mount_path;
     app.active.content = opendir((const char*)app.active.path);
     app.source.path = etc_path;
     app.source.content = opendir((const char*)app.source.path);
+    app.cache.path = cache_path;
+    app.stats.path = stats_path;
+    app.trace.path = trace_path;
+    app.record.path = record_path;
+    app.sched.path = priority_path;
+    app.snapshot.name = NULL;
+    app.source.backend = backend;
+    app.poll.interval = interval;
     
     app_init(&app);
     app_run(&app);
-}
\ No newline at end of file
+}